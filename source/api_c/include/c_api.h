@@ -257,6 +257,18 @@ double DP_DeepPotModelDeviGetCutoff(DP_DeepPotModelDevi* dp);
 */
 int DP_DeepPotModelDeviGetNumbTypes(DP_DeepPotModelDevi* dp);
 
+/**
+ * @brief Evaluate synthetic frames by a DP model deviation, so that the kernels are
+ * selected and the memory is allocated before the first real evaluation.
+ * @param[in] dp The DP model deviation to use.
+ * @param[in] natoms The number of local atoms.
+ * @param[in] nghost The number of ghost atoms.
+ * @param[in] nsteps The number of evaluations.
+ * @note The next evaluation with a neighbor list rebuilds the internal list from
+ * the given one, as if ago were 0, since the warm-up frames replace it.
+*/
+void DP_DeepPotModelDeviWarmup(DP_DeepPotModelDevi* dp, const int natoms, const int nghost, const int nsteps);
+
 /**
  * @brief Get the type map of a DP.
  * @param[in] dp The DP to use.
@@ -278,6 +290,19 @@ int DP_DeepPotGetNumbTypes(DP_DeepPot* dp);
 */
 const char* DP_DeepPotGetTypeMap(DP_DeepPot* dp);
 
+/**
+ * @brief Evaluate synthetic frames by a DP, so that the kernels are selected and
+ * the memory is allocated before the first real evaluation.
+ * @param[in] dp The DP to use.
+ * @param[in] natoms The number of local atoms.
+ * @param[in] nghost The number of ghost atoms. If it is 0, the periodic frames are evaluated,
+ * otherwise the frames with the neighbor list are evaluated.
+ * @param[in] nsteps The number of evaluations.
+ * @note The next evaluation with a neighbor list rebuilds the internal list from
+ * the given one, as if ago were 0, since the warm-up frames replace it.
+*/
+void DP_DeepPotWarmup(DP_DeepPot* dp, const int natoms, const int nghost, const int nsteps);
+
 /**
 * @brief The deep tensor.
 **/
@@ -691,6 +691,18 @@ namespace deepmd
                 assert(dp);
                 return DP_DeepPotGetNumbTypes(dp);
             };
+            /**
+             * @brief Evaluate synthetic frames, so that the kernels are selected and the memory is allocated before the first real evaluation.
+             * @param[in] natoms The number of local atoms.
+             * @param[in] nghost The number of ghost atoms. If it is 0, the periodic frames are evaluated, otherwise the frames with the neighbor list are evaluated.
+             * @param[in] nsteps The number of evaluations.
+             * @note The next evaluation with a neighbor list rebuilds the internal list from the given one, as if ago were 0, since the warm-up frames replace it.
+             **/
+            void warmup(const int &natoms, const int &nghost = 0, const int &nsteps = 2)
+            {
+                assert(dp);
+                DP_DeepPotWarmup(dp, natoms, nghost, nsteps);
+            };
             /**
              * @brief Get the type map (element name of the atom types) of this model.
              * @param[out] type_map The type map of this model.
@@ -894,6 +906,18 @@ namespace deepmd
                 assert(dp);
                 return DP_DeepPotModelDeviGetNumbTypes(dp);
             };
+            /**
+             * @brief Evaluate synthetic frames by the models, so that the kernels are selected and the memory is allocated before the first real evaluation.
+             * @param[in] natoms The number of local atoms.
+             * @param[in] nghost The number of ghost atoms.
+             * @param[in] nsteps The number of evaluations.
+             * @note The next evaluation with a neighbor list rebuilds the internal list from the given one, as if ago were 0, since the warm-up frames replace it.
+             **/
+            void warmup(const int &natoms, const int &nghost = 0, const int &nsteps = 2)
+            {
+                assert(dp);
+                DP_DeepPotModelDeviWarmup(dp, natoms, nghost, nsteps);
+            };
 
         private:
             DP_DeepPotModelDevi *dp;
@@ -739,6 +739,15 @@ int DP_DeepPotGetNumbTypes(
     return dp->dp.numb_types();
 }
 
+void DP_DeepPotWarmup(
+    DP_DeepPot* dp,
+    const int natoms,
+    const int nghost,
+    const int nsteps
+    ) {
+    dp->dp.warmup(natoms, nghost, nsteps);
+}
+
 void DP_DeepPotModelDeviComputeNList (
     DP_DeepPotModelDevi* dp,
     const int natoms,
@@ -787,6 +796,15 @@ int DP_DeepPotModelDeviGetNumbTypes(
     return dp->dp.numb_types();
 }
 
+void DP_DeepPotModelDeviWarmup(
+    DP_DeepPotModelDevi* dp,
+    const int natoms,
+    const int nghost,
+    const int nsteps
+    ) {
+    dp->dp.warmup(natoms, nghost, nsteps);
+}
+
 void DP_DeepTensorComputeTensor (
     DP_DeepTensor* dt,
     const int natoms,
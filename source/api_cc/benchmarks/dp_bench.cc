@@ -0,0 +1,373 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sys/resource.h>
+#include "DeepPot.h"
+#include "coord.h"
+#include "region.h"
+#include "neighbor_list.h"
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+// the atoms of a periodic box
+struct Frame
+{
+  std::vector<double> coord;
+  std::vector<int> atype;
+  // the rows are the cell vectors
+  std::vector<double> box;
+};
+
+// read the box and the atoms of a LAMMPS data file of the atomic style,
+// the types are shifted to start from 0
+static Frame
+read_lammps_data(const std::string & file_name)
+{
+  std::ifstream fp(file_name);
+  if (!fp.is_open()) {
+    throw deepmd::deepmd_exception("cannot open the data file " + file_name);
+  }
+  Frame frame;
+  double lo[3] = {0., 0., 0.}, hi[3] = {0., 0., 0.}, tilt[3] = {0., 0., 0.};
+  int natoms = 0;
+  std::string line;
+  while (std::getline(fp, line)) {
+    std::istringstream iss(line);
+    if (line.find("atoms") != std::string::npos) {
+      iss >> natoms;
+    }
+    else if (line.find("xlo xhi") != std::string::npos) {
+      iss >> lo[0] >> hi[0];
+    }
+    else if (line.find("ylo yhi") != std::string::npos) {
+      iss >> lo[1] >> hi[1];
+    }
+    else if (line.find("zlo zhi") != std::string::npos) {
+      iss >> lo[2] >> hi[2];
+    }
+    else if (line.find("xy xz yz") != std::string::npos) {
+      iss >> tilt[0] >> tilt[1] >> tilt[2];
+    }
+    else if (line.compare(0, 5, "Atoms") == 0) {
+      break;
+    }
+  }
+  frame.box = {hi[0] - lo[0], 0., 0.,
+	       tilt[0], hi[1] - lo[1], 0.,
+	       tilt[1], tilt[2], hi[2] - lo[2]};
+  frame.coord.resize(natoms * 3);
+  frame.atype.resize(natoms);
+  int nread = 0;
+  while (nread < natoms && std::getline(fp, line)) {
+    std::istringstream iss(line);
+    int id, type;
+    double xx[3];
+    if (!(iss >> id >> type >> xx[0] >> xx[1] >> xx[2])) continue;
+    if (id < 1 || id > natoms) {
+      throw deepmd::deepmd_exception("invalid atom id in the data file " + file_name);
+    }
+    for (int dd = 0; dd < 3; ++dd) {
+      frame.coord[(id - 1) * 3 + dd] = xx[dd] - lo[dd];
+    }
+    frame.atype[id - 1] = type - 1;
+    nread++;
+  }
+  if (nread != natoms || natoms == 0) {
+    throw deepmd::deepmd_exception("cannot read the atoms of the data file " + file_name);
+  }
+  return frame;
+}
+
+// replicate the cell along the shortest direction until there are at least natoms atoms
+static Frame
+replicate(const Frame & cell, const int & natoms)
+{
+  const int ncell = cell.atype.size();
+  int nn[3] = {1, 1, 1};
+  while (nn[0] * nn[1] * nn[2] * ncell < natoms) {
+    int dmin = 0;
+    for (int dd = 1; dd < 3; ++dd) {
+      if (nn[dd] * cell.box[dd * 4] < nn[dmin] * cell.box[dmin * 4]) dmin = dd;
+    }
+    nn[dmin]++;
+  }
+  Frame frame;
+  frame.box = cell.box;
+  for (int dd = 0; dd < 3; ++dd) {
+    for (int kk = 0; kk < 3; ++kk) {
+      frame.box[dd * 3 + kk] *= nn[dd];
+    }
+  }
+  for (int ii = 0; ii < nn[0]; ++ii) {
+    for (int jj = 0; jj < nn[1]; ++jj) {
+      for (int kk = 0; kk < nn[2]; ++kk) {
+	for (int aa = 0; aa < ncell; ++aa) {
+	  for (int dd = 0; dd < 3; ++dd) {
+	    frame.coord.push_back(cell.coord[aa * 3 + dd]
+				  + ii * cell.box[0 * 3 + dd]
+				  + jj * cell.box[1 * 3 + dd]
+				  + kk * cell.box[2 * 3 + dd]);
+	  }
+	  frame.atype.push_back(cell.atype[aa]);
+	}
+      }
+    }
+  }
+  return frame;
+}
+
+// randomly permute the atoms, as the order of the atoms in the MD codes
+// is unrelated to their positions after many steps
+static void
+shuffle_atoms(Frame & frame)
+{
+  const int natoms = frame.atype.size();
+  std::vector<int> perm(natoms);
+  for (int ii = 0; ii < natoms; ++ii) perm[ii] = ii;
+  std::mt19937 gen(20230601);
+  std::shuffle(perm.begin(), perm.end(), gen);
+  Frame out = frame;
+  for (int ii = 0; ii < natoms; ++ii) {
+    for (int dd = 0; dd < 3; ++dd) {
+      out.coord[ii * 3 + dd] = frame.coord[perm[ii] * 3 + dd];
+    }
+    out.atype[ii] = frame.atype[perm[ii]];
+  }
+  frame = out;
+}
+
+// the ghost atoms and the neighbor list of a frame, built with rcut + skin
+// and kept while the atoms move by less than skin / 2, as in the MD codes
+struct GhostNlist
+{
+  int nloc, nall;
+  std::vector<double> coord_cpy, shift;
+  std::vector<int> atype_cpy, mapping;
+  deepmd::NeighborListData nlist_data;
+  deepmd::InputNlist inlist;
+  void build(const Frame & frame, const double & rc) {
+    deepmd::Region<double> region;
+    deepmd::init_region_cpu(region, &frame.box[0]);
+    nloc = frame.atype.size();
+    // the perturbed atoms may be out of the box
+    std::vector<double> coord(frame.coord);
+    deepmd::normalize_coord_cpu(&coord[0], nloc, region);
+    // the exact nall is given if the buffers are too small, so the copy is
+    // redone at most once
+    if (deepmd::copy_coord_cpu(
+	    coord_cpy.data(), atype_cpy.data(), mapping.data(), &nall,
+	    &coord[0], &frame.atype[0], nloc, int(mapping.size()), rc, region) == 1) {
+      coord_cpy.resize(nall * 3);
+      atype_cpy.resize(nall);
+      mapping.resize(nall);
+      deepmd::copy_coord_cpu(
+	  &coord_cpy[0], &atype_cpy[0], &mapping[0], &nall,
+	  &coord[0], &frame.atype[0], nloc, nall, rc, region);
+    }
+    shift.resize(nall * 3);
+    for (int ii = 0; ii < nall; ++ii) {
+      for (int dd = 0; dd < 3; ++dd) {
+	shift[ii * 3 + dd] = coord_cpy[ii * 3 + dd] - frame.coord[mapping[ii] * 3 + dd];
+      }
+    }
+    int mem_size = 256, max_list_size;
+    std::vector<int> ilist(nloc), numneigh(nloc), jlist;
+    std::vector<int*> firstneigh(nloc);
+    while (true) {
+      jlist.resize((size_t)nloc * mem_size);
+      for (int ii = 0; ii < nloc; ++ii) {
+	firstneigh[ii] = &jlist[(size_t)ii * mem_size];
+      }
+      deepmd::InputNlist tmp_list(nloc, &ilist[0], &numneigh[0], &firstneigh[0]);
+      if (deepmd::build_nlist_cell_cpu(
+	      tmp_list, &max_list_size, &coord_cpy[0],
+	      nloc, nall, mem_size, rc, region) == 0) {
+	nlist_data.copy_from_nlist(tmp_list);
+	break;
+      }
+      mem_size = max_list_size;
+    }
+    nlist_data.make_inlist(inlist);
+  }
+  // move the ghost atoms with the local atoms
+  void update(const Frame & frame) {
+    for (int ii = 0; ii < nall; ++ii) {
+      for (int dd = 0; dd < 3; ++dd) {
+	coord_cpy[ii * 3 + dd] = frame.coord[mapping[ii] * 3 + dd] + shift[ii * 3 + dd];
+      }
+    }
+  }
+};
+
+// the peak resident set size in MB, of the whole process so far
+static double
+peak_rss_mb()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+  return usage.ru_maxrss / 1024. / 1024.;
+#else
+  return usage.ru_maxrss / 1024.;
+#endif
+}
+
+static json
+summarize(std::vector<double> latency, const int & natoms, const double & timestep)
+{
+  std::sort(latency.begin(), latency.end());
+  const int nsteps = latency.size();
+  double sum = 0.;
+  for (double tt : latency) sum += tt;
+  const double mean = sum / nsteps;
+  auto percentile = [&](const double pp) {
+    int idx = std::min(nsteps - 1, (int)std::ceil(pp / 100. * nsteps) - 1);
+    return latency[std::max(idx, 0)] * 1e3;
+  };
+  json result;
+  result["steps"] = nsteps;
+  result["latency_ms"] = {
+    {"mean", mean * 1e3},
+    {"min", latency.front() * 1e3},
+    {"p50", percentile(50)},
+    {"p90", percentile(90)},
+    {"p99", percentile(99)},
+    {"max", latency.back() * 1e3},
+  };
+  result["atom_steps_per_second"] = natoms / mean;
+  // fs per step -> ns per day
+  result["ns_per_day"] = timestep * 1e-6 * 86400. / mean;
+  return result;
+}
+
+// time each step of a mode, the coordinates are perturbed from the
+// reference at each step, and the neighbor list is rebuilt every nlist_freq steps
+template <typename COMPUTE>
+static json
+run_mode(COMPUTE compute,
+	 GhostNlist * ghost,
+	 const Frame & frame_ref,
+	 const double & rc,
+	 const json & jdata)
+{
+  const int nsteps = jdata.value("nsteps", 100);
+  const int nwarmup = jdata.value("nwarmup", 5);
+  const int nlist_freq = jdata.value("nlist_freq", 10);
+  const double perturb = jdata.value("perturb", 0.01);
+  const double timestep = jdata.value("timestep", 0.5);
+  std::mt19937 gen(20230601);
+  std::uniform_real_distribution<double> uniform(-perturb, perturb);
+  Frame frame = frame_ref;
+  std::vector<double> latency;
+  for (int step = 0; step < nwarmup + nsteps; ++step) {
+    for (int ii = 0; ii < frame.coord.size(); ++ii) {
+      frame.coord[ii] = frame_ref.coord[ii] + uniform(gen);
+    }
+    int ago = step % nlist_freq;
+    if (ghost == NULL) {
+      // the periodic images are handled by DeepPot
+    }
+    else if (ago == 0) {
+      ghost->build(frame, rc);
+    }
+    else {
+      ghost->update(frame);
+    }
+    // the ghost atoms and the neighbor list of the MD code are not timed
+    auto start = std::chrono::steady_clock::now();
+    compute(frame, ago);
+    auto end = std::chrono::steady_clock::now();
+    if (step >= nwarmup) {
+      latency.push_back(std::chrono::duration<double>(end - start).count());
+    }
+  }
+  return summarize(latency, frame.atype.size(), timestep);
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc == 1) {
+    std::cerr << "usage " << std::endl;
+    std::cerr << argv[0] << " input_script " << std::endl;
+    return 1;
+  }
+
+  std::ifstream fp (argv[1]);
+  json jdata;
+  fp >> jdata;
+
+  if (jdata.value("nsteps", 100) < 1 || jdata.value("nlist_freq", 10) < 1) {
+    std::cerr << "nsteps and nlist_freq should be positive" << std::endl;
+    return 1;
+  }
+  std::vector<std::string> models = jdata["models"];
+  Frame cell = read_lammps_data(jdata["data_file"]);
+  Frame frame = replicate(cell, jdata.value("natoms", (int)cell.atype.size()));
+  if (jdata.value("shuffle", false)) {
+    shuffle_atoms(frame);
+  }
+  // read by DeepPot and DeepPotModelDevi at the initialization
+  if (jdata.value("spatial_sort", false)) {
+    setenv("DP_SPATIAL_SORT", "1", 1);
+  }
+  std::vector<std::string> modes = jdata.value("modes", std::vector<std::string>({"no_nlist", "nlist", "model_devi"}));
+  const double skin = jdata.value("skin", 2.0);
+  const int nlocal = frame.atype.size();
+
+  deepmd::DeepPot deep_pot;
+  deep_pot.init(models[0]);
+  const double rc = deep_pot.cutoff() + skin;
+  GhostNlist ghost;
+
+  json output;
+  output["models"] = models;
+  output["natoms"] = nlocal;
+  output["box"] = frame.box;
+  output["input"] = jdata;
+  output["results"] = json::object();
+  for (const std::string & mode : modes) {
+    deepmd::ENERGYTYPE ener;
+    std::vector<double> force, virial;
+    if (mode == "no_nlist") {
+      output["results"][mode] = run_mode([&](const Frame & fr, const int ago) {
+	deep_pot.compute(ener, force, virial, fr.coord, fr.atype, fr.box);
+      }, NULL, frame, rc, jdata);
+    }
+    else if (mode == "nlist") {
+      output["results"][mode] = run_mode([&](const Frame & fr, const int ago) {
+	deep_pot.compute(ener, force, virial, ghost.coord_cpy, ghost.atype_cpy, fr.box,
+			 ghost.nall - ghost.nloc, ghost.inlist, ago);
+      }, &ghost, frame, rc, jdata);
+    }
+    else if (mode == "model_devi") {
+      deepmd::DeepPotModelDevi deep_pot_model_devi;
+      deep_pot_model_devi.init(models);
+      std::vector<deepmd::ENERGYTYPE> all_ener;
+      std::vector<std::vector<double>> all_force, all_virial;
+      output["results"][mode] = run_mode([&](const Frame & fr, const int ago) {
+	deep_pot_model_devi.compute(all_ener, all_force, all_virial, ghost.coord_cpy, ghost.atype_cpy, fr.box,
+				    ghost.nall - ghost.nloc, ghost.inlist, ago);
+      }, &ghost, frame, rc, jdata);
+    }
+    else {
+      std::cerr << "unknown mode " << mode << std::endl;
+      return 1;
+    }
+  }
+  output["peak_rss_mb"] = peak_rss_mb();
+
+  if (jdata.find("output") != jdata.end()) {
+    std::ofstream ofs(jdata["output"].get<std::string>());
+    ofs << std::setw(4) << output << std::endl;
+  }
+  else {
+    std::cout << std::setw(4) << output << std::endl;
+  }
+  return 0;
+}
@@ -75,6 +75,13 @@ public:
    * @return The list of sel types.
    */
   std::vector<int> sel_types () const {assert(inited); return sel_type;};
+  /**
+  * @brief Get the wall time and the number of calls of each phase of the evaluation.
+  * @param[in] pre The prefix to each line.
+  * @return The report, or an empty string if the environment variable DP_TIMING is not set.
+  * @note The evaluations may run concurrently on the same object, except when DP_TIMING is set.
+  **/
+  std::string get_timing_report (const std::string & pre = "") const {return timer.get_report(pre);};
 private:
   tensorflow::Session* session;
   std::string name_scope, name_prefix;
@@ -87,6 +94,9 @@ private:
   int ntypes;
   std::string model_type;
   std::vector<int> sel_type;
+  // the attributes read from the graph without running the session
+  GraphMetadata metadata;
+  PhaseTimer timer;
   template<class VT> VT get_scalar(const std::string & name) const;
   template<class VT> void get_vector(std::vector<VT> & vec, const std::string & name) const;
   template<typename MODELTYPE, typename VALUETYPE>
@@ -94,8 +104,7 @@ private:
 		  std::vector<VALUETYPE> &		dvirial,
 		  tensorflow::Session *			session,
 		  const std::vector<std::pair<std::string, tensorflow::Tensor>> & input_tensors,
-		  const AtomMap &	atommap,
-		  const int			nghost);
+		  const PermutationPlan &	plan);
 };
 }
 
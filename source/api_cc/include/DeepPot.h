@@ -30,10 +30,31 @@ public:
   **/
   void init (const std::string & model, const int & gpu_rank = 0, const std::string & file_content = "");
   /**
+  * @brief Initialize the DP from a buffer holding the model file, e.g. a SharedModelFile.
+  * @param[in] model The name of the frozen model file.
+  * @param[in] gpu_rank The GPU rank.
+  * @param[in] model_buffer The content of the model file. The buffer is not used after the initialization.
+  * @param[in] buffer_size The size of the buffer. If it is 0, DP will read from the file instead of the buffer.
+  **/
+  void init (const std::string & model, const int & gpu_rank, const char * model_buffer, const size_t & buffer_size);
+  /**
   * @brief Print the DP summary to the screen.
   * @param[in] pre The prefix to each line.
   **/
   void print_summary(const std::string &pre) const;
+  /**
+  * @brief Evaluate synthetic frames of a given size, so that the kernels are selected 
+  * and the memory is allocated before the first real evaluation.
+  * @param[in] nloc The number of local atoms.
+  * @param[in] nghost The number of ghost atoms. If it is 0, the periodic frames are evaluated, 
+  * otherwise the frames with the neighbor list are evaluated.
+  * @param[in] nsteps The number of evaluations. Default is 2.
+  * @note The warm-up frames replace the neighbor list, the atom permutation and 
+  * the input tensors kept between the steps. The next evaluation with a neighbor 
+  * list therefore rebuilds them from the given list, as if ago were 0. The warm-up 
+  * evaluations are not counted in the timing report.
+  **/
+  void warmup(const int & nloc, const int & nghost = 0, const int & nsteps = 2);
 public:
   /**
   * @brief Evaluate the energy, force and virial by using this DP.
@@ -61,6 +82,31 @@ public:
 		const std::vector<VALUETYPE>&	fparam = std::vector<VALUETYPE>(),
 		const std::vector<VALUETYPE>&	aparam = std::vector<VALUETYPE>());
   /**
+  * @brief Evaluate the energy, force and virial of a batch of frames by using this DP.
+  * All frames are evaluated in a single session run.
+  * @param[out] ener The system energies. The array is of size nframes.
+  * @param[out] force The force on each atom. The array is of size nframes x natoms x 3.
+  * @param[out] virial The virials. The array is of size nframes x 9.
+  * @param[in] coord The coordinates of atoms. The array should be of size nframes x natoms x 3.
+  * @param[in] atype The atom types. The list should contain natoms ints, shared by all frames.
+  * @param[in] box The cell of the region. The array should be of size nframes x 9, or empty if no pbc.
+  * @param[in] fparam The frame parameter. The array can be of size :
+      * nframes x dim_fparam.
+      * dim_fparam. Then all frames are assumed to be provided with the same fparam.
+  * @param[in] aparam The atomic parameter The array can be of size :
+      * nframes x natoms x dim_aparam.
+      * natoms x dim_aparam. Then all frames are assumed to be provided with the same aparam.
+  **/
+  template<typename VALUETYPE>
+  void compute (std::vector<ENERGYTYPE> &	ener,
+		std::vector<VALUETYPE> &	force,
+		std::vector<VALUETYPE> &	virial,
+		const std::vector<VALUETYPE> &	coord,
+		const std::vector<int> &	atype,
+		const std::vector<VALUETYPE> &	box, 
+		const std::vector<VALUETYPE>&	fparam = std::vector<VALUETYPE>(),
+		const std::vector<VALUETYPE>&	aparam = std::vector<VALUETYPE>());
+  /**
   * @brief Evaluate the energy, force and virial by using this DP.
   * @param[out] ener The system energy.
   * @param[out] force The force on each atom.
@@ -121,6 +167,35 @@ public:
 		const std::vector<VALUETYPE>&	fparam = std::vector<VALUETYPE>(),
 		const std::vector<VALUETYPE>&	aparam = std::vector<VALUETYPE>());
   /**
+  * @brief Evaluate the energy, force, virial, atomic energy, and atomic virial of a batch of frames by using this DP.
+  * All frames are evaluated in a single session run.
+  * @param[out] ener The system energies. The array is of size nframes.
+  * @param[out] force The force on each atom. The array is of size nframes x natoms x 3.
+  * @param[out] virial The virials. The array is of size nframes x 9.
+  * @param[out] atom_energy The atomic energy. The array is of size nframes x natoms.
+  * @param[out] atom_virial The atomic virial. The array is of size nframes x natoms x 9.
+  * @param[in] coord The coordinates of atoms. The array should be of size nframes x natoms x 3.
+  * @param[in] atype The atom types. The list should contain natoms ints, shared by all frames.
+  * @param[in] box The cell of the region. The array should be of size nframes x 9, or empty if no pbc.
+  * @param[in] fparam The frame parameter. The array can be of size :
+      * nframes x dim_fparam.
+      * dim_fparam. Then all frames are assumed to be provided with the same fparam.
+  * @param[in] aparam The atomic parameter The array can be of size :
+      * nframes x natoms x dim_aparam.
+      * natoms x dim_aparam. Then all frames are assumed to be provided with the same aparam.
+  **/
+  template<typename VALUETYPE>
+  void compute (std::vector<ENERGYTYPE> &	ener,
+		std::vector<VALUETYPE> &	force,
+		std::vector<VALUETYPE> &	virial,
+		std::vector<VALUETYPE> &	atom_energy,
+		std::vector<VALUETYPE> &	atom_virial,
+		const std::vector<VALUETYPE> &	coord,
+		const std::vector<int> &	atype,
+		const std::vector<VALUETYPE> &	box,
+		const std::vector<VALUETYPE>&	fparam = std::vector<VALUETYPE>(),
+		const std::vector<VALUETYPE>&	aparam = std::vector<VALUETYPE>());
+  /**
   * @brief Evaluate the energy, force, virial, atomic energy, and atomic virial by using this DP.
   * @param[out] ener The system energy.
   * @param[out] force The force on each atom.
@@ -180,10 +255,27 @@ public:
   * @param[out] type_map The type map of this model.
   **/
   void get_type_map (std::string & type_map);
+  /**
+  * @brief Get the wall time and the number of calls of each phase of the evaluation.
+  * @param[in] pre The prefix to each line.
+  * @return The report, or an empty string if the environment variable DP_TIMING is not set.
+  **/
+  std::string get_timing_report (const std::string & pre = "") const {return timer.get_report(pre);};
+  /**
+  * @brief Clear the time accumulated so far, so that the next report starts afresh.
+  **/
+  void clear_timing () {timer.clear();};
+  /**
+  * @brief Trace the next evaluation with TensorFlow and write the step stats as a Chrome trace.
+  * @param[in] file_name The file to write the Chrome trace to.
+  **/
+  void trace_next_compute (const std::string & file_name) {tracer.request(file_name);};
 private:
   tensorflow::Session* session;
   int num_intra_nthreads, num_inter_nthreads;
   tensorflow::GraphDef* graph_def;
+  // the attributes read from the graph without running the session
+  GraphMetadata metadata;
   bool inited;
   template<class VT> VT get_scalar(const std::string & name) const;
   // VALUETYPE get_rcut () const;
@@ -196,28 +288,27 @@ private:
   int ntypes;
   int dfparam;
   int daparam;
+  // the virial is fetched from the graph instead of summing the atomic virial
+  bool has_o_virial;
   template<typename VALUETYPE>
-  void validate_fparam_aparam(const int & nloc,
+  void validate_fparam_aparam(const int & nframes,
+			      const int & nloc,
 			      const std::vector<VALUETYPE> &fparam,
 			      const std::vector<VALUETYPE> &aparam)const ;
-  template<typename VALUETYPE>
-  void compute_inner (ENERGYTYPE &			ener,
-		      std::vector<VALUETYPE> &		force,
-		      std::vector<VALUETYPE> &		virial,
-		      const std::vector<VALUETYPE> &	coord,
-		      const std::vector<int> &		atype,
-		      const std::vector<VALUETYPE> &	box, 
-		      const int				nghost,
-		      const int &			ago,
-		      const std::vector<VALUETYPE>&	fparam = std::vector<VALUETYPE>(),
-		      const std::vector<VALUETYPE>&	aparam = std::vector<VALUETYPE>());
 
   // copy neighbor list info from host
   bool init_nbor;
   std::vector<int> sec_a;
   NeighborListData nlist_data;
   InputNlist nlist;
-  AtomMap atommap;
+  // the real atoms sorted by type, kept until the nbor list is updated
+  PermutationPlan perm_plan;
+  // the buffers of the input tensors are reused by the next steps
+  std::vector<std::pair<std::string, tensorflow::Tensor>> input_tensors;
+  // set by warmup, the next step rebuilds the lists whatever ago is
+  bool nlist_outdated;
+  PhaseTimer timer;
+  StepTracer tracer;
 
   // function used for neighbor list copy
   std::vector<int> get_sel_a() const;
@@ -245,6 +336,26 @@ public:
   * @param[in] file_contents The contents of the model files. If it is not empty, DP will read from the strings instead of the files.
   **/
   void init (const std::vector<std::string> & models, const int & gpu_rank = 0, const std::vector<std::string> & file_contents = std::vector<std::string>());
+  /**
+  * @brief Initialize the DP model deviation from the buffers holding the model files, e.g. SharedModelFiles.
+  * @param[in] models The names of the frozen model files.
+  * @param[in] gpu_rank The GPU rank.
+  * @param[in] model_buffers The contents of the model files. The buffers are not used after the initialization.
+  * @param[in] buffer_sizes The sizes of the buffers. If they are empty, DP will read from the files instead of the buffers.
+  **/
+  void init (const std::vector<std::string> & models, const int & gpu_rank, const std::vector<const char *> & model_buffers, const std::vector<size_t> & buffer_sizes);
+  /**
+  * @brief Evaluate synthetic frames of a given size by these DP models, so that the kernels 
+  * are selected and the memory is allocated before the first real evaluation.
+  * @param[in] nloc The number of local atoms.
+  * @param[in] nghost The number of ghost atoms.
+  * @param[in] nsteps The number of evaluations. Default is 2.
+  * @note The warm-up frames replace the neighbor list, the atom permutation and 
+  * the input tensors kept between the steps. The next evaluation with a neighbor 
+  * list therefore rebuilds them from the given list, as if ago were 0. The warm-up 
+  * evaluations are not counted in the timing report.
+  **/
+  void warmup(const int & nloc, const int & nghost = 0, const int & nsteps = 2);
 public:
   /**
   * @brief Evaluate the energy, force and virial by using these DP models.
@@ -313,6 +424,43 @@ public:
 		const std::vector<VALUETYPE>	&	fparam = std::vector<VALUETYPE>(),
 		const std::vector<VALUETYPE>	&	aparam = std::vector<VALUETYPE>());
   /**
+  * @brief Evaluate the average energy, force and virial of these DP models, together with the deviation of the forces.
+  * The deviation is reduced while the models are evaluated, so the forces of the individual models are not kept.
+  * The deviation is computed from the forces on the local atoms. The forces on the ghost atoms are not folded 
+  * back to the local atoms, so the interface returning the forces of all models should be used if the ghost atoms carry forces.
+  * @param[out] ener The average system energy.
+  * @param[out] force The average force on each atom.
+  * @param[out] virial The average virial.
+  * @param[out] std_f The standard deviation of the force on each local atom.
+  * @param[out] max_devi_f The maximal standard deviation of the forces.
+  * @param[out] min_devi_f The minimal standard deviation of the forces.
+  * @param[out] avg_devi_f The average standard deviation of the forces.
+  * @param[in] coord The coordinates of atoms. The array should be of size natoms x 3.
+  * @param[in] atype The atom types. The list should contain natoms ints.
+  * @param[in] box The cell of the region. The array should be of size 9.
+  * @param[in] nghost The number of ghost atoms.
+  * @param[in] lmp_list The input neighbour list.
+  * @param[in] ago Update the internal neighbour list if ago is 0.
+  * @param[in] fparam The frame parameter. The array should be of size dim_fparam.
+  * @param[in] aparam The atomic parameter. The array should be of size natoms x dim_aparam.
+  **/
+  template<typename VALUETYPE>
+  void compute (ENERGYTYPE &			ener,
+		std::vector<VALUETYPE> &	force,
+		std::vector<VALUETYPE> &	virial,
+		std::vector<VALUETYPE> &	std_f,
+		VALUETYPE &			max_devi_f,
+		VALUETYPE &			min_devi_f,
+		VALUETYPE &			avg_devi_f,
+		const std::vector<VALUETYPE> &	coord,
+		const std::vector<int> &		atype,
+		const std::vector<VALUETYPE> &	box,
+		const int			nghost,
+		const InputNlist &	lmp_list,
+		const int 				&   ago,
+		const std::vector<VALUETYPE>	&	fparam = std::vector<VALUETYPE>(),
+		const std::vector<VALUETYPE>	&	aparam = std::vector<VALUETYPE>());
+  /**
   * @brief Get the cutoff radius.
   * @return The cutoff radius.
   **/
@@ -404,11 +552,31 @@ public:
   void compute_relative_std_f (std::vector<VALUETYPE> &		std,
 		      const std::vector<VALUETYPE> &		avg,
 		      const VALUETYPE eps);
+  /**
+  * @brief Get the wall time and the number of calls of each phase of the evaluation.
+  * @param[in] pre The prefix to each line.
+  * @return The report, or an empty string if the environment variable DP_TIMING is not set.
+  **/
+  std::string get_timing_report (const std::string & pre = "") const {return timer.get_report(pre);};
+  /**
+  * @brief Clear the time accumulated so far, so that the next report starts afresh.
+  **/
+  void clear_timing () {timer.clear();};
+  /**
+  * @brief Trace the next evaluation with TensorFlow and write the step stats as Chrome traces.
+  * @param[in] file_name The file to write the Chrome trace to. The index of the model
+  * is inserted before the extension, for example, trace_0.json for trace.json.
+  **/
+  void trace_next_compute (const std::string & file_name);
 private:
   unsigned numb_models;
   std::vector<tensorflow::Session*> sessions;
   int num_intra_nthreads, num_inter_nthreads;
+  // number of models evaluated concurrently
+  int num_concurrent_models;
   std::vector<tensorflow::GraphDef*> graph_defs;
+  // the attributes read from each graph without running the sessions
+  std::vector<GraphMetadata> metadata;
   bool inited;
   template<class VT> VT get_scalar(const std::string name) const;
   // VALUETYPE get_rcut () const;
@@ -421,17 +589,38 @@ private:
   int ntypes;
   int dfparam;
   int daparam;
+  // the virial is fetched from the graphs instead of summing the atomic virial
+  bool has_o_virial;
   template <typename VALUETYPE>
   void validate_fparam_aparam(const int & nloc,
 			      const std::vector<VALUETYPE> &fparam,
 			      const std::vector<VALUETYPE> &aparam)const ;
+  // build the input tensors shared by all the models
+  template <typename VALUETYPE>
+  void prepare_input_tensors(std::vector<std::pair<std::string, tensorflow::Tensor>> & input_tensors,
+			     const std::vector<VALUETYPE> &	coord,
+			     const std::vector<int> &		atype,
+			     const std::vector<VALUETYPE> &	box,
+			     const int			nghost,
+			     const InputNlist &		lmp_list,
+			     const int &			ago,
+			     const std::vector<VALUETYPE> &	fparam,
+			     const std::vector<VALUETYPE> &	aparam);
 
   // copy neighbor list info from host
   bool init_nbor;
   std::vector<std::vector<int> > sec;
-  deepmd::AtomMap atommap;
+  // the real atoms sorted by type, kept until the nbor list is updated
+  deepmd::PermutationPlan perm_plan;
   NeighborListData nlist_data;
   InputNlist nlist;
+  // the buffers of the input tensors are reused by the next steps
+  std::vector<std::pair<std::string, tensorflow::Tensor>> input_tensors;
+  // set by warmup, the next step rebuilds the lists whatever ago is
+  bool nlist_outdated;
+  PhaseTimer timer;
+  // each model is traced to its own file
+  std::vector<StepTracer> tracers;
 
   // function used for nborlist copy
   std::vector<std::vector<int> > get_sel() const;
@@ -167,6 +167,13 @@ public:
    * @return The list of sel types.
    */
   const std::vector<int> & sel_types () const {assert(inited); return sel_type;};
+  /**
+  * @brief Get the wall time and the number of calls of each phase of the evaluation.
+  * @param[in] pre The prefix to each line.
+  * @return The report, or an empty string if the environment variable DP_TIMING is not set.
+  * @note The evaluations may run concurrently on the same object, except when DP_TIMING is set.
+  **/
+  std::string get_timing_report (const std::string & pre = "") const {return timer.get_report(pre);};
 private:
   tensorflow::Session* session;
   std::string name_scope;
@@ -181,15 +188,17 @@ private:
   std::string model_version;
   int odim;
   std::vector<int> sel_type;
+  // the attributes read from the graph without running the session
+  GraphMetadata metadata;
+  PhaseTimer timer;
   template<class VT> VT get_scalar(const std::string & name) const;
   template<class VT> void get_vector (std::vector<VT> & vec, const std::string & name) const;
   template<typename MODELTYPE, typename VALUETYPE>
   void run_model (std::vector<VALUETYPE> &		d_tensor_,
 		  tensorflow::Session *			session, 
 		  const std::vector<std::pair<std::string, tensorflow::Tensor>> & input_tensors,
-		  const AtomMap &		atommap, 
-		  const std::vector<int> &		sel_fwd,
-		  const int				nghost = 0);
+		  const PermutationPlan &	plan, 
+		  const std::vector<int> &		sel_fwd);
   template<typename MODELTYPE, typename VALUETYPE>
   void run_model (std::vector<VALUETYPE> &		dglobal_tensor_,
 		  std::vector<VALUETYPE> &	dforce_,
@@ -198,9 +207,8 @@ private:
 		  std::vector<VALUETYPE> &	datom_virial_,
 		  tensorflow::Session *			session, 
 		  const std::vector<std::pair<std::string, tensorflow::Tensor>> & input_tensors,
-		  const AtomMap &		atommap, 
-		  const std::vector<int> &		sel_fwd,
-		  const int				nghost = 0);
+		  const PermutationPlan &	plan, 
+		  const std::vector<int> &		sel_fwd);
   template<typename VALUETYPE>
   void compute_inner (std::vector<VALUETYPE> &		value,
 		      const std::vector<VALUETYPE> &	coord,
@@ -2,7 +2,10 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <unordered_set>
 #include <iostream>
+#include <chrono>
 #include "version.h"
 #include "neighbor_list.h"
 #include "AtomMap.h"
@@ -19,16 +22,28 @@ namespace deepmd{
 
 typedef double ENERGYTYPE;
 
+/**
+* @brief The neighbor list stored in the compressed sparse row format.
+* @details The neighbors of all the core region atoms are stored contiguously 
+* in jlist, and the neighbors of the ii-th atom are jlist[jrange[ii]] to 
+* jlist[jrange[ii+1]-1]. The buffers are reused by the next neighbor list 
+* update, and make_inlist points into them without copying.
+**/
 struct NeighborListData 
 {
   /// Array stores the core region atom's index
   std::vector<int > ilist;
-  /// Array stores the core region atom's neighbor index
-  std::vector<std::vector<int> > jlist;
+  /// Array stores the neighbor index of all the core region atoms
+  std::vector<int > jlist;
+  /// Array stores the offset of the neighbors of core region atoms in jlist, of size inum + 1
+  std::vector<int > jrange;
   /// Array stores the number of neighbors of core region atoms
   std::vector<int > numneigh;
   /// Array stores the the location of the first neighbor of core region atoms
   std::vector<int* > firstneigh;  
+private:
+  // buffers used by shuffle_exclude_empty
+  std::vector<int > tmp_ilist, tmp_jlist, tmp_jrange;
 public:
   void copy_from_nlist(const InputNlist & inlist);
   void shuffle(const std::vector<int> & fwd_map);
@@ -37,6 +52,125 @@ public:
   void make_inlist(InputNlist & inlist);
 };
 
+/**
+* @brief Build a synthetic frame of a given size, which is used to warm up the models.
+* @details The local atoms are randomly placed in a cubic box, at the density 
+* where each atom has about sum(sel) neighbors within rcut. The ghost atoms are 
+* randomly placed in the shell of width rcut around the box. The types are 
+* assigned in turn.
+* @param[out] coord The coordinates of the local atoms followed by the ghost atoms.
+* @param[out] atype The atom types.
+* @param[out] box The cubic box of the local atoms.
+* @param[out] nlist_data The neighbor list of the local atoms, including the ghost atoms.
+* @param[in] nloc The number of local atoms.
+* @param[in] nghost The number of ghost atoms.
+* @param[in] ntypes The number of atom types.
+* @param[in] rcut The cutoff radius.
+* @param[in] sel The number of selected neighbors of each type. If it is empty, a density of 0.1 is used.
+**/
+void
+make_warmup_frame(std::vector<double> & coord,
+		  std::vector<int> & atype,
+		  std::vector<double> & box,
+		  NeighborListData & nlist_data,
+		  const int & nloc,
+		  const int & nghost,
+		  const int & ntypes,
+		  const double & rcut,
+		  const std::vector<int> & sel);
+
+
+/**
+* @brief The permutation from the input atoms to the atoms of the model.
+* @details The real atoms, i.e. the atoms with types in [0, ntypes), are selected, 
+* and the selected local atoms are sorted by type, while the selected ghost atoms 
+* keep their order. The two maps are composed, so the data are permuted in a 
+* single pass in each direction. With the spatial sort, the atoms close in space 
+* are also close in the model order.
+**/
+class PermutationPlan
+{
+public:
+  PermutationPlan();
+  /**
+  * @brief Build the plan. The plan is kept if the atom types are not changed.
+  * @param[in] datype The atom types of the input atoms, the local atoms go first.
+  * @param[in] nghost The number of ghost atoms.
+  * @param[in] ntypes The number of atom types.
+  * @return Whether the plan is rebuilt.
+  **/
+  bool build(const std::vector<int> & datype,
+	     const int & nghost,
+	     const int & ntypes);
+  /**
+  * @brief Build the plan, and sort the atoms by space if the spatial sort is enabled.
+  * @details With the spatial sort, the real local atoms are sorted by type and then by 
+  * the Morton key of their coordinates, and the real ghost atoms by the Morton key. 
+  * The plan is rebuilt at each call, so it should be built when the neighbor list is rebuilt.
+  * @param[in] datype The atom types of the input atoms, the local atoms go first.
+  * @param[in] dcoord The coordinates of the input atoms. Only the first frame is used.
+  * @param[in] nghost The number of ghost atoms.
+  * @param[in] ntypes The number of atom types.
+  * @return Whether the plan is rebuilt.
+  **/
+  template <typename VALUETYPE>
+  bool build(const std::vector<int> & datype,
+	     const std::vector<VALUETYPE> & dcoord,
+	     const int & nghost,
+	     const int & ntypes);
+  /// Enable or disable the spatial sort of the atoms.
+  void set_spatial_sort(const bool & spatial_sort_) {spatial_sort = spatial_sort_;}
+  /// Whether the atoms are sorted by space.
+  bool get_spatial_sort() const {return spatial_sort;}
+  /**
+  * @brief Permute the data of the input atoms to the model order.
+  * @param[out] out The data of the model atoms.
+  * @param[in] in The data of the input atoms.
+  * @param[in] stride The number of values of each atom.
+  * @param[in] nmodel The number of the leading model atoms to permute. All the model atoms if it is negative.
+  **/
+  template <typename VT_OUT, typename VT_IN>
+  void forward(VT_OUT * out,
+	       const VT_IN * in,
+	       const int & stride,
+	       const int & nmodel = -1) const;
+  /**
+  * @brief Permute the data of the model atoms back to the input order. The data of the excluded atoms are zero.
+  * @param[out] out The data of the input atoms, of size nall x stride.
+  * @param[in] in The data of the model atoms.
+  * @param[in] stride The number of values of each atom.
+  * @param[in] nmodel The number of the leading model atoms in the data. All the model atoms if it is negative.
+  **/
+  template <typename VT_OUT, typename VT_IN>
+  void backward(VT_OUT * out,
+		const VT_IN * in,
+		const int & stride,
+		const int & nmodel = -1) const;
+  /// The index of each input atom in the model, -1 if it is excluded.
+  const std::vector<int> & get_fwd_map() const {return fwd_map;}
+  /// The input index of each model atom.
+  const std::vector<int> & get_bkw_map() const {return bkw_map;}
+  /// The types of the model atoms.
+  const std::vector<int> & get_type() const {return type;}
+  /// The number of the input atoms.
+  int get_nall() const {return fwd_map.size();}
+  /// The number of the local input atoms.
+  int get_nloc() const {return nloc;}
+  /// The number of the model atoms.
+  int get_nall_real() const {return bkw_map.size();}
+  /// The number of the local model atoms.
+  int get_nloc_real() const {return nloc_real;}
+private:
+  bool spatial_sort;
+  std::vector<int> src_type;
+  int src_nghost;
+  int src_ntypes;
+  int nloc;
+  int nloc_real;
+  std::vector<int> fwd_map;
+  std::vector<int> bkw_map;
+  std::vector<int> type;
+};
 
 /**
 * @brief Check if the model version is supported.
@@ -105,6 +239,115 @@ void
 get_env_nthreads(int & num_intra_nthreads,
 		 int & num_inter_nthreads);
 
+/**
+* @brief Get the number of models that are evaluated concurrently from the environment variable.
+* @details Read from DP_MODEL_DEVI_CONCURRENCY. All the models are evaluated concurrently if it is not set.
+* @param[in] numb_models The number of models.
+* @return The number of models evaluated concurrently, between 1 and numb_models.
+**/
+int
+get_env_model_devi_concurrency(const int & numb_models);
+
+/**
+* @brief Check whether the atoms are sorted by space before the model evaluation.
+* @details Read from DP_SPATIAL_SORT. The atoms are sorted only by type if it is not set or is 0.
+* @return Whether the atoms are sorted by space.
+**/
+bool
+get_env_spatial_sort();
+
+/**
+* @brief The accumulated wall time and number of calls of each phase of the evaluation.
+* @details The timer is enabled by setting the environment variable DP_TIMING to a 
+* nonzero value. The phases are reported in the order they are first timed. The timer 
+* is not thread-safe, the phases should be timed by the thread calling the model.
+**/
+class PhaseTimer
+{
+public:
+  /**
+  * @brief Create the timer, enabled if DP_TIMING is set.
+  **/
+  PhaseTimer();
+  /**
+  * @brief Whether the timer is enabled.
+  **/
+  bool enabled() const {return is_enabled;};
+  /**
+  * @brief Add the time of a call of a phase.
+  * @param[in] phase The name of the phase.
+  * @param[in] seconds The wall time in seconds.
+  **/
+  void add(const char * phase, const double & seconds);
+  /**
+  * @brief Clear the accumulated time.
+  **/
+  void clear();
+  /**
+  * @brief Get the report of the accumulated time.
+  * @param[in] pre The prefix to each line.
+  * @return The table of the phases, or an empty string if the timer is disabled.
+  **/
+  std::string get_report(const std::string & pre = "") const;
+private:
+  bool is_enabled;
+  std::vector<std::string> phases;
+  std::vector<double> seconds;
+  std::vector<long long> counts;
+};
+
+/**
+* @brief Time a phase from the construction to the destruction, or to stop().
+* @details Nothing is done if the timer is NULL or disabled.
+**/
+class ScopedTimer
+{
+public:
+  /**
+  * @brief Start timing a phase.
+  * @param[in] timer The timer to add the time to.
+  * @param[in] phase The name of the phase, which should outlive the scope.
+  **/
+  ScopedTimer(PhaseTimer * timer, const char * phase);
+  ~ScopedTimer() {stop();};
+  /**
+  * @brief Stop timing and add the time to the timer.
+  **/
+  void stop();
+private:
+  ScopedTimer(const ScopedTimer &);
+  ScopedTimer & operator=(const ScopedTimer &);
+  PhaseTimer * timer;
+  const char * phase;
+  std::chrono::steady_clock::time_point start;
+};
+
+/**
+* @brief Trace a session run on request and write the step stats as a Chrome trace.
+* @details The runs are not traced unless requested, and a request is 
+* consumed by the next run.
+**/
+class StepTracer
+{
+public:
+  /**
+  * @brief Request to trace the next run.
+  * @param[in] file_name The file to write the Chrome trace to.
+  **/
+  void request(const std::string & file_name) {file = file_name;};
+  /**
+  * @brief Whether the next run is requested to be traced.
+  **/
+  bool requested() const {return !file.empty();};
+  /**
+  * @brief Write the trace to the requested file and consume the request.
+  * @param[in] trace The Chrome trace in JSON.
+  **/
+  void write(const std::string & trace);
+private:
+  std::string file;
+};
+
 /**
  * @brief Dynamically load OP library. This should be called before loading graphs.
  */
@@ -132,6 +375,33 @@ void
 check_status(
     const tensorflow::Status& status);
 
+/**
+* @brief Run the session, with the full trace if requested by the tracer.
+* @param[in] session TensorFlow session.
+* @param[in] input_tensors The input tensors.
+* @param[in] output_names The names of the output tensors.
+* @param[out] output_tensors The output tensors.
+* @param[in] tracer The tracer of the run, not traced if NULL.
+**/
+void
+session_run(
+    tensorflow::Session* session,
+    const std::vector<std::pair<std::string, tensorflow::Tensor>> & input_tensors,
+    const std::vector<std::string> & output_names,
+    std::vector<tensorflow::Tensor> & output_tensors,
+    StepTracer * tracer = NULL);
+
+/**
+* @brief Convert the step stats of a session run to the Chrome trace format.
+* @details Each device is a process and each thread of a device is a thread
+* of the trace. The trace can be viewed in chrome://tracing or Perfetto.
+* @param[in] step_stats The step stats.
+* @return The trace in JSON.
+**/
+std::string
+step_stats_to_chrome_trace(
+    const tensorflow::StepStats & step_stats);
+
 std::string 
 name_prefix(
     const std::string & name_scope);
@@ -165,6 +435,85 @@ session_get_vector(
     const std::string name_, 
     const std::string scope = "");
 
+/**
+* @brief Check if the graph has a node.
+* @param[in] graph_def The graph.
+* @param[in] name The name of the node.
+* @return Whether the graph has the node.
+**/
+bool
+graph_has_node(
+	const tensorflow::GraphDef & graph_def,
+	const std::string & name);
+
+/**
+* @brief The metadata of a graph, i.e. the names of the nodes, the attribute 
+* constants (named *_attr/name) and the selection of the descriptor.
+* @details All of them are read from the GraphDef in a single pass, so no 
+* session has to be run.
+**/
+class GraphMetadata
+{
+public:
+  GraphMetadata() {};
+  /**
+  * @brief Read the metadata from a graph.
+  * @param[in] graph_def The graph.
+  **/
+  void init(const tensorflow::GraphDef & graph_def);
+  /**
+  * @brief Check if the graph has a node.
+  * @param[in] name The name of the node.
+  * @return Whether the graph has the node.
+  **/
+  bool has_node(const std::string & name) const {return names.count(name) > 0;};
+  /**
+  * @brief Check if an attribute constant is read.
+  * @param[in] name The name of the constant.
+  * @param[in] scope The scope of the constant.
+  * @return Whether the constant is read.
+  **/
+  bool has_const(const std::string & name, const std::string & scope = "") const;
+  /**
+  * @brief Get the value of an attribute constant.
+  * @param[in] name The name of the constant.
+  * @param[in] scope The scope of the constant.
+  * @return The value of the constant.
+  **/
+  template<typename VT>
+  VT get_scalar(const std::string & name, const std::string & scope = "") const;
+  /**
+  * @brief Get the vector of an attribute constant.
+  * @param[out] o_vec The output vector.
+  * @param[in] name The name of the constant.
+  * @param[in] scope The scope of the constant.
+  **/
+  template<typename VT>
+  void get_vector(std::vector<VT> & o_vec, const std::string & name, const std::string & scope = "") const;
+  /**
+  * @brief Get the type of an attribute constant.
+  * @param[in] name The name of the constant.
+  * @param[in] scope The scope of the constant.
+  * @return The type of the constant as int.
+  **/
+  int get_dtype(const std::string & name, const std::string & scope = "") const;
+  /**
+  * @brief Get the number of selected neighbors of each type of the descriptor.
+  * @return The sel_a of DescrptSeA, or the sel of DescrptSeR.
+  **/
+  const std::vector<int> & get_sel() const {return sel;};
+private:
+  struct ConstValue {
+    int dtype;
+    std::vector<double> values;
+    std::vector<std::string> strings;
+  };
+  const ConstValue & find_const(const std::string & name, const std::string & scope) const;
+  std::unordered_set<std::string> names;
+  std::map<std::string, ConstValue> consts;
+  std::vector<int> sel;
+};
+
 /**
 * @brief Get the type of a tensor.
 * @param[in] session TensorFlow session.
@@ -180,16 +529,17 @@ session_get_dtype(
 
 /**
 * @brief Get input tensors.
-* @param[out] input_tensors Input tensors.
-* @param[in] dcoord_ Coordinates of atoms.
+* @param[in,out] input_tensors Input tensors. The buffers of the given tensors are reused if their names, types and shapes match.
+* @param[in] dcoord_ Coordinates of atoms. The array should be of size nframes x natoms x 3.
 * @param[in] ntypes Number of atom types.
-* @param[in] datype_ Atom types.
-* @param[in] dbox Box matrix.
+* @param[in] datype_ Atom types. The list should contain natoms ints, shared by all frames.
+* @param[in] dbox Box matrix. The array should be of size nframes x 9, or empty if no pbc.
 * @param[in] cell_size Cell size.
-* @param[in] fparam_ Frame parameters.
-* @param[in] aparam_ Atom parameters.
-* @param[in] atommap Atom map.
+* @param[in] fparam_ Frame parameters. The array should be of size nframes x dim_fparam.
+* @param[in] aparam_ Atom parameters. The array should be of size nframes x natoms x dim_aparam.
+* @param[in] plan The permutation from the input atoms to the model atoms.
 * @param[in] scope The scope of the tensors.
+* @return The number of the local atoms of the model.
 */
 template <typename MODELTYPE, typename VALUETYPE>
 int
@@ -201,22 +551,22 @@ session_input_tensors (std::vector<std::pair<std::string, tensorflow::Tensor>> &
 		       const double &		cell_size,
 		       const std::vector<VALUETYPE> &	fparam_,
 		       const std::vector<VALUETYPE> &	aparam_,
-		       const deepmd::AtomMap&atommap,
+		       const deepmd::PermutationPlan&plan,
 		       const std::string		scope = "");
 
 /**
 * @brief Get input tensors.
-* @param[out] input_tensors Input tensors.
+* @param[in,out] input_tensors Input tensors. The buffers of the given tensors are reused if their names, types and shapes match.
 * @param[in] dcoord_ Coordinates of atoms.
 * @param[in] ntypes Number of atom types.
 * @param[in] datype_ Atom types.
-* @param[in] dlist Neighbor list.
+* @param[in] dlist Neighbor list of the model atoms.
 * @param[in] fparam_ Frame parameters.
 * @param[in] aparam_ Atom parameters.
-* @param[in] atommap Atom map.
-* @param[in] nghost Number of ghost atoms.
+* @param[in] plan The permutation from the input atoms to the model atoms.
 * @param[in] ago Update the internal neighbour list if ago is 0.
 * @param[in] scope The scope of the tensors.
+* @return The number of the local atoms of the model.
 */
 template <typename MODELTYPE, typename VALUETYPE>
 int
@@ -228,8 +578,7 @@ session_input_tensors (std::vector<std::pair<std::string, tensorflow::Tensor>> &
 		       InputNlist &		dlist, 
 		       const std::vector<VALUETYPE> &	fparam_,
 		       const std::vector<VALUETYPE> &	aparam_,
-		       const deepmd::AtomMap&atommap,
-		       const int			nghost,
+		       const deepmd::PermutationPlan&plan,
 		       const int			ago,
 		       const std::string		scope = "");
 
@@ -241,6 +590,58 @@ session_input_tensors (std::vector<std::pair<std::string, tensorflow::Tensor>> &
 void
 read_file_to_string(std::string model, std::string & file_content);
 
+/**
+* @brief A read-only copy of a model file in a POSIX shared-memory segment,
+* so that the processes on the same node share a single copy of the bytes.
+* @details One process creates the segment from the file, which is mapped 
+* instead of read, and the others attach to it by its name. The segment is 
+* removed when the creator releases it; the processes that have attached 
+* keep their mappings until they release them.
+**/
+class SharedModelFile
+{
+public:
+  SharedModelFile();
+  ~SharedModelFile();
+  /**
+  * @brief Create the segment and copy the model file into it.
+  * @details The segment is named by the prefix followed by the hostname, the 
+  * pid and a random nonce. An existing segment is never replaced; if the 
+  * name is taken, another nonce is drawn.
+  * @param[in] model Path to the model.
+  * @param[in] prefix Prefix of the segment name, which should start with "/".
+  **/
+  void create(const std::string & model, const std::string & prefix);
+  /**
+  * @brief Attach to a segment created by another process.
+  * @param[in] name Name of the segment.
+  **/
+  void attach(const std::string & name);
+  /**
+  * @brief Unmap the segment, and remove it if it was created by this process.
+  **/
+  void release();
+  /**
+  * @brief The name of the segment, to be passed to attach.
+  **/
+  const std::string & name() const {return shm_name;};
+  /**
+  * @brief The content of the model file.
+  **/
+  const char * data() const {return buffer;};
+  /**
+  * @brief The size of the model file.
+  **/
+  size_t size() const {return buffer_size;};
+private:
+  SharedModelFile(const SharedModelFile &);
+  SharedModelFile & operator=(const SharedModelFile &);
+  std::string shm_name;
+  char * buffer;
+  size_t buffer_size;
+  bool owner;
+};
+
 
 /**
 * @brief Convert pbtxt to pb.
@@ -11,5 +11,6 @@ namespace tensorflow{
     class Tensor;
     class GraphDef;
     class Status;
+    class StepStats;
 }
 #endif
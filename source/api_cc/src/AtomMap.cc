@@ -14,18 +14,40 @@ AtomMap(const std::vector<int >::const_iterator in_begin,
 {
   int natoms = in_end - in_begin;
   atype.resize (natoms);
-  std::vector<std::pair<int, int > > sorting (natoms);
-  std::vector<int >::const_iterator iter = in_begin;
-  for (unsigned ii = 0; ii < sorting.size(); ++ii){
-    sorting[ii] = std::pair<int, int > (*(iter++), ii);
-  }
-  sort (sorting.begin(), sorting.end());
   idx_map.resize(natoms);
   fwd_idx_map.resize(natoms);
+  int min_type = 0, max_type = -1;
+  if (natoms > 0) {
+    min_type = *std::min_element(in_begin, in_end);
+    max_type = *std::max_element(in_begin, in_end);
+  }
+  if (min_type >= 0 && max_type < natoms + 64) {
+    // the number of types is small, counting sort by type, 
+    // the atoms of the same type keep their order
+    std::vector<int> type_start (max_type + 2, 0);
+    for (int ii = 0; ii < natoms; ++ii){
+      type_start[in_begin[ii] + 1] ++;
+    }
+    for (int tt = 0; tt <= max_type; ++tt){
+      type_start[tt + 1] += type_start[tt];
+    }
+    for (int ii = 0; ii < natoms; ++ii){
+      idx_map[type_start[in_begin[ii]] ++] = ii;
+    }
+  }
+  else {
+    std::vector<std::pair<int, int > > sorting (natoms);
+    for (unsigned ii = 0; ii < sorting.size(); ++ii){
+      sorting[ii] = std::pair<int, int > (in_begin[ii], ii);
+    }
+    sort (sorting.begin(), sorting.end());
+    for (unsigned ii = 0; ii < sorting.size(); ++ii){
+      idx_map[ii] = sorting[ii].second;
+    }
+  }
   for (unsigned ii = 0; ii < idx_map.size(); ++ii){
-    idx_map[ii] = sorting[ii].second;
-    fwd_idx_map[sorting[ii].second] = ii;
-    atype[ii] = sorting[ii].first;
+    fwd_idx_map[idx_map[ii]] = ii;
+    atype[ii] = in_begin[idx_map[ii]];
   }
 }
 
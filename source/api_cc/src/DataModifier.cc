@@ -48,7 +48,12 @@ init (const std::string & model,
   // for (int ii = 0; ii < nnodes; ++ii){
   //   cout << ii << " \t " << graph_def.node(ii).name() << endl;
   // }
-  dtype = session_get_dtype(session, "descrpt_attr/rcut");
+  metadata.init(*graph_def);
+  if (metadata.has_const("descrpt_attr/rcut")) {
+    dtype = metadata.get_dtype("descrpt_attr/rcut");
+  } else {
+    dtype = session_get_dtype(session, "descrpt_attr/rcut");
+  }
   if (dtype == tensorflow::DT_DOUBLE) {
     rcut = get_scalar<double>("descrpt_attr/rcut");
   } else {
@@ -67,6 +72,9 @@ VT
 DipoleChargeModifier::
 get_scalar (const std::string & name) const
 {
+  if (metadata.has_const(name, name_scope)) {
+    return metadata.get_scalar<VT>(name, name_scope);
+  }
   return session_get_scalar<VT>(session, name, name_scope);
 }
 
@@ -75,6 +83,10 @@ void
 DipoleChargeModifier::
 get_vector (std::vector<VT> & vec, const std::string & name) const
 {
+  if (metadata.has_const(name, name_scope)) {
+    metadata.get_vector<VT>(vec, name, name_scope);
+    return;
+  }
   session_get_vector<VT>(vec, session, name, name_scope);
 }
 
@@ -85,11 +97,10 @@ run_model (std::vector<VALUETYPE> &		dforce,
 	   std::vector<VALUETYPE> &		dvirial,
 	   Session *				session, 
 	   const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-	   const AtomMap &	atommap, 
-	   const int				nghost)
+	   const PermutationPlan &	plan)
 {
-  unsigned nloc = atommap.get_type().size();
-  unsigned nall = nloc + nghost;
+  unsigned nloc = plan.get_nloc_real();
+  unsigned nall = plan.get_nall_real();
   if (nloc == 0) {
     dforce.clear();
     dvirial.clear();
@@ -97,10 +108,13 @@ run_model (std::vector<VALUETYPE> &		dforce,
   }
 
   std::vector<Tensor> output_tensors;
+  ScopedTimer run_timer(&timer, "session_run");
   deepmd::check_status (session->Run(input_tensors, 
 			    {"o_dm_force", "o_dm_virial", "o_dm_av"},
 			    {}, 
 			    &output_tensors));
+  run_timer.stop();
+  ScopedTimer output_timer(&timer, "output");
   int cc = 0;
   Tensor output_f = output_tensors[cc++];
   Tensor output_v = output_tensors[cc++];
@@ -120,11 +134,10 @@ run_model (std::vector<VALUETYPE> &		dforce,
   auto of = output_f.flat<MODELTYPE> ();
   auto ov = output_v.flat<MODELTYPE> ();
 
-  dforce.resize(nall*3);
+  // the force is mapped back to the input order
+  dforce.resize(plan.get_nall() * 3);
   dvirial.resize(9);
-  for (int ii = 0; ii < nall * 3; ++ii){
-    dforce[ii] = of(ii);
-  }
+  plan.backward(dforce.data(), of.data(), 3);
   for (int ii = 0; ii < 9; ++ii){
     dvirial[ii] = ov(ii);
   }
@@ -137,8 +150,7 @@ run_model <double, double> (std::vector<double> &		dforce,
 	   std::vector<double> &		dvirial,
 	   Session *				session, 
 	   const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-	   const AtomMap &	atommap, 
-	   const int				nghost);
+	   const PermutationPlan &	plan);
 
 template
 void 
@@ -147,8 +159,7 @@ run_model <float, double> (std::vector<double> &		dforce,
 	   std::vector<double> &		dvirial,
 	   Session *				session, 
 	   const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-	   const AtomMap &	atommap, 
-	   const int				nghost);
+	   const PermutationPlan &	plan);
 
 template
 void 
@@ -157,8 +168,7 @@ run_model <double, float> (std::vector<float> &		dforce,
 	   std::vector<float> &		dvirial,
 	   Session *				session, 
 	   const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-	   const AtomMap &	atommap, 
-	   const int				nghost);
+	   const PermutationPlan &	plan);
 
 template
 void 
@@ -167,8 +177,7 @@ run_model <float, float> (std::vector<float> &		dforce,
 	   std::vector<float> &		dvirial,
 	   Session *				session, 
 	   const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-	   const AtomMap &	atommap, 
-	   const int				nghost);
+	   const PermutationPlan &	plan);
 
 template <typename VALUETYPE>
 void
@@ -183,14 +192,15 @@ compute (std::vector<VALUETYPE> &		dfcorr_,
 	 const int				nghost,
 	 const InputNlist &		lmp_list)
 {
-  // firstly do selection
+  // firstly do selection and sorting
   int nall = datype_.size();
   int nloc = nall - nghost;
-  int nghost_real;
-  std::vector<int > real_fwd_map, real_bkw_map;
-  select_real_atoms(real_fwd_map, real_bkw_map, nghost_real, dcoord_, datype_, nghost, ntypes);  
-  int nall_real = real_bkw_map.size();
-  int nloc_real = nall_real - nghost_real;
+  // the plan is local to the call, so that the object can be shared by threads
+  PermutationPlan perm_plan;
+  ScopedTimer plan_timer(&timer, "build_plan");
+  perm_plan.build(datype_, nghost, ntypes);
+  plan_timer.stop();
+  int nloc_real = perm_plan.get_nloc_real();
   if (nloc_real == 0){
     dfcorr_.resize(nall * 3);
     dvcorr_.resize(9);
@@ -198,37 +208,23 @@ compute (std::vector<VALUETYPE> &		dfcorr_,
     fill(dvcorr_.begin(), dvcorr_.end(), (VALUETYPE)0.0);
     return;
   }
-  // resize to nall_real
-  std::vector<VALUETYPE> dcoord_real;
-  std::vector<VALUETYPE> delef_real;
-  std::vector<int> datype_real;
-  dcoord_real.resize(nall_real * 3);
-  delef_real.resize(nall_real * 3);
-  datype_real.resize(nall_real);
-  // fwd map
-  select_map<VALUETYPE>(dcoord_real, dcoord_, real_fwd_map, 3);
-  select_map<VALUETYPE>(delef_real, delef_, real_fwd_map, 3);
-  select_map<int>(datype_real, datype_, real_fwd_map, 1);
+  const std::vector<int> & bkw_map(perm_plan.get_bkw_map());
   // internal nlist
+  ScopedTimer nlist_timer(&timer, "nlist_update");
   NeighborListData nlist_data;
   nlist_data.copy_from_nlist(lmp_list);
-  nlist_data.shuffle_exclude_empty(real_fwd_map);  
-  // sort atoms
-  AtomMap atommap (datype_real.begin(), datype_real.begin() + nloc_real);
-  assert (nloc_real == atommap.get_type().size());
-  const std::vector<int> & sort_fwd_map(atommap.get_fwd_map());
-  const std::vector<int> & sort_bkw_map(atommap.get_bkw_map());
-  // shuffle nlist
-  nlist_data.shuffle(atommap);
+  nlist_data.shuffle_exclude_empty(perm_plan.get_fwd_map());  
   InputNlist nlist;
   nlist_data.make_inlist(nlist);
+  nlist_timer.stop();
   // make input tensors
+  ScopedTimer input_timer(&timer, "input_tensors");
   std::vector<std::pair<std::string, Tensor>> input_tensors;
   int ret;
   if (dtype == tensorflow::DT_DOUBLE) {
-    ret = session_input_tensors<double> (input_tensors, dcoord_real, ntypes, datype_real, dbox, nlist, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), atommap, nghost_real, 0, name_scope);
+    ret = session_input_tensors<double> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), perm_plan, 0, name_scope);
   } else {
-    ret = session_input_tensors<float> (input_tensors, dcoord_real, ntypes, datype_real, dbox, nlist, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), atommap, nghost_real, 0, name_scope);
+    ret = session_input_tensors<float> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), perm_plan, 0, name_scope);
   }
   assert (nloc_real == ret);
   // make bond idx map
@@ -237,12 +233,12 @@ compute (std::vector<VALUETYPE> &		dfcorr_,
     bd_idx[pairs[ii].first] = pairs[ii].second;
   }
   // make extf by bond idx map
-  std::vector<int > dtype_sort_loc = atommap.get_type();
+  const std::vector<int > & dtype_sort = perm_plan.get_type();
   std::vector<VALUETYPE> dextf;
-  for(int ii = 0; ii < dtype_sort_loc.size(); ++ii){
-    if (binary_search(sel_type.begin(), sel_type.end(), dtype_sort_loc[ii])){
+  for(int ii = 0; ii < nloc_real; ++ii){
+    if (binary_search(sel_type.begin(), sel_type.end(), dtype_sort[ii])){
       // selected atom
-      int first_idx = real_bkw_map[sort_bkw_map[ii]];
+      int first_idx = bkw_map[ii];
       int second_idx = bd_idx[first_idx];
       assert(second_idx >= 0);
       dextf.push_back(delef_[second_idx*3+0]);
@@ -275,42 +271,29 @@ compute (std::vector<VALUETYPE> &		dfcorr_,
   }
   // append extf to input tensor
   input_tensors.push_back({"t_ef", extf_tensor});  
-  // run model
-  std::vector<VALUETYPE> dfcorr, dvcorr;
+  input_timer.stop();
+  // run model, the force correction is in the input order
+  std::vector<VALUETYPE> dvcorr;
   if (dtype == tensorflow::DT_DOUBLE) {
-    run_model <double> (dfcorr, dvcorr, session, input_tensors, atommap, nghost_real);
+    run_model <double> (dfcorr_, dvcorr, session, input_tensors, perm_plan);
   } else {
-    run_model <float> (dfcorr, dvcorr, session, input_tensors, atommap, nghost_real);
-  }
-  assert(dfcorr.size() == nall_real * 3);
-  // back map force
-  std::vector<VALUETYPE> dfcorr_1 = dfcorr;
-  atommap.backward<VALUETYPE> (dfcorr_1.begin(), dfcorr.begin(), 3);
-  assert(dfcorr_1.size() == nall_real * 3);
-  // resize to all and clear
-  std::vector<VALUETYPE> dfcorr_2(nall*3);
-  fill(dfcorr_2.begin(), dfcorr_2.end(), (VALUETYPE)0.0);
-  // back map to original position
-  for (int ii = 0; ii < nall_real; ++ii){
-    for (int dd = 0; dd < 3; ++dd){
-      dfcorr_2[real_bkw_map[ii]*3+dd] += dfcorr_1[ii*3+dd];
-    }
+    run_model <float> (dfcorr_, dvcorr, session, input_tensors, perm_plan);
   }
+  assert(dfcorr_.size() == nall * 3);
   // self correction of bonded force
   for (int ii = 0; ii < pairs.size(); ++ii){
     for (int dd = 0; dd < 3; ++dd){
-      dfcorr_2[pairs[ii].first*3+dd] += delef_[pairs[ii].second*3+dd];
+      dfcorr_[pairs[ii].first*3+dd] += delef_[pairs[ii].second*3+dd];
     }    
   }
   // add ele contrinution
-  dfcorr_ = dfcorr_2;
   // for (int ii = 0; ii < nloc; ++ii){
   //   for (int dd = 0; dd < 3; ++dd){
   //     dfcorr_[ii*3+dd] += delef_[ii*3+dd];
   //   }
   // }  
   for (int ii = 0; ii < nloc_real; ++ii){
-    int oii = real_bkw_map[ii];
+    int oii = bkw_map[ii];
     for (int dd = 0; dd < 3; ++dd){
       dfcorr_[oii*3+dd] += delef_[oii*3+dd];
     }    
@@ -1,6 +1,8 @@
 #include "DeepPot.h"
 #include "AtomMap.h"
 #include <stdexcept>	
+#include <exception>
+#include <algorithm>
 #include "device.h"
 
 using namespace tensorflow;
@@ -20,63 +22,144 @@ std::vector<int> cum_sum (const std::vector<int32> & n_sel) {
 
 template <typename MODELTYPE, typename VALUETYPE>
 static void 
-run_model (ENERGYTYPE &			dener,
+run_model (std::vector<ENERGYTYPE> &	dener,
 	   std::vector<VALUETYPE> &	dforce_,
 	   std::vector<VALUETYPE> &	dvirial,
 	   Session *			session, 
 	   const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-	   const AtomMap&	atommap, 
-	   const int			nghost = 0)
+	   const PermutationPlan&	plan, 
+	   const int			nframes,
+	   const bool			has_o_virial = false,
+	   PhaseTimer *		timer = NULL,
+	   StepTracer *		tracer = NULL)
 {
-  unsigned nloc = atommap.get_type().size();
-  unsigned nall = nloc + nghost;
+  // the outputs are of the input atoms, while the model only sees the real atoms
+  unsigned nloc = plan.get_nloc_real();
+  unsigned nall = plan.get_nall_real();
+  unsigned nall_in = plan.get_nall();
+  dener.resize(nframes);
   if (nloc == 0) {
-    dener = 0;
+    fill(dener.begin(), dener.end(), (ENERGYTYPE)0.0);
     // no backward map needed
-    // dforce of size nall * 3
-    dforce_.resize(nall * 3);
+    // dforce of size nframes * nall * 3
+    dforce_.resize(nframes * nall_in * 3);
     fill(dforce_.begin(), dforce_.end(), (VALUETYPE)0.0);
-    // dvirial of size 9
-    dvirial.resize(9);
+    // dvirial of size nframes * 9
+    dvirial.resize(nframes * 9);
     fill(dvirial.begin(), dvirial.end(), (VALUETYPE)0.0);
     return;
   }
 
+  // the atomic outputs are not fetched if the graph provides the virial
   std::vector<Tensor> output_tensors;
-  check_status (session->Run(input_tensors, 
-			    {"o_energy", "o_force", "o_atom_energy", "o_atom_virial"}, 
-			    {}, 
-			    &output_tensors));
+  ScopedTimer run_timer(timer, "session_run");
+  session_run (session, 
+	       input_tensors, 
+	       {"o_energy", "o_force", has_o_virial ? "o_virial" : "o_atom_virial"}, 
+	       output_tensors, 
+	       tracer);
+  run_timer.stop();
+  ScopedTimer output_timer(timer, "output");
   
   Tensor output_e = output_tensors[0];
   Tensor output_f = output_tensors[1];
-  Tensor output_av = output_tensors[3];
+  Tensor output_v = output_tensors[2];
 
   auto oe = output_e.flat <ENERGYTYPE> ();
   auto of = output_f.flat <MODELTYPE> ();
-  auto oav = output_av.flat <MODELTYPE> ();
+  auto ov = output_v.flat <MODELTYPE> ();
 
-  dener = oe(0);
-  std::vector<VALUETYPE> dforce (3 * nall);
-  dvirial.resize (9);
-  for (unsigned ii = 0; ii < nall * 3; ++ii){
-    dforce[ii] = of(ii);
-  }
+  dforce_.resize (nframes * nall_in * 3);
+  dvirial.resize (nframes * 9);
   // set dvirial to zero, prevent input vector is not zero (#1123)
   std::fill(dvirial.begin(), dvirial.end(), (VALUETYPE)0.);
-  for (int ii = 0; ii < nall; ++ii) {
-    dvirial[0] += (VALUETYPE)1.0 * oav(9*ii+0);
-    dvirial[1] += (VALUETYPE)1.0 * oav(9*ii+1);
-    dvirial[2] += (VALUETYPE)1.0 * oav(9*ii+2);
-    dvirial[3] += (VALUETYPE)1.0 * oav(9*ii+3);
-    dvirial[4] += (VALUETYPE)1.0 * oav(9*ii+4);
-    dvirial[5] += (VALUETYPE)1.0 * oav(9*ii+5);
-    dvirial[6] += (VALUETYPE)1.0 * oav(9*ii+6);
-    dvirial[7] += (VALUETYPE)1.0 * oav(9*ii+7);
-    dvirial[8] += (VALUETYPE)1.0 * oav(9*ii+8);
+  for (int kk = 0; kk < nframes; ++kk) {
+    dener[kk] = oe(kk);
+    if (has_o_virial) {
+      for (int dd = 0; dd < 9; ++dd) {
+	dvirial[kk*9+dd] = ov(kk*9+dd);
+      }
+      continue;
+    }
+    for (int ii = 0; ii < nall; ++ii) {
+      for (int dd = 0; dd < 9; ++dd) {
+	dvirial[kk*9+dd] += (VALUETYPE)1.0 * ov(kk*nall*9 + 9*ii+dd);
+      }
+    }
+  }
+  // the outputs are read in place and mapped back to the input order
+  for (int kk = 0; kk < nframes; ++kk) {
+    plan.backward (&dforce_[kk*nall_in*3], of.data() + kk*nall*3, 3);
   }
-  dforce_ = dforce;
-  atommap.backward<VALUETYPE> (dforce_.begin(), dforce.begin(), 3);
+}
+
+template
+void
+run_model <double, double> (std::vector<ENERGYTYPE> &	dener,
+	   std::vector<double> &	dforce_,
+	   std::vector<double> &	dvirial,
+	   Session *			session, 
+	   const std::vector<std::pair<std::string, Tensor>> & input_tensors,
+	   const PermutationPlan&	plan, 
+	   const int			nframes,
+	   const bool			has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
+
+template
+void
+run_model <double, float> (std::vector<ENERGYTYPE> &	dener,
+     std::vector<float> &	dforce_,
+     std::vector<float> &	dvirial,
+     Session *			session, 
+     const std::vector<std::pair<std::string, Tensor>> & input_tensors,
+     const PermutationPlan&	plan, 
+     const int			nframes,
+     const bool			has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
+
+template
+void
+run_model <float, double> (std::vector<ENERGYTYPE> &	dener,
+	   std::vector<double> &	dforce_,
+	   std::vector<double> &	dvirial,
+	   Session *			session, 
+	   const std::vector<std::pair<std::string, Tensor>> & input_tensors,
+	   const PermutationPlan&	plan, 
+	   const int			nframes,
+	   const bool			has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
+
+template
+void
+run_model <float, float> (std::vector<ENERGYTYPE> &	dener,
+     std::vector<float> &	dforce_,
+     std::vector<float> &	dvirial,
+     Session *			session, 
+     const std::vector<std::pair<std::string, Tensor>> & input_tensors,
+     const PermutationPlan&	plan, 
+     const int			nframes,
+     const bool			has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
+
+template <typename MODELTYPE, typename VALUETYPE>
+static void 
+run_model (ENERGYTYPE &			dener,
+	   std::vector<VALUETYPE> &	dforce_,
+	   std::vector<VALUETYPE> &	dvirial,
+	   Session *			session, 
+	   const std::vector<std::pair<std::string, Tensor>> & input_tensors,
+	   const PermutationPlan&	plan, 
+	   const bool			has_o_virial = false,
+	   PhaseTimer *		timer = NULL,
+	   StepTracer *		tracer = NULL)
+{
+  std::vector<ENERGYTYPE> dener_;
+  run_model<MODELTYPE, VALUETYPE> (dener_, dforce_, dvirial, session, input_tensors, plan, 1, has_o_virial, timer, tracer);
+  dener = dener_[0];
 }
 
 template
@@ -86,8 +169,10 @@ run_model <double, double> (ENERGYTYPE &			dener,
 	   std::vector<double> &	dvirial,
 	   Session *			session, 
 	   const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-	   const AtomMap&	atommap, 
-	   const int			nghost);
+	   const PermutationPlan&	plan, 
+	   const bool			has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
 
 template
 void
@@ -96,8 +181,10 @@ run_model <double, float> (ENERGYTYPE &			dener,
      std::vector<float> &	dvirial,
      Session *			session, 
      const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-     const AtomMap&	atommap, 
-     const int			nghost);
+     const PermutationPlan&	plan, 
+     const bool			has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
 
 template
 void
@@ -106,8 +193,10 @@ run_model <float, double> (ENERGYTYPE &			dener,
 	   std::vector<double> &	dvirial,
 	   Session *			session, 
 	   const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-	   const AtomMap&	atommap, 
-	   const int			nghost);
+	   const PermutationPlan&	plan, 
+	   const bool			has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
 
 template
 void
@@ -116,45 +205,61 @@ run_model <float, float> (ENERGYTYPE &			dener,
      std::vector<float> &	dvirial,
      Session *			session, 
      const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-     const AtomMap&	atommap, 
-     const int			nghost);
+     const PermutationPlan&	plan, 
+     const bool			has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
 
 template <typename MODELTYPE, typename VALUETYPE>
-static void run_model (ENERGYTYPE   &		dener,
+static void run_model (std::vector<ENERGYTYPE> &	dener,
 		       std::vector<VALUETYPE>&	dforce_,
 		       std::vector<VALUETYPE>&	dvirial,	   
 		       std::vector<VALUETYPE>&	datom_energy_,
 		       std::vector<VALUETYPE>&	datom_virial_,
 		       Session*			session, 
 		       const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-		       const deepmd::AtomMap &   atommap, 
-		       const int&		nghost = 0)
+		       const deepmd::PermutationPlan &   plan, 
+		       const int&		nframes,
+		       const bool		has_o_virial = false,
+	   PhaseTimer *		timer = NULL,
+	   StepTracer *		tracer = NULL)
 {
-    unsigned nloc = atommap.get_type().size();
-    unsigned nall = nloc + nghost;
+    // the outputs are of the input atoms, while the model only sees the real atoms
+    unsigned nloc = plan.get_nloc_real();
+    unsigned nall = plan.get_nall_real();
+    unsigned nall_in = plan.get_nall();
+    dener.resize(nframes);
     if (nloc == 0) {
-        dener = 0;
+        fill(dener.begin(), dener.end(), (ENERGYTYPE)0.0);
         // no backward map needed
-        // dforce of size nall * 3
-        dforce_.resize(nall * 3);
+        // dforce of size nframes * nall * 3
+        dforce_.resize(nframes * nall_in * 3);
         fill(dforce_.begin(), dforce_.end(), (VALUETYPE)0.0);
-        // dvirial of size 9
-        dvirial.resize(9);
+        // dvirial of size nframes * 9
+        dvirial.resize(nframes * 9);
         fill(dvirial.begin(), dvirial.end(), (VALUETYPE)0.0);
-        // datom_energy_ of size nall
-        datom_energy_.resize(nall);
+        // datom_energy_ of size nframes * nall
+        datom_energy_.resize(nframes * nall_in);
         fill(datom_energy_.begin(), datom_energy_.end(), (VALUETYPE)0.0);
-        // datom_virial_ of size nall * 9
-        datom_virial_.resize(nall * 9);
+        // datom_virial_ of size nframes * nall * 9
+        datom_virial_.resize(nframes * nall_in * 9);
         fill(datom_virial_.begin(), datom_virial_.end(), (VALUETYPE)0.0);
         return;
     }
     std::vector<Tensor> output_tensors;
+    std::vector<std::string> output_names = {"o_energy", "o_force", "o_atom_energy", "o_atom_virial"};
+    if (has_o_virial) {
+        output_names.push_back("o_virial");
+    }
 
-    check_status (session->Run(input_tensors, 
-			    {"o_energy", "o_force", "o_atom_energy", "o_atom_virial"}, 
-			    {},
-			    &output_tensors));
+    ScopedTimer run_timer(timer, "session_run");
+    session_run (session, 
+		 input_tensors, 
+		 output_names, 
+		 output_tensors, 
+		 tracer);
+    run_timer.stop();
+    ScopedTimer output_timer(timer, "output");
 
     Tensor output_e = output_tensors[0];
     Tensor output_f = output_tensors[1];
@@ -166,39 +271,108 @@ static void run_model (ENERGYTYPE   &		dener,
     auto oae = output_ae.flat <MODELTYPE> ();
     auto oav = output_av.flat <MODELTYPE> ();
 
-    dener = oe(0);
-    std::vector<VALUETYPE> dforce (3 * nall);
-    std::vector<VALUETYPE> datom_energy (nall, 0);
-    std::vector<VALUETYPE> datom_virial (9 * nall);
-    dvirial.resize (9);
-    for (int ii = 0; ii < nall * 3; ++ii) {
-        dforce[ii] = of(ii);
-    }
-    for (int ii = 0; ii < nloc; ++ii) {
-        datom_energy[ii] = oae(ii);
-    }
-    for (int ii = 0; ii < nall * 9; ++ii) {
-        datom_virial[ii] = oav(ii);
+    dforce_.resize (nframes * nall_in * 3);
+    datom_energy_.resize (nframes * nall_in);
+    datom_virial_.resize (nframes * nall_in * 9);
+    dvirial.resize (nframes * 9);
+    // the outputs are read in place and mapped back to the input order
+    // o_atom_energy only holds the local atoms
+    for (int kk = 0; kk < nframes; ++kk) {
+        plan.backward (&dforce_[kk*nall_in*3], of.data() + kk*nall*3, 3);
+        plan.backward (&datom_energy_[kk*nall_in], oae.data() + kk*nloc, 1, nloc);
+        plan.backward (&datom_virial_[kk*nall_in*9], oav.data() + kk*nall*9, 9);
     }
     // set dvirial to zero, prevent input vector is not zero (#1123)
     std::fill(dvirial.begin(), dvirial.end(), (VALUETYPE)0.);
-    for (int ii = 0; ii < nall; ++ii) {
-        dvirial[0] += (VALUETYPE)1.0 * datom_virial[9*ii+0];
-        dvirial[1] += (VALUETYPE)1.0 * datom_virial[9*ii+1];
-        dvirial[2] += (VALUETYPE)1.0 * datom_virial[9*ii+2];
-        dvirial[3] += (VALUETYPE)1.0 * datom_virial[9*ii+3];
-        dvirial[4] += (VALUETYPE)1.0 * datom_virial[9*ii+4];
-        dvirial[5] += (VALUETYPE)1.0 * datom_virial[9*ii+5];
-        dvirial[6] += (VALUETYPE)1.0 * datom_virial[9*ii+6];
-        dvirial[7] += (VALUETYPE)1.0 * datom_virial[9*ii+7];
-        dvirial[8] += (VALUETYPE)1.0 * datom_virial[9*ii+8];
-	}
-    dforce_ = dforce;
-    datom_energy_ = datom_energy;
-    datom_virial_ = datom_virial;
-    atommap.backward<VALUETYPE> (dforce_.begin(), dforce.begin(), 3);
-    atommap.backward<VALUETYPE> (datom_energy_.begin(), datom_energy.begin(), 1);
-    atommap.backward<VALUETYPE> (datom_virial_.begin(), datom_virial.begin(), 9);
+    for (int kk = 0; kk < nframes; ++kk) {
+        dener[kk] = oe(kk);
+        if (has_o_virial) {
+            auto ov = output_tensors[4].flat <MODELTYPE> ();
+            for (int dd = 0; dd < 9; ++dd) {
+                dvirial[kk*9+dd] = ov(kk*9+dd);
+            }
+            continue;
+        }
+        for (int ii = 0; ii < nall; ++ii) {
+            for (int dd = 0; dd < 9; ++dd) {
+                dvirial[kk*9+dd] += (VALUETYPE)1.0 * oav(kk*nall*9 + 9*ii+dd);
+            }
+        }
+    }
+}
+
+template
+void run_model <double, double> (std::vector<ENERGYTYPE> &	dener,
+    std::vector<double>&	dforce_,
+    std::vector<double>&	dvirial,	   
+    std::vector<double>&	datom_energy_,
+    std::vector<double>&	datom_virial_,
+    Session*			session, 
+    const std::vector<std::pair<std::string, Tensor>> & input_tensors,
+    const deepmd::PermutationPlan &   plan, 
+    const int&		nframes,
+    const bool		has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
+
+template
+void run_model <double, float> (std::vector<ENERGYTYPE> &	dener,
+    std::vector<float>&	dforce_,
+    std::vector<float>&	dvirial,	   
+    std::vector<float>&	datom_energy_,
+    std::vector<float>&	datom_virial_,
+    Session*			session, 
+    const std::vector<std::pair<std::string, Tensor>> & input_tensors,
+    const deepmd::PermutationPlan &   plan, 
+    const int&		nframes,
+    const bool		has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
+
+template
+void run_model <float, double> (std::vector<ENERGYTYPE> &	dener,
+    std::vector<double>&	dforce_,
+    std::vector<double>&	dvirial,	   
+    std::vector<double>&	datom_energy_,
+    std::vector<double>&	datom_virial_,
+    Session*			session, 
+    const std::vector<std::pair<std::string, Tensor>> & input_tensors,
+    const deepmd::PermutationPlan &   plan, 
+    const int&		nframes,
+    const bool		has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
+
+template
+void run_model <float, float> (std::vector<ENERGYTYPE> &	dener,
+    std::vector<float>&	dforce_,
+    std::vector<float>&	dvirial,	   
+    std::vector<float>&	datom_energy_,
+    std::vector<float>&	datom_virial_,
+    Session*			session, 
+    const std::vector<std::pair<std::string, Tensor>> & input_tensors,
+    const deepmd::PermutationPlan &   plan, 
+    const int&		nframes,
+    const bool		has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
+
+template <typename MODELTYPE, typename VALUETYPE>
+static void run_model (ENERGYTYPE   &		dener,
+		       std::vector<VALUETYPE>&	dforce_,
+		       std::vector<VALUETYPE>&	dvirial,	   
+		       std::vector<VALUETYPE>&	datom_energy_,
+		       std::vector<VALUETYPE>&	datom_virial_,
+		       Session*			session, 
+		       const std::vector<std::pair<std::string, Tensor>> & input_tensors,
+		       const deepmd::PermutationPlan &   plan, 
+		       const bool		has_o_virial = false,
+	   PhaseTimer *		timer = NULL,
+	   StepTracer *		tracer = NULL)
+{
+    std::vector<ENERGYTYPE> dener_;
+    run_model<MODELTYPE, VALUETYPE> (dener_, dforce_, dvirial, datom_energy_, datom_virial_, session, input_tensors, plan, 1, has_o_virial, timer, tracer);
+    dener = dener_[0];
 }
 
 template
@@ -209,8 +383,10 @@ void run_model <double, double> (ENERGYTYPE   &		dener,
     std::vector<double>&	datom_virial_,
     Session*			session, 
     const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-    const deepmd::AtomMap &   atommap, 
-    const int&		nghost);
+    const deepmd::PermutationPlan &   plan, 
+    const bool		has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
 
 template
 void run_model <double, float> (ENERGYTYPE   &		dener,
@@ -220,8 +396,10 @@ void run_model <double, float> (ENERGYTYPE   &		dener,
     std::vector<float>&	datom_virial_,
     Session*			session, 
     const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-    const deepmd::AtomMap &   atommap, 
-    const int&		nghost);
+    const deepmd::PermutationPlan &   plan, 
+    const bool		has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
 
 template
 void run_model <float, double> (ENERGYTYPE   &		dener,
@@ -231,8 +409,10 @@ void run_model <float, double> (ENERGYTYPE   &		dener,
     std::vector<double>&	datom_virial_,
     Session*			session, 
     const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-    const deepmd::AtomMap &   atommap, 
-    const int&		nghost);
+    const deepmd::PermutationPlan &   plan, 
+    const bool		has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
 
 template
 void run_model <float, float> (ENERGYTYPE   &		dener,
@@ -242,20 +422,22 @@ void run_model <float, float> (ENERGYTYPE   &		dener,
     std::vector<float>&	datom_virial_,
     Session*			session, 
     const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-    const deepmd::AtomMap &   atommap, 
-    const int&		nghost);
+    const deepmd::PermutationPlan &   plan, 
+    const bool		has_o_virial,
+     PhaseTimer *		timer,
+     StepTracer *		tracer);
 
 DeepPot::
 DeepPot ()
     : inited (false), init_nbor (false),
-      graph_def(new GraphDef())
+      graph_def(new GraphDef()), nlist_outdated (false)
 {
 }
 
 DeepPot::
 DeepPot (const std::string & model, const int & gpu_rank, const std::string & file_content)
     : inited (false), init_nbor (false),
-      graph_def(new GraphDef())
+      graph_def(new GraphDef()), nlist_outdated (false)
 {
   init(model, gpu_rank, file_content);  
 }
@@ -267,6 +449,13 @@ DeepPot::~DeepPot() {
 void
 DeepPot::
 init (const std::string & model, const int & gpu_rank, const std::string & file_content)
+{
+  init(model, gpu_rank, file_content.data(), file_content.size());
+}
+
+void
+DeepPot::
+init (const std::string & model, const int & gpu_rank, const char * model_buffer, const size_t & buffer_size)
 {
   if (inited){
     std::cerr << "WARNING: deepmd-kit should not be initialized twice, do nothing at the second call of initializer" << std::endl;
@@ -276,12 +465,13 @@ init (const std::string & model, const int & gpu_rank, const std::string & file_
   get_env_nthreads(num_intra_nthreads, num_inter_nthreads);
   options.config.set_inter_op_parallelism_threads(num_inter_nthreads);
   options.config.set_intra_op_parallelism_threads(num_intra_nthreads);
+  perm_plan.set_spatial_sort(get_env_spatial_sort());
   deepmd::load_op_library();
 
-  if(file_content.size() == 0)
+  if(buffer_size == 0)
     check_status (ReadBinaryProto(Env::Default(), model, graph_def));
   else
-    (*graph_def).ParseFromString(file_content);
+    (*graph_def).ParseFromArray(model_buffer, buffer_size);
   int gpu_num = -1;
   #if GOOGLE_CUDA || TENSORFLOW_USE_ROCM
   DPGetDeviceCount(gpu_num); // check current device environment
@@ -297,7 +487,12 @@ init (const std::string & model, const int & gpu_rank, const std::string & file_
   #endif // GOOGLE_CUDA || TENSORFLOW_USE_ROCM
   check_status (NewSession(options, &session));
   check_status (session->Create(*graph_def));
-  dtype = session_get_dtype(session, "descrpt_attr/rcut");
+  metadata.init(*graph_def);
+  if (metadata.has_const("descrpt_attr/rcut")) {
+    dtype = metadata.get_dtype("descrpt_attr/rcut");
+  } else {
+    dtype = session_get_dtype(session, "descrpt_attr/rcut");
+  }
   if (dtype == tensorflow::DT_DOUBLE) {
     rcut = get_scalar<double>("descrpt_attr/rcut");
   } else {
@@ -310,6 +505,7 @@ init (const std::string & model, const int & gpu_rank, const std::string & file_
   if (dfparam < 0) dfparam = 0;
   if (daparam < 0) daparam = 0;
   model_type = get_scalar<STRINGTYPE>("model_attr/model_type");
+  has_o_virial = metadata.has_node("o_virial");
   try{
   model_version = get_scalar<STRINGTYPE>("model_attr/model_version");
   } catch (deepmd::tf_exception& e){
@@ -334,70 +530,67 @@ print_summary(const std::string &pre) const
   deepmd::print_summary(pre);
 }
 
+void
+DeepPot::
+warmup(const int & nloc, const int & nghost, const int & nsteps)
+{
+  if (nloc <= 0) {
+    throw deepmd::deepmd_exception("the number of atoms to warm up should be positive");
+  }
+  std::vector<double> coord, box;
+  std::vector<int> atype;
+  // the synthetic frames are not timed
+  const PhaseTimer saved_timer = timer;
+  NeighborListData warmup_nlist;
+  make_warmup_frame(coord, atype, box, warmup_nlist, nloc, nghost, ntypes, rcut, get_sel_a());
+  std::vector<double> fparam(dfparam, 0.), aparam(nloc * daparam, 0.);
+  ENERGYTYPE ener;
+  std::vector<double> force, virial;
+  if (nghost == 0) {
+    coord.resize(nloc * 3);
+    atype.resize(nloc);
+    for (int ii = 0; ii < nsteps; ++ii){
+      compute(ener, force, virial, coord, atype, box, fparam, aparam);
+    }
+  }
+  else {
+    InputNlist inlist;
+    warmup_nlist.make_inlist(inlist);
+    for (int ii = 0; ii < nsteps; ++ii){
+      compute(ener, force, virial, coord, atype, box, nghost, inlist, ii, fparam, aparam);
+    }
+  }
+  nlist_outdated = true;
+  timer = saved_timer;
+}
+
 template<class VT>
 VT
 DeepPot::
 get_scalar (const std::string & name) const
 {
+  if (metadata.has_const(name)) {
+    return metadata.get_scalar<VT>(name);
+  }
   return session_get_scalar<VT>(session, name);
 }
 
-std::string graph_info(const GraphDef & graph_def) {
-    // std::stringstream buffer;
-    // std::streambuf * old = std::cout.rdbuf(buffer.rdbuf());
-    std::string str = "";
-    for (int ii = 0; ii < graph_def.node_size(); ii++) {
-        if (graph_def.node(ii).name() == "DescrptSeA") {
-            // str = graph_def.node(ii).PrintDebugString();
-            str = graph_def.node(ii).DebugString();
-            return str;
-            // std::cout << str << std::endl;
-        }
-        if (graph_def.node(ii).name() == "DescrptSeR") {
-            // str = graph_def.node(ii).PrintDebugString();
-            str = graph_def.node(ii).DebugString();
-            return str;
-            // std::cout << str << std::endl;
-        }
-    }
-    return str;
-}
-
-// init the tmp array data
 std::vector<int> DeepPot::get_sel_a () const {
-    std::vector<int> sel_a;
-    std::istringstream is(graph_info(*graph_def));
-    std::string line = "";
-    while(is >> line) {
-        if (line.find("sel_a") != line.npos) {
-            while (std::getline(is, line) && line != "}") {
-                if (line.find("i:") != line.npos) {
-                    sel_a.push_back(atoi((line.substr(line.find("i:") + 2)).c_str()));
-                }
-            } break;
-        }
-        if (line.find("sel") != line.npos) {
-            while (std::getline(is, line) && line != "}") {
-                if (line.find("i:") != line.npos) {
-                    sel_a.push_back(atoi((line.substr(line.find("i:") + 2)).c_str()));
-                }
-            } break;
-        }
-    }
-    return sel_a;
+  return metadata.get_sel();
 }
 
 template <typename VALUETYPE>
 void
 DeepPot::
-validate_fparam_aparam(const int & nloc,
+validate_fparam_aparam(const int & nframes,
+		       const int & nloc,
 		       const std::vector<VALUETYPE> &fparam,
 		       const std::vector<VALUETYPE> &aparam)const 
 {
-  if (fparam.size() != dfparam) {
+  if (fparam.size() != dfparam && fparam.size() != nframes * dfparam) {
     throw deepmd::deepmd_exception("the dim of frame parameter provided is not consistent with what the model uses");
   }
-  if (aparam.size() != daparam * nloc) {
+  if (aparam.size() != daparam * nloc && aparam.size() != nframes * daparam * nloc) {
     throw deepmd::deepmd_exception("the dim of atom parameter provided is not consistent with what the model uses");
   }  
 }
@@ -405,17 +598,61 @@ validate_fparam_aparam(const int & nloc,
 template
 void
 DeepPot::
-validate_fparam_aparam<double>(const int & nloc,
+validate_fparam_aparam<double>(const int & nframes,
+           const int & nloc,
            const std::vector<double> &fparam,
            const std::vector<double> &aparam)const ;
 
 template
 void
 DeepPot::
-validate_fparam_aparam<float>(const int & nloc,
+validate_fparam_aparam<float>(const int & nframes,
+           const int & nloc,
            const std::vector<float> &fparam,
            const std::vector<float> &aparam)const ;
 
+// repeat the parameter of a single frame if it is shared by all frames
+template <typename VALUETYPE>
+static void
+tile_fparam_aparam (std::vector<VALUETYPE> & out_param,
+		    const int & nframes,
+		    const int & dparam,
+		    const std::vector<VALUETYPE> & param)
+{
+  if (param.size() == dparam) {
+    out_param.resize(nframes * dparam);
+    for (int ii = 0; ii < nframes; ++ii){
+      std::copy(param.begin(), param.end(), out_param.begin() + ii * dparam);
+    }
+  }
+  else {
+    out_param = param;
+  }
+}
+
+// number of frames provided by the coordinates and the box
+template <typename VALUETYPE>
+static int
+get_nframes (const std::vector<VALUETYPE> & dcoord,
+	     const int & natoms,
+	     const std::vector<VALUETYPE> & dbox)
+{
+  int nframes;
+  if (natoms > 0) {
+    nframes = dcoord.size() / (natoms * 3);
+  }
+  else {
+    nframes = dbox.size() > 0 ? dbox.size() / 9 : 1;
+  }
+  if (dcoord.size() != nframes * natoms * 3) {
+    throw deepmd::deepmd_exception("the size of coordinates is not consistent with the number of atoms");
+  }
+  if (dbox.size() != 0 && dbox.size() != nframes * 9) {
+    throw deepmd::deepmd_exception("the size of box is not consistent with the number of frames");
+  }
+  return nframes;
+}
+
 template <typename VALUETYPE>
 void
 DeepPot::
@@ -428,29 +665,77 @@ compute (ENERGYTYPE &			dener,
 	 const std::vector<VALUETYPE> &	fparam,
 	 const std::vector<VALUETYPE> &	aparam)
 {
-  int nall = dcoord_.size() / 3;
-  int nloc = nall;
-  atommap = deepmd::AtomMap (datype_.begin(), datype_.begin() + nloc);
-  assert (nloc == atommap.get_type().size());
-  validate_fparam_aparam(nloc, fparam, aparam);
+  std::vector<ENERGYTYPE> dener_;
+  compute(dener_, dforce_, dvirial, dcoord_, datype_, dbox, fparam, aparam);
+  dener = dener_[0];
+}
+
+template
+void
+DeepPot::
+compute <double> (ENERGYTYPE &			dener,
+	 std::vector<double> &	dforce_,
+	 std::vector<double> &	dvirial,
+	 const std::vector<double> &	dcoord_,
+	 const std::vector<int> &	datype_,
+	 const std::vector<double> &	dbox, 
+	 const std::vector<double> &	fparam,
+	 const std::vector<double> &	aparam);
+
+template
+void
+DeepPot::
+compute <float> (ENERGYTYPE &			dener,
+	 std::vector<float> &	dforce_,
+	 std::vector<float> &	dvirial,
+	 const std::vector<float> &	dcoord_,
+	 const std::vector<int> &	datype_,
+	 const std::vector<float> &	dbox, 
+	 const std::vector<float> &	fparam,
+	 const std::vector<float> &	aparam);
+
+template <typename VALUETYPE>
+void
+DeepPot::
+compute (std::vector<ENERGYTYPE> &	dener,
+	 std::vector<VALUETYPE> &	dforce_,
+	 std::vector<VALUETYPE> &	dvirial,
+	 const std::vector<VALUETYPE> &	dcoord_,
+	 const std::vector<int> &	datype_,
+	 const std::vector<VALUETYPE> &	dbox, 
+	 const std::vector<VALUETYPE> &	fparam_,
+	 const std::vector<VALUETYPE> &	aparam_)
+{
+  int nloc = datype_.size();
+  int nframes = get_nframes(dcoord_, nloc, dbox);
+  ScopedTimer plan_timer(&timer, "build_plan");
+  perm_plan.build(datype_, dcoord_, 0, ntypes);
+  plan_timer.stop();
+  validate_fparam_aparam(nframes, nloc, fparam_, aparam_);
+  std::vector<VALUETYPE> fparam, aparam;
+  tile_fparam_aparam(fparam, nframes, dfparam, fparam_);
+  tile_fparam_aparam(aparam, nframes, nloc * daparam, aparam_);
 
-  std::vector<std::pair<std::string, Tensor>> input_tensors;
 
   if (dtype == tensorflow::DT_DOUBLE) {
-    int ret = session_input_tensors<double> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, fparam, aparam, atommap);
-    assert (ret == nloc);
-    run_model<double> (dener, dforce_, dvirial, session, input_tensors, atommap);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors<double> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, fparam, aparam, perm_plan);
+    input_timer.stop();
+    assert (ret == perm_plan.get_nloc_real());
+    run_model<double> (dener, dforce_, dvirial, session, input_tensors, perm_plan, nframes, has_o_virial, &timer, &tracer);
   } else {
-    int ret = session_input_tensors<float> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, fparam, aparam, atommap);
-    assert (ret == nloc);
-    run_model<float> (dener, dforce_, dvirial, session, input_tensors, atommap);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors<float> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, fparam, aparam, perm_plan);
+    input_timer.stop();
+    assert (ret == perm_plan.get_nloc_real());
+    run_model<float> (dener, dforce_, dvirial, session, input_tensors, perm_plan, nframes, has_o_virial, &timer, &tracer);
   }
 }
 
 template
 void
 DeepPot::
-compute <double> (ENERGYTYPE &			dener,
+compute <double> (std::vector<ENERGYTYPE> &	dener,
 	 std::vector<double> &	dforce_,
 	 std::vector<double> &	dvirial,
 	 const std::vector<double> &	dcoord_,
@@ -462,7 +747,7 @@ compute <double> (ENERGYTYPE &			dener,
 template
 void
 DeepPot::
-compute <float> (ENERGYTYPE &			dener,
+compute <float> (std::vector<ENERGYTYPE> &	dener,
 	 std::vector<float> &	dforce_,
 	 std::vector<float> &	dvirial,
 	 const std::vector<float> &	dcoord_,
@@ -486,30 +771,36 @@ compute (ENERGYTYPE &			dener,
 	 const std::vector<VALUETYPE> &	fparam,
 	 const std::vector<VALUETYPE> &	aparam_)
 {
-  std::vector<VALUETYPE> dcoord, dforce, aparam;
-  std::vector<int> datype, fwd_map, bkw_map;
-  int nghost_real;
-  select_real_atoms(fwd_map, bkw_map, nghost_real, dcoord_, datype_, nghost, ntypes);
-  // resize to nall_real
-  dcoord.resize(bkw_map.size() * 3);
-  datype.resize(bkw_map.size());
-  // fwd map
-  select_map<VALUETYPE>(dcoord, dcoord_, fwd_map, 3);
-  select_map<int>(datype, datype_, fwd_map, 1);
-  // aparam
-  if (daparam > 0){
-    aparam.resize(bkw_map.size() - nghost_real);
-    select_map<VALUETYPE>(aparam, aparam_, fwd_map, daparam);
-  }
-  // internal nlist
-  if (ago == 0){
+  int nall = dcoord_.size() / 3;
+  int nloc = nall - nghost;
+  validate_fparam_aparam(1, nloc, fparam, aparam_);
+  // agp == 0 means that the LAMMPS nbor list has been updated, and the lists
+  // left by warmup belong to the synthetic frames
+  const int nlist_ago = nlist_outdated ? 0 : ago;
+  nlist_outdated = false;
+  if (nlist_ago == 0) {
+    ScopedTimer plan_timer(&timer, "build_plan");
+    perm_plan.build(datype_, dcoord_, nghost, ntypes);
+    plan_timer.stop();
+    ScopedTimer nlist_timer(&timer, "nlist_update");
     nlist_data.copy_from_nlist(lmp_list);
-    nlist_data.shuffle_exclude_empty(fwd_map);  
+    nlist_data.shuffle_exclude_empty(perm_plan.get_fwd_map());
+    nlist_data.make_inlist(nlist);
+  }
+  // the real atoms are selected and sorted in a single pass by the plan
+  if (dtype == tensorflow::DT_DOUBLE) {
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors<double> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, fparam, aparam_, perm_plan, nlist_ago);
+    input_timer.stop();
+    assert (perm_plan.get_nloc_real() == ret);
+    run_model<double> (dener, dforce_, dvirial, session, input_tensors, perm_plan, has_o_virial, &timer, &tracer);
+  } else {
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors<float> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, fparam, aparam_, perm_plan, nlist_ago);
+    input_timer.stop();
+    assert (perm_plan.get_nloc_real() == ret);
+    run_model<float> (dener, dforce_, dvirial, session, input_tensors, perm_plan, has_o_virial, &timer, &tracer);
   }
-  compute_inner(dener, dforce, dvirial, dcoord, datype, dbox, nghost_real, ago, fparam, aparam);
-  // bkw map
-  dforce_.resize(fwd_map.size() * 3);
-  select_map<VALUETYPE>(dforce_, dforce, bkw_map, 3);
 }
 
 template
@@ -545,59 +836,54 @@ compute <float> (ENERGYTYPE &			dener,
 template <typename VALUETYPE>
 void
 DeepPot::
-compute_inner (ENERGYTYPE &			dener,
-	       std::vector<VALUETYPE> &		dforce_,
-	       std::vector<VALUETYPE> &		dvirial,
-	       const std::vector<VALUETYPE> &	dcoord_,
-	       const std::vector<int> &		datype_,
-	       const std::vector<VALUETYPE> &	dbox, 
-	       const int			nghost,
-	       const int&			ago,
-	       const std::vector<VALUETYPE> &	fparam,
-	       const std::vector<VALUETYPE> &	aparam)
+compute (ENERGYTYPE &			dener,
+	 std::vector<VALUETYPE> &	dforce_,
+	 std::vector<VALUETYPE> &	dvirial,
+	 std::vector<VALUETYPE> &	datom_energy_,
+	 std::vector<VALUETYPE> &	datom_virial_,
+	 const std::vector<VALUETYPE> &	dcoord_,
+	 const std::vector<int> &	datype_,
+	 const std::vector<VALUETYPE> &	dbox,
+	 const std::vector<VALUETYPE> &	fparam,
+	 const std::vector<VALUETYPE> &	aparam)
 {
-  int nall = dcoord_.size() / 3;
-  int nloc = nall - nghost;
-
-    validate_fparam_aparam(nloc, fparam, aparam);
-    std::vector<std::pair<std::string, Tensor>> input_tensors;
-
-    // agp == 0 means that the LAMMPS nbor list has been updated
-    if (ago == 0) {
-      atommap = deepmd::AtomMap (datype_.begin(), datype_.begin() + nloc);
-      assert (nloc == atommap.get_type().size());
-      nlist_data.shuffle(atommap);
-      nlist_data.make_inlist(nlist);
-    }
-    if (dtype == tensorflow::DT_DOUBLE) {
-      int ret = session_input_tensors<double> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, fparam, aparam, atommap, nghost, ago);
-      assert (nloc == ret);
-      run_model<double> (dener, dforce_, dvirial, session, input_tensors, atommap, nghost);
-    } else {
-      int ret = session_input_tensors<float> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, fparam, aparam, atommap, nghost, ago);
-      assert (nloc == ret);
-      run_model<float> (dener, dforce_, dvirial, session, input_tensors, atommap, nghost);
-    }
+  std::vector<ENERGYTYPE> dener_;
+  compute(dener_, dforce_, dvirial, datom_energy_, datom_virial_, dcoord_, datype_, dbox, fparam, aparam);
+  dener = dener_[0];
 }
 
 template
 void
 DeepPot::
-compute_inner <double> (ENERGYTYPE &			dener,
+compute <double> (ENERGYTYPE &			dener,
    std::vector<double> &	dforce_,
    std::vector<double> &	dvirial,
+   std::vector<double> &	datom_energy_,
+   std::vector<double> &	datom_virial_,
    const std::vector<double> &	dcoord_,
    const std::vector<int> &	datype_,
-   const std::vector<double> &	dbox, 
-   const int			nghost,
-   const int&			ago,
+   const std::vector<double> &	dbox,
    const std::vector<double> &	fparam,
    const std::vector<double> &	aparam);
 
+template
+void
+DeepPot::
+compute <float> (ENERGYTYPE &			dener,
+   std::vector<float> &	dforce_,
+   std::vector<float> &	dvirial,
+   std::vector<float> &	datom_energy_,
+   std::vector<float> &	datom_virial_,
+   const std::vector<float> &	dcoord_,
+   const std::vector<int> &	datype_,
+   const std::vector<float> &	dbox,
+   const std::vector<float> &	fparam,
+   const std::vector<float> &	aparam);
+
 template <typename VALUETYPE>
 void
 DeepPot::
-compute (ENERGYTYPE &			dener,
+compute (std::vector<ENERGYTYPE> &	dener,
 	 std::vector<VALUETYPE> &	dforce_,
 	 std::vector<VALUETYPE> &	dvirial,
 	 std::vector<VALUETYPE> &	datom_energy_,
@@ -605,27 +891,39 @@ compute (ENERGYTYPE &			dener,
 	 const std::vector<VALUETYPE> &	dcoord_,
 	 const std::vector<int> &	datype_,
 	 const std::vector<VALUETYPE> &	dbox,
-	 const std::vector<VALUETYPE> &	fparam,
-	 const std::vector<VALUETYPE> &	aparam)
+	 const std::vector<VALUETYPE> &	fparam_,
+	 const std::vector<VALUETYPE> &	aparam_)
 {
-  atommap = deepmd::AtomMap (datype_.begin(), datype_.end());
-  validate_fparam_aparam(atommap.get_type().size(), fparam, aparam);
+  int nloc = datype_.size();
+  int nframes = get_nframes(dcoord_, nloc, dbox);
+  ScopedTimer plan_timer(&timer, "build_plan");
+  perm_plan.build(datype_, dcoord_, 0, ntypes);
+  plan_timer.stop();
+  validate_fparam_aparam(nframes, nloc, fparam_, aparam_);
+  std::vector<VALUETYPE> fparam, aparam;
+  tile_fparam_aparam(fparam, nframes, dfparam, fparam_);
+  tile_fparam_aparam(aparam, nframes, nloc * daparam, aparam_);
 
-  std::vector<std::pair<std::string, Tensor>> input_tensors;
 
   if (dtype == tensorflow::DT_DOUBLE) {
-    int nloc = session_input_tensors<double> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, fparam, aparam, atommap);
-    run_model<double> (dener, dforce_, dvirial, datom_energy_, datom_virial_, session, input_tensors, atommap);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors<double> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, fparam, aparam, perm_plan);
+    input_timer.stop();
+    assert (ret == perm_plan.get_nloc_real());
+    run_model<double> (dener, dforce_, dvirial, datom_energy_, datom_virial_, session, input_tensors, perm_plan, nframes, has_o_virial, &timer, &tracer);
   } else {
-    int nloc = session_input_tensors<float> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, fparam, aparam, atommap);
-    run_model<float> (dener, dforce_, dvirial, datom_energy_, datom_virial_, session, input_tensors, atommap);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors<float> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, fparam, aparam, perm_plan);
+    input_timer.stop();
+    assert (ret == perm_plan.get_nloc_real());
+    run_model<float> (dener, dforce_, dvirial, datom_energy_, datom_virial_, session, input_tensors, perm_plan, nframes, has_o_virial, &timer, &tracer);
   }
 }
 
 template
 void
 DeepPot::
-compute <double> (ENERGYTYPE &			dener,
+compute <double> (std::vector<ENERGYTYPE> &	dener,
    std::vector<double> &	dforce_,
    std::vector<double> &	dvirial,
    std::vector<double> &	datom_energy_,
@@ -639,7 +937,7 @@ compute <double> (ENERGYTYPE &			dener,
 template
 void
 DeepPot::
-compute <float> (ENERGYTYPE &			dener,
+compute <float> (std::vector<ENERGYTYPE> &	dener,
    std::vector<float> &	dforce_,
    std::vector<float> &	dvirial,
    std::vector<float> &	datom_energy_,
@@ -669,53 +967,33 @@ compute (ENERGYTYPE &			dener,
 {
   int nall = dcoord_.size() / 3;
   int nloc = nall - nghost;
-  validate_fparam_aparam(nloc, fparam, aparam_);
-    std::vector<std::pair<std::string, Tensor>> input_tensors;
-  // select real atoms
-  std::vector<VALUETYPE> dcoord, dforce, aparam, datom_energy, datom_virial;
-  std::vector<int> datype, fwd_map, bkw_map;
-  int nghost_real;
-  select_real_atoms(fwd_map, bkw_map, nghost_real, dcoord_, datype_, nghost, ntypes);
-  // resize to nall_real
-  int nall_real = bkw_map.size();
-  int nloc_real = nall_real - nghost_real;
-  dcoord.resize(nall_real * 3);
-  datype.resize(nall_real);
-  // fwd map
-  select_map<VALUETYPE>(dcoord, dcoord_, fwd_map, 3);
-  select_map<int>(datype, datype_, fwd_map, 1);
-  // aparam
-  if (daparam > 0){
-    aparam.resize(nloc_real);
-    select_map<VALUETYPE>(aparam, aparam_, fwd_map, daparam);
+  validate_fparam_aparam(1, nloc, fparam, aparam_);
+  // the lists left by warmup belong to the synthetic frames
+  const int nlist_ago = nlist_outdated ? 0 : ago;
+  nlist_outdated = false;
+  if (nlist_ago == 0) {
+    ScopedTimer plan_timer(&timer, "build_plan");
+    perm_plan.build(datype_, dcoord_, nghost, ntypes);
+    plan_timer.stop();
+    ScopedTimer nlist_timer(&timer, "nlist_update");
+    nlist_data.copy_from_nlist(lmp_list);
+    nlist_data.shuffle_exclude_empty(perm_plan.get_fwd_map());
+    nlist_data.make_inlist(nlist);
   }
-    if (ago == 0) {
-    atommap = deepmd::AtomMap (datype.begin(), datype.begin() + nloc_real);
-    assert (nloc_real == atommap.get_type().size());
-
-        nlist_data.copy_from_nlist(lmp_list);
-        nlist_data.shuffle_exclude_empty(fwd_map);
-        nlist_data.shuffle(atommap);
-	nlist_data.make_inlist(nlist);
-    }
 
   if (dtype == tensorflow::DT_DOUBLE) {
-    int ret = session_input_tensors<double> (input_tensors, dcoord, ntypes, datype, dbox, nlist, fparam, aparam, atommap, nghost_real, ago);
-    assert (nloc_real == ret);
-    run_model<double> (dener, dforce, dvirial, datom_energy, datom_virial, session, input_tensors, atommap, nghost_real);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors<double> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, fparam, aparam_, perm_plan, nlist_ago);
+    input_timer.stop();
+    assert (perm_plan.get_nloc_real() == ret);
+    run_model<double> (dener, dforce_, dvirial, datom_energy_, datom_virial_, session, input_tensors, perm_plan, has_o_virial, &timer, &tracer);
   } else {
-    int ret = session_input_tensors<float> (input_tensors, dcoord, ntypes, datype, dbox, nlist, fparam, aparam, atommap, nghost_real, ago);
-    assert (nloc_real == ret);
-    run_model<float> (dener, dforce, dvirial, datom_energy, datom_virial, session, input_tensors, atommap, nghost_real);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors<float> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, fparam, aparam_, perm_plan, nlist_ago);
+    input_timer.stop();
+    assert (perm_plan.get_nloc_real() == ret);
+    run_model<float> (dener, dforce_, dvirial, datom_energy_, datom_virial_, session, input_tensors, perm_plan, has_o_virial, &timer, &tracer);
   }
-
-  // bkw map
-  dforce_.resize(fwd_map.size() * 3);
-  datom_energy_.resize(fwd_map.size());
-  datom_virial_.resize(fwd_map.size() * 9);
-  select_map<VALUETYPE>(dforce_, dforce, bkw_map, 3);
-  select_map<VALUETYPE>(datom_energy_, datom_energy, bkw_map, 1);
-  select_map<VALUETYPE>(datom_virial_, datom_virial, bkw_map, 9);
 }
 
 template
@@ -764,7 +1042,9 @@ DeepPotModelDevi::
 DeepPotModelDevi ()
     : inited (false), 
       init_nbor (false),
-      numb_models (0)
+      numb_models (0),
+      num_concurrent_models (1),
+      nlist_outdated (false)
 {
 }
 
@@ -772,7 +1052,9 @@ DeepPotModelDevi::
 DeepPotModelDevi (const std::vector<std::string> & models, const int & gpu_rank, const std::vector<std::string> & file_contents)
     : inited (false), 
       init_nbor(false),
-      numb_models (0)
+      numb_models (0),
+      num_concurrent_models (1),
+      nlist_outdated (false)
 {
   init(models, gpu_rank, file_contents);
 }
@@ -786,6 +1068,19 @@ DeepPotModelDevi::~DeepPotModelDevi() {
 void
 DeepPotModelDevi::
 init (const std::vector<std::string> & models, const int & gpu_rank, const std::vector<std::string> & file_contents)
+{
+  std::vector<const char *> model_buffers;
+  std::vector<size_t> buffer_sizes;
+  for (unsigned ii = 0; ii < file_contents.size(); ++ii){
+    model_buffers.push_back(file_contents[ii].data());
+    buffer_sizes.push_back(file_contents[ii].size());
+  }
+  init(models, gpu_rank, model_buffers, buffer_sizes);
+}
+
+void
+DeepPotModelDevi::
+init (const std::vector<std::string> & models, const int & gpu_rank, const std::vector<const char *> & model_buffers, const std::vector<size_t> & buffer_sizes)
 {
   if (inited){
     std::cerr << "WARNING: deepmd-kit should not be initialized twice, do nothing at the second call of initializer" << std::endl;
@@ -802,14 +1097,21 @@ init (const std::vector<std::string> & models, const int & gpu_rank, const std::
 
   SessionOptions options;
   get_env_nthreads(num_intra_nthreads, num_inter_nthreads);
+  // the models run concurrently, so the intra-op threads are shared among them
+  num_concurrent_models = get_env_model_devi_concurrency(numb_models);
+  perm_plan.set_spatial_sort(get_env_spatial_sort());
+  int num_intra_nthreads_model = num_intra_nthreads;
+  if (num_intra_nthreads > 0) {
+    num_intra_nthreads_model = std::max(num_intra_nthreads / num_concurrent_models, 1);
+  }
   options.config.set_inter_op_parallelism_threads(num_inter_nthreads);
-  options.config.set_intra_op_parallelism_threads(num_intra_nthreads);
+  options.config.set_intra_op_parallelism_threads(num_intra_nthreads_model);
   for (unsigned ii = 0; ii < numb_models; ++ii){
     graph_defs[ii] = new GraphDef();
-    if (file_contents.size() == 0)
+    if (buffer_sizes.size() == 0)
       check_status (ReadBinaryProto(Env::Default(), models[ii], graph_defs[ii]));
     else
-      (*graph_defs[ii]).ParseFromString(file_contents[ii]);
+      (*graph_defs[ii]).ParseFromArray(model_buffers[ii], buffer_sizes[ii]);
   }
   #if GOOGLE_CUDA || TENSORFLOW_USE_ROCM
   if (gpu_num > 0) {
@@ -829,7 +1131,16 @@ init (const std::vector<std::string> & models, const int & gpu_rank, const std::
     check_status (NewSession(options, &(sessions[ii])));
     check_status (sessions[ii]->Create(*graph_defs[ii]));
   }
-  dtype = session_get_dtype(sessions[0], "descrpt_attr/rcut");
+  metadata.resize(numb_models);
+  for (unsigned ii = 0; ii < numb_models; ++ii) {
+    metadata[ii].init(*graph_defs[ii]);
+  }
+  tracers.resize(numb_models);
+  if (metadata[0].has_const("descrpt_attr/rcut")) {
+    dtype = metadata[0].get_dtype("descrpt_attr/rcut");
+  } else {
+    dtype = session_get_dtype(sessions[0], "descrpt_attr/rcut");
+  }
   if (dtype == tensorflow::DT_DOUBLE) {
     rcut = get_scalar<double>("descrpt_attr/rcut");
   } else {
@@ -842,6 +1153,10 @@ init (const std::vector<std::string> & models, const int & gpu_rank, const std::
   if (dfparam < 0) dfparam = 0;
   if (daparam < 0) daparam = 0;
   model_type = get_scalar<STRINGTYPE>("model_attr/model_type");
+  has_o_virial = true;
+  for (unsigned ii = 0; ii < numb_models; ++ii) {
+    has_o_virial = has_o_virial && metadata[ii].has_node("o_virial");
+  }
   model_version = get_scalar<STRINGTYPE>("model_attr/model_version");
   if(! model_compatable(model_version)){
     throw deepmd::deepmd_exception(
@@ -857,6 +1172,47 @@ init (const std::vector<std::string> & models, const int & gpu_rank, const std::
   init_nbor = false;
 }
 
+void
+DeepPotModelDevi::
+warmup(const int & nloc, const int & nghost, const int & nsteps)
+{
+  if (nloc <= 0) {
+    throw deepmd::deepmd_exception("the number of atoms to warm up should be positive");
+  }
+  std::vector<double> coord, box;
+  std::vector<int> atype;
+  // the synthetic frames are not timed
+  const PhaseTimer saved_timer = timer;
+  NeighborListData warmup_nlist;
+  make_warmup_frame(coord, atype, box, warmup_nlist, nloc, nghost, ntypes, rcut, get_sel()[0]);
+  std::vector<double> fparam(dfparam, 0.), aparam(nloc * daparam, 0.);
+  std::vector<ENERGYTYPE> all_ener;
+  std::vector<std::vector<double> > all_force, all_virial;
+  InputNlist inlist;
+  warmup_nlist.make_inlist(inlist);
+  for (int ii = 0; ii < nsteps; ++ii){
+    compute(all_ener, all_force, all_virial, coord, atype, box, nghost, inlist, ii, fparam, aparam);
+  }
+  nlist_outdated = true;
+  timer = saved_timer;
+}
+
+void
+DeepPotModelDevi::
+trace_next_compute(const std::string & file_name)
+{
+  // the index is inserted before the extension of the file, not of the directory
+  size_t pos_dot = file_name.rfind('.');
+  size_t pos_sep = file_name.find_last_of("/\\");
+  if (pos_dot == std::string::npos || (pos_sep != std::string::npos && pos_dot < pos_sep)) {
+    pos_dot = file_name.size();
+  }
+  tracers.resize(numb_models);
+  for (unsigned ii = 0; ii < numb_models; ++ii){
+    tracers[ii].request(file_name.substr(0, pos_dot) + "_" + std::to_string(ii) + file_name.substr(pos_dot));
+  }
+}
+
 template<class VT>
 VT
 DeepPotModelDevi::
@@ -864,7 +1220,12 @@ get_scalar(const std::string name) const
 {
   VT myrcut;
   for (unsigned ii = 0; ii < numb_models; ++ii){
-    VT ret = session_get_scalar<VT>(sessions[ii], name);
+    VT ret;
+    if (metadata[ii].has_const(name)) {
+      ret = metadata[ii].get_scalar<VT>(name);
+    } else {
+      ret = session_get_scalar<VT>(sessions[ii], name);
+    }
     if (ii == 0){
       myrcut = ret;
     }
@@ -880,30 +1241,11 @@ std::vector<std::vector<int> >
 DeepPotModelDevi::
 get_sel () const 
 {
-    std::vector<std::vector<int> > sec;
-    for (int ii = 0; ii < numb_models; ii++) {
-        std::vector<int> sel;
-        std::istringstream is(graph_info(*graph_defs[ii]));
-        std::string line = "";
-        while(is >> line) {
-            if (line.find("sel") != line.npos) {
-                while (std::getline(is, line) && line != "}") {
-                    if (line.find("i:") != line.npos) {
-                        sel.push_back(atoi((line.substr(line.find("i:") + 2)).c_str()));
-                    }
-                } break;
-            }
-            if (line.find("sel_a") != line.npos) {
-                while (std::getline(is, line) && line != "}") {
-                    if (line.find("i:") != line.npos) {
-                        sel.push_back(atoi((line.substr(line.find("i:") + 2)).c_str()));
-                    }
-                } break;
-            }
-        }
-        sec.push_back(sel);
-    }
-    return sec;
+  std::vector<std::vector<int> > sec;
+  for (int ii = 0; ii < numb_models; ii++) {
+    sec.push_back(metadata[ii].get_sel());
+  }
+  return sec;
 }
 
 
@@ -983,6 +1325,120 @@ validate_fparam_aparam<float>(const int & nloc,
 //   //      << model_devi[191] << endl;
 // }
 
+// evaluate func(ii) for ii = 0, ..., numb_models - 1, running at most 
+// nconcurrent models at the same time. Each model has its own session, 
+// and the sessions share the same input tensors. reduce(ii) is then called 
+// in the order of the models, whichever finishes first, so that the sums 
+// over the models are reproducible.
+template <typename FUNC, typename REDUCE>
+static void
+run_models_concurrently (const unsigned	numb_models,
+			 const int		nconcurrent,
+			 FUNC			func,
+			 REDUCE			reduce)
+{
+  // exceptions should not escape from the parallel region
+  std::vector<std::exception_ptr> eptr (numb_models);
+#pragma omp parallel for num_threads(nconcurrent) schedule(dynamic, 1) ordered
+  for (int ii = 0; ii < (int)numb_models; ++ii) {
+    try {
+      func(ii);
+    }
+    catch (...) {
+      eptr[ii] = std::current_exception();
+    }
+#pragma omp ordered
+    {
+      if (!eptr[ii]) {
+	try {
+	  reduce(ii);
+	}
+	catch (...) {
+	  eptr[ii] = std::current_exception();
+	}
+      }
+    }
+  }
+  for (unsigned ii = 0; ii < numb_models; ++ii) {
+    if (eptr[ii]) std::rethrow_exception(eptr[ii]);
+  }
+}
+
+template <typename FUNC>
+static void
+run_models_concurrently (const unsigned	numb_models,
+			 const int		nconcurrent,
+			 FUNC			func)
+{
+  run_models_concurrently(numb_models, nconcurrent, func, [](const int) {});
+}
+
+template <typename VALUETYPE>
+void
+DeepPotModelDevi::
+prepare_input_tensors (std::vector<std::pair<std::string, Tensor>> & input_tensors,
+		       const std::vector<VALUETYPE> &	dcoord_,
+		       const std::vector<int> &		datype_,
+		       const std::vector<VALUETYPE> &	dbox,
+		       const int			nghost,
+		       const InputNlist &		lmp_list,
+		       const int &			ago,
+		       const std::vector<VALUETYPE> &	fparam,
+		       const std::vector<VALUETYPE> &	aparam)
+{
+  int nall = dcoord_.size() / 3;
+  int nloc = nall - nghost;
+  validate_fparam_aparam(nloc, fparam, aparam);
+
+  // agp == 0 means that the LAMMPS nbor list has been updated, and the lists
+  // left by warmup belong to the synthetic frames
+  const int nlist_ago = nlist_outdated ? 0 : ago;
+  nlist_outdated = false;
+  if (nlist_ago == 0) {
+    ScopedTimer plan_timer(&timer, "build_plan");
+    perm_plan.build(datype_, dcoord_, nghost, ntypes);
+    plan_timer.stop();
+    ScopedTimer nlist_timer(&timer, "nlist_update");
+    nlist_data.copy_from_nlist(lmp_list);
+    nlist_data.shuffle_exclude_empty(perm_plan.get_fwd_map());
+    nlist_data.make_inlist(nlist);
+  }
+  int ret;
+  ScopedTimer input_timer(&timer, "input_tensors");
+  if (dtype == tensorflow::DT_DOUBLE) {
+    ret = session_input_tensors <double> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, fparam, aparam, perm_plan, nlist_ago);
+  } else {
+    ret = session_input_tensors <float> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, fparam, aparam, perm_plan, nlist_ago);
+  }
+  assert (perm_plan.get_nloc_real() == ret);
+}
+
+template
+void
+DeepPotModelDevi::
+prepare_input_tensors <double> (std::vector<std::pair<std::string, Tensor>> & input_tensors,
+   const std::vector<double> &	dcoord_,
+   const std::vector<int> &		datype_,
+   const std::vector<double> &	dbox,
+   const int			nghost,
+   const InputNlist &		lmp_list,
+   const int &			ago,
+   const std::vector<double> &	fparam,
+   const std::vector<double> &	aparam);
+
+template
+void
+DeepPotModelDevi::
+prepare_input_tensors <float> (std::vector<std::pair<std::string, Tensor>> & input_tensors,
+   const std::vector<float> &	dcoord_,
+   const std::vector<int> &		datype_,
+   const std::vector<float> &	dbox,
+   const int			nghost,
+   const InputNlist &		lmp_list,
+   const int &			ago,
+   const std::vector<float> &	fparam,
+   const std::vector<float> &	aparam);
+
 template <typename VALUETYPE>
 void
 DeepPotModelDevi::
@@ -999,37 +1455,20 @@ compute (std::vector<ENERGYTYPE> &		all_energy,
 	 const std::vector<VALUETYPE> &		aparam)
 {
   if (numb_models == 0) return;
-  int nall = dcoord_.size() / 3;
-  int nloc = nall - nghost;
-  validate_fparam_aparam(nloc, fparam, aparam);
-  std::vector<std::pair<std::string, Tensor>> input_tensors;
-
-    // agp == 0 means that the LAMMPS nbor list has been updated
-    if (ago == 0) {
-        atommap = AtomMap (datype_.begin(), datype_.begin() + nloc);
-        assert (nloc == atommap.get_type().size());
-
-        nlist_data.copy_from_nlist(lmp_list);
-        nlist_data.shuffle(atommap);
-	nlist_data.make_inlist(nlist);
-    }
-    int ret;
+  prepare_input_tensors(input_tensors, dcoord_, datype_, dbox, nghost, lmp_list, ago, fparam, aparam);
+
+  all_energy.resize (numb_models);
+  all_force.resize (numb_models);
+  all_virial.resize (numb_models);
+  // the models may run concurrently, so they are timed as a whole
+  ScopedTimer run_timer(&timer, "run_models");
+  run_models_concurrently(numb_models, num_concurrent_models, [&](const int ii) {
     if (dtype == tensorflow::DT_DOUBLE) {
-      ret = session_input_tensors <double> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, fparam, aparam, atommap, nghost, ago);
+      run_model<double> (all_energy[ii], all_force[ii], all_virial[ii], sessions[ii], input_tensors, perm_plan, has_o_virial, NULL, &tracers[ii]);
     } else {
-      ret = session_input_tensors <float> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, fparam, aparam, atommap, nghost, ago);
-    }
-    all_energy.resize (numb_models);
-    all_force.resize (numb_models);
-    all_virial.resize (numb_models);
-    assert (nloc == ret);
-    for (unsigned ii = 0; ii < numb_models; ++ii) {
-      if (dtype == tensorflow::DT_DOUBLE) {
-        run_model<double> (all_energy[ii], all_force[ii], all_virial[ii], sessions[ii], input_tensors, atommap, nghost);
-      } else {
-        run_model<float> (all_energy[ii], all_force[ii], all_virial[ii], sessions[ii], input_tensors, atommap, nghost);
-      }
+      run_model<float> (all_energy[ii], all_force[ii], all_virial[ii], sessions[ii], input_tensors, perm_plan, has_o_virial, NULL, &tracers[ii]);
     }
+  });
 }
 
 template
@@ -1080,40 +1519,22 @@ compute (std::vector<ENERGYTYPE> &		all_energy,
 	 const std::vector<VALUETYPE> &	 	aparam)
 {
   if (numb_models == 0) return;
-  int nall = dcoord_.size() / 3;
-  int nloc = nall - nghost;
-  validate_fparam_aparam(nloc, fparam, aparam);
-  std::vector<std::pair<std::string, Tensor>> input_tensors;
-
-    // agp == 0 means that the LAMMPS nbor list has been updated
-    if (ago == 0) {
-        atommap = AtomMap (datype_.begin(), datype_.begin() + nloc);
-        assert (nloc == atommap.get_type().size());
-
-        nlist_data.copy_from_nlist(lmp_list);
-        nlist_data.shuffle(atommap);
-	nlist_data.make_inlist(nlist);
-    }
-    int ret;
+  prepare_input_tensors(input_tensors, dcoord_, datype_, dbox, nghost, lmp_list, ago, fparam, aparam);
+
+  all_energy.resize (numb_models);
+  all_force .resize (numb_models);
+  all_virial.resize (numb_models);
+  all_atom_energy.resize (numb_models);
+  all_atom_virial.resize (numb_models); 
+  // the models may run concurrently, so they are timed as a whole
+  ScopedTimer run_timer(&timer, "run_models");
+  run_models_concurrently(numb_models, num_concurrent_models, [&](const int ii) {
     if (dtype == tensorflow::DT_DOUBLE) {
-      ret = session_input_tensors <double> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, fparam, aparam, atommap, nghost, ago);
+      run_model<double> (all_energy[ii], all_force[ii], all_virial[ii], all_atom_energy[ii], all_atom_virial[ii], sessions[ii], input_tensors, perm_plan, has_o_virial, NULL, &tracers[ii]);
     } else {
-      ret = session_input_tensors <float> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, fparam, aparam, atommap, nghost, ago);
-    }
-
-    all_energy.resize (numb_models);
-    all_force .resize (numb_models);
-    all_virial.resize (numb_models);
-    all_atom_energy.resize (numb_models);
-    all_atom_virial.resize (numb_models); 
-    assert (nloc == ret);
-    for (unsigned ii = 0; ii < numb_models; ++ii) {
-      if (dtype == tensorflow::DT_DOUBLE) {
-        run_model<double> (all_energy[ii], all_force[ii], all_virial[ii], all_atom_energy[ii], all_atom_virial[ii], sessions[ii], input_tensors, atommap, nghost);
-      } else {
-        run_model<float> (all_energy[ii], all_force[ii], all_virial[ii], all_atom_energy[ii], all_atom_virial[ii], sessions[ii], input_tensors, atommap, nghost);
-      }
+      run_model<float> (all_energy[ii], all_force[ii], all_virial[ii], all_atom_energy[ii], all_atom_virial[ii], sessions[ii], input_tensors, perm_plan, has_o_virial, NULL, &tracers[ii]);
     }
+  });
 }
 
 template
@@ -1150,6 +1571,123 @@ compute <float> (std::vector<ENERGYTYPE> &		all_energy,
    const std::vector<float> &		fparam,
    const std::vector<float> &		aparam);
 
+template <typename VALUETYPE>
+void
+DeepPotModelDevi::
+compute (ENERGYTYPE &				dener,
+	 std::vector<VALUETYPE> &		dforce,
+	 std::vector<VALUETYPE> &		dvirial,
+	 std::vector<VALUETYPE> &		std_f,
+	 VALUETYPE &				max_devi_f,
+	 VALUETYPE &				min_devi_f,
+	 VALUETYPE &				avg_devi_f,
+	 const std::vector<VALUETYPE> &		dcoord_,
+	 const std::vector<int> &		datype_,
+	 const std::vector<VALUETYPE> &		dbox,
+	 const int				nghost,
+	 const InputNlist &		lmp_list,
+	 const int                &		ago,
+	 const std::vector<VALUETYPE> &		fparam,
+	 const std::vector<VALUETYPE> &		aparam)
+{
+  if (numb_models == 0) return;
+  int nall = dcoord_.size() / 3;
+  int nloc = nall - nghost;
+  prepare_input_tensors(input_tensors, dcoord_, datype_, dbox, nghost, lmp_list, ago, fparam, aparam);
+
+  // running sums over the models, taken in the order of the models. the 
+  // force of each model is dropped as soon as it is accumulated
+  ENERGYTYPE sum_e = 0.;
+  std::vector<double> sum_f (nall * 3, 0.), sum_f2 (nall * 3, 0.), sum_v (9, 0.);
+  std::vector<ENERGYTYPE> all_ener (numb_models);
+  std::vector<std::vector<VALUETYPE> > all_force (numb_models), all_virial (numb_models);
+  // the models may run concurrently, so they are timed as a whole
+  ScopedTimer run_timer(&timer, "run_models");
+  run_models_concurrently(numb_models, num_concurrent_models, [&](const int ii) {
+    if (dtype == tensorflow::DT_DOUBLE) {
+      run_model<double> (all_ener[ii], all_force[ii], all_virial[ii], sessions[ii], input_tensors, perm_plan, has_o_virial, NULL, &tracers[ii]);
+    } else {
+      run_model<float> (all_ener[ii], all_force[ii], all_virial[ii], sessions[ii], input_tensors, perm_plan, has_o_virial, NULL, &tracers[ii]);
+    }
+  }, [&](const int ii) {
+    const std::vector<VALUETYPE> & force = all_force[ii];
+    const std::vector<VALUETYPE> & virial = all_virial[ii];
+    sum_e += all_ener[ii];
+    for (int jj = 0; jj < nall * 3; ++jj) {
+      sum_f[jj] += force[jj];
+      sum_f2[jj] += (double)force[jj] * force[jj];
+    }
+    for (int jj = 0; jj < 9; ++jj) {
+      sum_v[jj] += virial[jj];
+    }
+    std::vector<VALUETYPE>().swap(all_force[ii]);
+  });
+  run_timer.stop();
+
+  ScopedTimer devi_timer(&timer, "model_devi");
+  dener = sum_e / numb_models;
+  dforce.resize (nall * 3);
+  for (int jj = 0; jj < nall * 3; ++jj) {
+    dforce[jj] = sum_f[jj] / numb_models;
+  }
+  dvirial.resize (9);
+  for (int jj = 0; jj < 9; ++jj) {
+    dvirial[jj] = sum_v[jj] / numb_models;
+  }
+  std_f.resize (nloc);
+  max_devi_f = min_devi_f = avg_devi_f = 0.;
+  for (int ii = 0; ii < nloc; ++ii) {
+    double var = 0.;
+    for (int dd = 0; dd < 3; ++dd) {
+      double avg = sum_f[ii*3+dd] / numb_models;
+      var += sum_f2[ii*3+dd] / numb_models - avg * avg;
+    }
+    std_f[ii] = sqrt(std::max(var, 0.));
+    if (ii == 0 || std_f[ii] > max_devi_f) max_devi_f = std_f[ii];
+    if (ii == 0 || std_f[ii] < min_devi_f) min_devi_f = std_f[ii];
+    avg_devi_f += std_f[ii];
+  }
+  if (nloc > 0) avg_devi_f /= VALUETYPE(nloc);
+}
+
+template
+void
+DeepPotModelDevi::
+compute <double> (ENERGYTYPE &				dener,
+   std::vector<double> &		dforce,
+   std::vector<double> &		dvirial,
+   std::vector<double> &		std_f,
+   double &				max_devi_f,
+   double &				min_devi_f,
+   double &				avg_devi_f,
+   const std::vector<double> &		dcoord_,
+   const std::vector<int> &		datype_,
+   const std::vector<double> &		dbox,
+   const int				nghost,
+   const InputNlist &		lmp_list,
+   const int                &		ago,
+   const std::vector<double> &		fparam,
+   const std::vector<double> &		aparam);
+
+template
+void
+DeepPotModelDevi::
+compute <float> (ENERGYTYPE &				dener,
+   std::vector<float> &		dforce,
+   std::vector<float> &		dvirial,
+   std::vector<float> &		std_f,
+   float &				max_devi_f,
+   float &				min_devi_f,
+   float &				avg_devi_f,
+   const std::vector<float> &		dcoord_,
+   const std::vector<int> &		datype_,
+   const std::vector<float> &		dbox,
+   const int				nghost,
+   const InputNlist &		lmp_list,
+   const int                &		ago,
+   const std::vector<float> &		fparam,
+   const std::vector<float> &		aparam);
+
 template <typename VALUETYPE>
 void
 DeepPotModelDevi::
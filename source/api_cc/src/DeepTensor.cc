@@ -43,7 +43,12 @@ init (const std::string & model,
   deepmd::check_status (NewSession(options, &session));
   deepmd::check_status (ReadBinaryProto(Env::Default(), model, graph_def));
   deepmd::check_status (session->Create(*graph_def));  
-  dtype = session_get_dtype(session, "descrpt_attr/rcut");
+  metadata.init(*graph_def);
+  if (metadata.has_const("descrpt_attr/rcut")) {
+    dtype = metadata.get_dtype("descrpt_attr/rcut");
+  } else {
+    dtype = session_get_dtype(session, "descrpt_attr/rcut");
+  }
   if (dtype == tensorflow::DT_DOUBLE) {
     rcut = get_scalar<double>("descrpt_attr/rcut");
   } else {
@@ -76,6 +81,9 @@ VT
 DeepTensor::
 get_scalar (const std::string & name) const
 {
+  if (metadata.has_const(name, name_scope)) {
+    return metadata.get_scalar<VT>(name, name_scope);
+  }
   return session_get_scalar<VT>(session, name, name_scope);
 }
 
@@ -84,21 +92,40 @@ void
 DeepTensor::
 get_vector (std::vector<VT> & vec, const std::string & name) const
 {
+  if (metadata.has_const(name, name_scope)) {
+    metadata.get_vector<VT>(vec, name, name_scope);
+    return;
+  }
   session_get_vector<VT>(vec, session, name, name_scope);
 }
 
+// for each selected atom in the model order, its index among the selected 
+// input atoms, i.e. where its atomic tensor goes
+static void
+sort_sel_map (std::vector<int> &		sel_srt,
+	      const PermutationPlan &	plan,
+	      const std::vector<int> &	sel_fwd)
+{
+  const std::vector<int> & bkw_map = plan.get_bkw_map();
+  sel_srt.clear();
+  for (int ii = 0; ii < plan.get_nloc_real(); ++ii){
+    const int sel_ii = sel_fwd[bkw_map[ii]];
+    if (sel_ii >= 0) {
+      sel_srt.push_back(sel_ii);
+    }
+  }
+}
+
 template <typename MODELTYPE, typename VALUETYPE>
 void 
 DeepTensor::
 run_model (std::vector<VALUETYPE> &	d_tensor_,
 		  Session *			session, 
 		  const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-		  const AtomMap &atommap, 
-		  const std::vector<int> &	sel_fwd,
-		  const int			nghost)
+		  const PermutationPlan &plan, 
+		  const std::vector<int> &	sel_fwd)
 {
-  unsigned nloc = atommap.get_type().size();
-  unsigned nall = nloc + nghost;
+  unsigned nloc = plan.get_nloc_real();
   if (nloc == 0) {
     // return empty
     d_tensor_.clear();
@@ -106,10 +133,13 @@ run_model (std::vector<VALUETYPE> &	d_tensor_,
   }
 
   std::vector<Tensor> output_tensors;
+  ScopedTimer run_timer(&timer, "session_run");
   deepmd::check_status (session->Run(input_tensors, 
 			    {name_prefix(name_scope) + "o_" + model_type},
 			    {}, 
 			    &output_tensors));
+  run_timer.stop();
+  ScopedTimer output_timer(&timer, "output");
   
   Tensor output_t = output_tensors[0];
   // Yixiao: newer model may output rank 2 tensor [nframes x (natoms x noutdim)]
@@ -123,11 +153,8 @@ run_model (std::vector<VALUETYPE> &	d_tensor_,
     d_tensor[ii] = ot(ii);
   }
   // now we map the type-sorted sel-atom tensor back to original order
-  // first we have to get the type-sorted select map
-  std::vector<int> sel_srt = sel_fwd;
-  select_map<int>(sel_srt, sel_fwd, atommap.get_fwd_map(), 1);
-  // remove those -1 that correspond to discarded atoms
-  std::remove(sel_srt.begin(), sel_srt.end(), -1);
+  std::vector<int> sel_srt;
+  sort_sel_map(sel_srt, plan, sel_fwd);
   // now map the tensor back
   d_tensor_.resize(o_size);
   select_map<VALUETYPE>(d_tensor_, d_tensor, sel_srt, odim);
@@ -139,36 +166,32 @@ DeepTensor::
 run_model<double, double> (std::vector<double> &	d_tensor_,
 		  Session *			session, 
 		  const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-		  const AtomMap &atommap, 
-		  const std::vector<int> &	sel_fwd,
-		  const int			nghost);
+		  const PermutationPlan &plan, 
+		  const std::vector<int> &	sel_fwd);
 template
 void
 DeepTensor::
 run_model<float, double> (std::vector<double> &	d_tensor_,
 		  Session *			session, 
 		  const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-		  const AtomMap &atommap, 
-		  const std::vector<int> &	sel_fwd,
-		  const int			nghost);
+		  const PermutationPlan &plan, 
+		  const std::vector<int> &	sel_fwd);
 template
 void
 DeepTensor::
 run_model<double, float> (std::vector<float> &	d_tensor_,
 		  Session *			session, 
 		  const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-		  const AtomMap &atommap, 
-		  const std::vector<int> &	sel_fwd,
-		  const int			nghost);
+		  const PermutationPlan &plan, 
+		  const std::vector<int> &	sel_fwd);
 template
 void
 DeepTensor::
 run_model<float, float> (std::vector<float> &	d_tensor_,
 		  Session *			session, 
 		  const std::vector<std::pair<std::string, Tensor>> & input_tensors,
-		  const AtomMap &atommap, 
-		  const std::vector<int> &	sel_fwd,
-		  const int			nghost);
+		  const PermutationPlan &plan, 
+		  const std::vector<int> &	sel_fwd);
 
 template <typename MODELTYPE, typename VALUETYPE>
 void
@@ -180,13 +203,15 @@ run_model (std::vector<VALUETYPE> &		dglobal_tensor_,
 		  std::vector<VALUETYPE> &	datom_virial_,
 		  tensorflow::Session *			session, 
 		  const std::vector<std::pair<std::string, tensorflow::Tensor>> & input_tensors,
-		  const AtomMap &		atommap, 
-		  const std::vector<int> &		sel_fwd,
-		  const int				nghost)
+		  const PermutationPlan &	plan, 
+		  const std::vector<int> &		sel_fwd)
 {
-  unsigned nloc = atommap.get_type().size();
-  unsigned nall = nloc + nghost;
-  unsigned nsel = nloc - std::count(sel_fwd.begin(), sel_fwd.end(), -1);
+  unsigned nloc = plan.get_nloc_real();
+  unsigned nall = plan.get_nall_real();
+  unsigned nall_in = plan.get_nall();
+  std::vector<int> sel_srt;
+  sort_sel_map(sel_srt, plan, sel_fwd);
+  unsigned nsel = sel_srt.size();
   if (nloc == 0) {
     // return empty
     dglobal_tensor_.clear();
@@ -196,6 +221,7 @@ run_model (std::vector<VALUETYPE> &		dglobal_tensor_,
   }
 
   std::vector<Tensor> output_tensors;
+  ScopedTimer run_timer(&timer, "session_run");
   deepmd::check_status (session->Run(input_tensors, 
 			    {name_prefix(name_scope) + "o_global_" + model_type, 
 			     name_prefix(name_scope) + "o_force", 
@@ -204,6 +230,8 @@ run_model (std::vector<VALUETYPE> &		dglobal_tensor_,
 			     name_prefix(name_scope) + "o_atom_virial"},
 			    {}, 
 			    &output_tensors));
+  run_timer.stop();
+  ScopedTimer output_timer(&timer, "output");
 
   Tensor output_gt = output_tensors[0];
   Tensor output_f = output_tensors[1];
@@ -240,14 +268,10 @@ run_model (std::vector<VALUETYPE> &		dglobal_tensor_,
     dglobal_tensor_[ii] = ogt(ii);
   }
 
-  // component-wise force
-  std::vector<VALUETYPE> dforce (3 * nall * odim);
-  for (unsigned ii = 0; ii < odim * nall * 3; ++ii){
-    dforce[ii] = of(ii);
-  }
-  dforce_ = dforce;
+  // component-wise force, mapped back to the input order
+  dforce_.resize(odim * nall_in * 3);
   for (unsigned dd = 0; dd < odim; ++dd){
-    atommap.backward<VALUETYPE> (dforce_.begin() + (dd * nall * 3), dforce.begin() + (dd * nall * 3), 3);
+    plan.backward(&dforce_[dd * nall_in * 3], of.data() + dd * nall * 3, 3);
   }
 
   // component-wise virial
@@ -261,20 +285,13 @@ run_model (std::vector<VALUETYPE> &		dglobal_tensor_,
   for (unsigned ii = 0; ii < nsel * odim; ++ii){
     datom_tensor[ii] = oat(ii);
   }
-  std::vector<int> sel_srt = sel_fwd;
-  select_map<int>(sel_srt, sel_fwd, atommap.get_fwd_map(), 1);
-  std::remove(sel_srt.begin(), sel_srt.end(), -1);
   datom_tensor_.resize(nsel * odim);
   select_map<VALUETYPE>(datom_tensor_, datom_tensor, sel_srt, odim);
 
-  // component-wise atomic virial
-  std::vector<VALUETYPE> datom_virial (9 * nall * odim);
-  for (unsigned ii = 0; ii < odim * nall * 9; ++ii){
-    datom_virial[ii] = oav(ii);
-  }
-  datom_virial_ = datom_virial;
+  // component-wise atomic virial, mapped back to the input order
+  datom_virial_.resize(odim * nall_in * 9);
   for (unsigned dd = 0; dd < odim; ++dd){
-    atommap.backward<VALUETYPE> (datom_virial_.begin() + (dd * nall * 9), datom_virial.begin() + (dd * nall * 9), 9);
+    plan.backward(&datom_virial_[dd * nall_in * 9], oav.data() + dd * nall * 9, 9);
   }
 }
 
@@ -288,9 +305,8 @@ run_model<double, double> (std::vector<double> &		dglobal_tensor_,
 		  std::vector<double> &	datom_virial_,
 		  tensorflow::Session *			session, 
 		  const std::vector<std::pair<std::string, tensorflow::Tensor>> & input_tensors,
-		  const AtomMap &		atommap, 
-		  const std::vector<int> &		sel_fwd,
-		  const int				nghost);
+		  const PermutationPlan &	plan, 
+		  const std::vector<int> &		sel_fwd);
 template
 void
 DeepTensor::
@@ -301,9 +317,8 @@ run_model<float, double> (std::vector<double> &		dglobal_tensor_,
 		  std::vector<double> &	datom_virial_,
 		  tensorflow::Session *			session, 
 		  const std::vector<std::pair<std::string, tensorflow::Tensor>> & input_tensors,
-		  const AtomMap &		atommap, 
-		  const std::vector<int> &		sel_fwd,
-		  const int				nghost);
+		  const PermutationPlan &	plan, 
+		  const std::vector<int> &		sel_fwd);
 
 template
 void
@@ -315,9 +330,8 @@ run_model<double, float> (std::vector<float> &		dglobal_tensor_,
 		  std::vector<float> &	datom_virial_,
 		  tensorflow::Session *			session, 
 		  const std::vector<std::pair<std::string, tensorflow::Tensor>> & input_tensors,
-		  const AtomMap &		atommap, 
-		  const std::vector<int> &		sel_fwd,
-		  const int				nghost);
+		  const PermutationPlan &	plan, 
+		  const std::vector<int> &		sel_fwd);
 
 template
 void
@@ -329,9 +343,8 @@ run_model<float, float> (std::vector<float> &		dglobal_tensor_,
 		  std::vector<float> &	datom_virial_,
 		  tensorflow::Session *			session, 
 		  const std::vector<std::pair<std::string, tensorflow::Tensor>> & input_tensors,
-		  const AtomMap &		atommap, 
-		  const std::vector<int> &		sel_fwd,
-		  const int				nghost);
+		  const PermutationPlan &	plan, 
+		  const std::vector<int> &		sel_fwd);
 
 template <typename VALUETYPE>
 void
@@ -341,18 +354,7 @@ compute (std::vector<VALUETYPE> &	dtensor_,
 	 const std::vector<int> &	datype_,
 	 const std::vector<VALUETYPE> &	dbox)
 {
-  std::vector<VALUETYPE> dcoord;
-  std::vector<int> datype, fwd_map, bkw_map;
-  int nghost_real;
-  select_real_atoms(fwd_map, bkw_map, nghost_real, dcoord_, datype_, 0, ntypes);
-  assert(nghost_real == 0);
-  // resize to nall_real
-  dcoord.resize(bkw_map.size() * 3);
-  datype.resize(bkw_map.size());
-  // fwd map
-  select_map<VALUETYPE>(dcoord, dcoord_, fwd_map, 3);
-  select_map<int>(datype, datype_, fwd_map, 1);
-  compute_inner(dtensor_, dcoord, datype, dbox);
+  compute_inner(dtensor_, dcoord_, datype_, dbox);
 }
 
 template
@@ -381,23 +383,7 @@ compute (std::vector<VALUETYPE> &	dtensor_,
 	 const int			nghost,
 	 const InputNlist &	lmp_list)
 {
-  std::vector<VALUETYPE> dcoord;
-  std::vector<int> datype, fwd_map, bkw_map;
-  int nghost_real;
-  select_real_atoms(fwd_map, bkw_map, nghost_real, dcoord_, datype_, nghost, ntypes);
-  // resize to nall_real
-  dcoord.resize(bkw_map.size() * 3);
-  datype.resize(bkw_map.size());
-  // fwd map
-  select_map<VALUETYPE>(dcoord, dcoord_, fwd_map, 3);
-  select_map<int>(datype, datype_, fwd_map, 1);
-  // internal nlist
-  NeighborListData nlist_data;
-  nlist_data.copy_from_nlist(lmp_list);
-  nlist_data.shuffle_exclude_empty(fwd_map);  
-  InputNlist nlist;
-  nlist_data.make_inlist(nlist);
-  compute_inner(dtensor_, dcoord, datype, dbox, nghost_real, nlist);
+  compute_inner(dtensor_, dcoord_, datype_, dbox, nghost, lmp_list);
 }
 
 template
@@ -506,27 +492,7 @@ compute (std::vector<VALUETYPE> &	dglobal_tensor_,
 	 const std::vector<int> &	datype_,
 	 const std::vector<VALUETYPE> &	dbox)
 {
-  std::vector<VALUETYPE> dcoord, dforce, datom_virial;
-  std::vector<int> datype, fwd_map, bkw_map;
-  int nghost_real;
-  select_real_atoms(fwd_map, bkw_map, nghost_real, dcoord_, datype_, 0, ntypes);
-  assert(nghost_real == 0);
-  // resize to nall_real
-  dcoord.resize(bkw_map.size() * 3);
-  datype.resize(bkw_map.size());
-  // fwd map
-  select_map<VALUETYPE>(dcoord, dcoord_, fwd_map, 3);
-  select_map<int>(datype, datype_, fwd_map, 1);
-  compute_inner(dglobal_tensor_, dforce, dvirial_, datom_tensor_, datom_virial, dcoord, datype, dbox);
-  // bkw map
-  dforce_.resize(odim * fwd_map.size() * 3);
-  for(int kk = 0; kk < odim; ++kk){
-    select_map<VALUETYPE>(dforce_.begin() + kk * fwd_map.size() * 3, dforce.begin() + kk * bkw_map.size() * 3, bkw_map, 3);
-  }
-  datom_virial_.resize(odim * fwd_map.size() * 9);
-  for(int kk = 0; kk < odim; ++kk){
-    select_map<VALUETYPE>(datom_virial_.begin() + kk * fwd_map.size() * 9, datom_virial.begin() + kk * bkw_map.size() * 9, bkw_map, 9);
-  }
+  compute_inner(dglobal_tensor_, dforce_, dvirial_, datom_tensor_, datom_virial_, dcoord_, datype_, dbox);
 }
 
 template
@@ -567,32 +533,7 @@ compute (std::vector<VALUETYPE> &	dglobal_tensor_,
 	 const int			nghost,
 	 const InputNlist &	lmp_list)
 {
-  std::vector<VALUETYPE> dcoord, dforce, datom_virial;
-  std::vector<int> datype, fwd_map, bkw_map;
-  int nghost_real;
-  select_real_atoms(fwd_map, bkw_map, nghost_real, dcoord_, datype_, nghost, ntypes);
-  // resize to nall_real
-  dcoord.resize(bkw_map.size() * 3);
-  datype.resize(bkw_map.size());
-  // fwd map
-  select_map<VALUETYPE>(dcoord, dcoord_, fwd_map, 3);
-  select_map<int>(datype, datype_, fwd_map, 1);
-  // internal nlist
-  NeighborListData nlist_data;
-  nlist_data.copy_from_nlist(lmp_list);
-  nlist_data.shuffle_exclude_empty(fwd_map);  
-  InputNlist nlist;
-  nlist_data.make_inlist(nlist);
-  compute_inner(dglobal_tensor_, dforce, dvirial_, datom_tensor_, datom_virial, dcoord, datype, dbox, nghost_real, nlist);
-  // bkw map
-  dforce_.resize(odim * fwd_map.size() * 3);
-  for(int kk = 0; kk < odim; ++kk){
-    select_map<VALUETYPE>(dforce_.begin() + kk * fwd_map.size() * 3, dforce.begin() + kk * bkw_map.size() * 3, bkw_map, 3);
-  }
-  datom_virial_.resize(odim * fwd_map.size() * 9);
-  for(int kk = 0; kk < odim; ++kk){
-    select_map<VALUETYPE>(datom_virial_.begin() + kk * fwd_map.size() * 9, datom_virial.begin() + kk * bkw_map.size() * 9, bkw_map, 9);
-  }
+  compute_inner(dglobal_tensor_, dforce_, dvirial_, datom_tensor_, datom_virial_, dcoord_, datype_, dbox, nghost, lmp_list);
 }
 
 template
@@ -632,10 +573,13 @@ compute_inner (std::vector<VALUETYPE> &		dtensor_,
 	       const std::vector<int> &		datype_,
 	       const std::vector<VALUETYPE> &	dbox)
 {
-  int nall = dcoord_.size() / 3;
-  int nloc = nall;
-  AtomMap atommap (datype_.begin(), datype_.begin() + nloc);
-  assert (nloc == atommap.get_type().size());
+  // the real atoms are selected and sorted in a single pass by the plan, which
+  // is local to the call, so that the object can be shared by threads
+  PermutationPlan perm_plan;
+  ScopedTimer plan_timer(&timer, "build_plan");
+  perm_plan.build(datype_, 0, ntypes);
+  plan_timer.stop();
+  int nloc = perm_plan.get_nloc_real();
   
   std::vector<int> sel_fwd, sel_bkw;
   int nghost_sel;
@@ -645,13 +589,17 @@ compute_inner (std::vector<VALUETYPE> &		dtensor_,
   std::vector<std::pair<std::string, Tensor>> input_tensors;
 
   if (dtype == tensorflow::DT_DOUBLE) {
-    int ret = session_input_tensors <double> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), atommap, name_scope);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors <double> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), perm_plan, name_scope);
+    input_timer.stop();
     assert (ret == nloc);
-    run_model<double> (dtensor_, session, input_tensors, atommap, sel_fwd);
+    run_model<double> (dtensor_, session, input_tensors, perm_plan, sel_fwd);
   } else {
-    int ret = session_input_tensors <float> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), atommap, name_scope);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors <float> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), perm_plan, name_scope);
+    input_timer.stop();
     assert (ret == nloc);
-    run_model<float> (dtensor_, session, input_tensors, atommap, sel_fwd);
+    run_model<float> (dtensor_, session, input_tensors, perm_plan, sel_fwd);
   }
 }
 
@@ -681,33 +629,41 @@ compute_inner (std::vector<VALUETYPE> &		dtensor_,
 	       const int			nghost,
 	       const InputNlist &	nlist_)
 {
-  int nall = dcoord_.size() / 3;
-  int nloc = nall - nghost;
-  AtomMap atommap (datype_.begin(), datype_.begin() + nloc);
-  assert (nloc == atommap.get_type().size());
+  // the real atoms are selected and sorted in a single pass by the plan, which
+  // is local to the call, so that the object can be shared by threads
+  PermutationPlan perm_plan;
+  ScopedTimer plan_timer(&timer, "build_plan");
+  perm_plan.build(datype_, nghost, ntypes);
+  plan_timer.stop();
+  int nloc = perm_plan.get_nloc_real();
 
   std::vector<int> sel_fwd, sel_bkw;
   int nghost_sel;
   // this gives the raw selection map, will pass to run model
   select_by_type(sel_fwd, sel_bkw, nghost_sel, dcoord_, datype_, nghost, sel_type);
-  sel_fwd.resize(nloc);
 
+  ScopedTimer nlist_timer(&timer, "nlist_update");
   NeighborListData nlist_data;
   nlist_data.copy_from_nlist(nlist_);
-  nlist_data.shuffle(atommap);
+  nlist_data.shuffle_exclude_empty(perm_plan.get_fwd_map());
   InputNlist nlist;
   nlist_data.make_inlist(nlist);
+  nlist_timer.stop();
 
   std::vector<std::pair<std::string, Tensor>> input_tensors;
 
   if (dtype == tensorflow::DT_DOUBLE) {
-    int ret = session_input_tensors <double> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), atommap, nghost, 0, name_scope);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors <double> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), perm_plan, 0, name_scope);
+    input_timer.stop();
     assert (nloc == ret);
-    run_model<double> (dtensor_, session, input_tensors, atommap, sel_fwd, nghost);
+    run_model<double> (dtensor_, session, input_tensors, perm_plan, sel_fwd);
   } else {
-    int ret = session_input_tensors <float> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), atommap, nghost, 0, name_scope);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors <float> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), perm_plan, 0, name_scope);
+    input_timer.stop();
     assert (nloc == ret);
-    run_model<float> (dtensor_, session, input_tensors, atommap, sel_fwd, nghost);
+    run_model<float> (dtensor_, session, input_tensors, perm_plan, sel_fwd);
   }
 }
 
@@ -743,10 +699,13 @@ compute_inner (std::vector<VALUETYPE> &		dglobal_tensor_,
 	       const std::vector<int> &		datype_,
 	       const std::vector<VALUETYPE> &	dbox)
 {
-  int nall = dcoord_.size() / 3;
-  int nloc = nall;
-  AtomMap atommap (datype_.begin(), datype_.begin() + nloc);
-  assert (nloc == atommap.get_type().size());
+  // the real atoms are selected and sorted in a single pass by the plan, which
+  // is local to the call, so that the object can be shared by threads
+  PermutationPlan perm_plan;
+  ScopedTimer plan_timer(&timer, "build_plan");
+  perm_plan.build(datype_, 0, ntypes);
+  plan_timer.stop();
+  int nloc = perm_plan.get_nloc_real();
   
   std::vector<int> sel_fwd, sel_bkw;
   int nghost_sel;
@@ -756,13 +715,17 @@ compute_inner (std::vector<VALUETYPE> &		dglobal_tensor_,
   std::vector<std::pair<std::string, Tensor>> input_tensors;
 
   if (dtype == tensorflow::DT_DOUBLE) {
-    int ret = session_input_tensors <double> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), atommap, name_scope);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors <double> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), perm_plan, name_scope);
+    input_timer.stop();
     assert (ret == nloc);
-    run_model<double> (dglobal_tensor_, dforce_, dvirial_, datom_tensor_, datom_virial_, session, input_tensors, atommap, sel_fwd);
+    run_model<double> (dglobal_tensor_, dforce_, dvirial_, datom_tensor_, datom_virial_, session, input_tensors, perm_plan, sel_fwd);
   } else {
-    int ret = session_input_tensors <float> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), atommap, name_scope);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors <float> (input_tensors, dcoord_, ntypes, datype_, dbox, cell_size, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), perm_plan, name_scope);
+    input_timer.stop();
     assert (ret == nloc);
-    run_model<float> (dglobal_tensor_, dforce_, dvirial_, datom_tensor_, datom_virial_, session, input_tensors, atommap, sel_fwd);
+    run_model<float> (dglobal_tensor_, dforce_, dvirial_, datom_tensor_, datom_virial_, session, input_tensors, perm_plan, sel_fwd);
   }
 }
 
@@ -804,33 +767,41 @@ compute_inner (std::vector<VALUETYPE> &		dglobal_tensor_,
 	       const int			nghost,
 	       const InputNlist &	nlist_)
 {
-  int nall = dcoord_.size() / 3;
-  int nloc = nall - nghost;
-  AtomMap atommap (datype_.begin(), datype_.begin() + nloc);
-  assert (nloc == atommap.get_type().size());
+  // the real atoms are selected and sorted in a single pass by the plan, which
+  // is local to the call, so that the object can be shared by threads
+  PermutationPlan perm_plan;
+  ScopedTimer plan_timer(&timer, "build_plan");
+  perm_plan.build(datype_, nghost, ntypes);
+  plan_timer.stop();
+  int nloc = perm_plan.get_nloc_real();
 
   std::vector<int> sel_fwd, sel_bkw;
   int nghost_sel;
   // this gives the raw selection map, will pass to run model
   select_by_type(sel_fwd, sel_bkw, nghost_sel, dcoord_, datype_, nghost, sel_type);
-  sel_fwd.resize(nloc);
 
+  ScopedTimer nlist_timer(&timer, "nlist_update");
   NeighborListData nlist_data;
   nlist_data.copy_from_nlist(nlist_);
-  nlist_data.shuffle(atommap);
+  nlist_data.shuffle_exclude_empty(perm_plan.get_fwd_map());
   InputNlist nlist;
   nlist_data.make_inlist(nlist);
+  nlist_timer.stop();
 
   std::vector<std::pair<std::string, Tensor>> input_tensors;
 
   if (dtype == tensorflow::DT_DOUBLE) {
-    int ret = session_input_tensors <double> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), atommap, nghost, 0, name_scope);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors <double> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), perm_plan, 0, name_scope);
+    input_timer.stop();
     assert (nloc == ret);
-    run_model<double> (dglobal_tensor_, dforce_, dvirial_, datom_tensor_, datom_virial_, session, input_tensors, atommap, sel_fwd, nghost);
+    run_model<double> (dglobal_tensor_, dforce_, dvirial_, datom_tensor_, datom_virial_, session, input_tensors, perm_plan, sel_fwd);
   } else {
-    int ret = session_input_tensors <float> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), atommap, nghost, 0, name_scope);
+    ScopedTimer input_timer(&timer, "input_tensors");
+    int ret = session_input_tensors <float> (input_tensors, dcoord_, ntypes, datype_, dbox, nlist, std::vector<VALUETYPE>(), std::vector<VALUETYPE>(), perm_plan, 0, name_scope);
+    input_timer.stop();
     assert (nloc == ret);
-    run_model<float> (dglobal_tensor_, dforce_, dvirial_, datom_tensor_, datom_virial_, session, input_tensors, atommap, sel_fwd, nghost);
+    run_model<float> (dglobal_tensor_, dforce_, dvirial_, datom_tensor_, datom_virial_, session, input_tensors, perm_plan, sel_fwd);
   }
 }
 
@@ -1,7 +1,14 @@
 #include "common.h"
 #include "AtomMap.h"
 #include "device.h"
+#include "region.h"
 #include <fcntl.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
 #if defined(_WIN32)
 #if defined(_WIN32_WINNT)
 #undef _WIN32_WINNT
@@ -16,6 +23,11 @@
 #else
 // not windows
 #include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
 #endif
 #include "google/protobuf/text_format.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
@@ -167,18 +179,198 @@ select_real_atoms <float> (std::vector<int> & fwd_map,
 		  const int & nghost,
 		  const int & ntypes);
 
+deepmd::PermutationPlan::
+PermutationPlan()
+    : spatial_sort(false), src_nghost(-1), src_ntypes(-1), nloc(0), nloc_real(0)
+{
+}
+
+bool
+deepmd::PermutationPlan::
+build(const std::vector<int> & datype,
+      const int & nghost,
+      const int & ntypes)
+{
+  if (nghost == src_nghost && ntypes == src_ntypes && datype == src_type) {
+    return false;
+  }
+  src_type = datype;
+  src_nghost = nghost;
+  src_ntypes = ntypes;
+  int nall = datype.size();
+  nloc = nall - nghost;
+  // the real local atoms are sorted by type, stable in the input order
+  std::vector<int> local_idx, local_type;
+  local_idx.reserve(nloc);
+  local_type.reserve(nloc);
+  for (int ii = 0; ii < nloc; ++ii){
+    if (datype[ii] >= 0 && datype[ii] < ntypes) {
+      local_idx.push_back(ii);
+      local_type.push_back(datype[ii]);
+    }
+  }
+  const AtomMap local_map(local_type.begin(), local_type.end());
+  const std::vector<int> & local_bkw_map = local_map.get_bkw_map();
+  nloc_real = local_idx.size();
+  bkw_map.resize(nloc_real);
+  bkw_map.reserve(nall);
+  for (int ii = 0; ii < nloc_real; ++ii){
+    bkw_map[ii] = local_idx[local_bkw_map[ii]];
+  }
+  // the real ghost atoms keep their order
+  for (int ii = nloc; ii < nall; ++ii){
+    if (datype[ii] >= 0 && datype[ii] < ntypes) {
+      bkw_map.push_back(ii);
+    }
+  }
+  fwd_map.assign(nall, -1);
+  type.resize(bkw_map.size());
+  for (int ii = 0; ii < bkw_map.size(); ++ii){
+    fwd_map[bkw_map[ii]] = ii;
+    type[ii] = datype[bkw_map[ii]];
+  }
+  return true;
+}
+
+// spread the lower 10 bits of xx to every third bit
+static inline unsigned
+morton_spread(unsigned xx)
+{
+  xx &= 0x3ffu;
+  xx = (xx | (xx << 16)) & 0x030000ffu;
+  xx = (xx | (xx << 8)) & 0x0300f00fu;
+  xx = (xx | (xx << 4)) & 0x030c30c3u;
+  xx = (xx | (xx << 2)) & 0x09249249u;
+  return xx;
+}
+
+template <typename VALUETYPE>
+bool
+deepmd::PermutationPlan::
+build(const std::vector<int> & datype,
+      const std::vector<VALUETYPE> & dcoord,
+      const int & nghost,
+      const int & ntypes)
+{
+  if (!spatial_sort) {
+    return build(datype, nghost, ntypes);
+  }
+  // the atoms move between the calls, the plan is always rebuilt
+  src_nghost = -1;
+  build(datype, nghost, ntypes);
+  src_nghost = -1;
+  const int nall_real = bkw_map.size();
+  if (nall_real == 0) {
+    return true;
+  }
+  // the Morton keys in the bounding box of the real atoms, 10 bits in each direction
+  double lo[3], hi[3], scale[3];
+  for (int dd = 0; dd < 3; ++dd){
+    lo[dd] = hi[dd] = dcoord[bkw_map[0] * 3 + dd];
+  }
+  for (int ii = 1; ii < nall_real; ++ii){
+    for (int dd = 0; dd < 3; ++dd){
+      const double xx = dcoord[bkw_map[ii] * 3 + dd];
+      lo[dd] = std::min(lo[dd], xx);
+      hi[dd] = std::max(hi[dd], xx);
+    }
+  }
+  for (int dd = 0; dd < 3; ++dd){
+    scale[dd] = hi[dd] > lo[dd] ? 1023. / (hi[dd] - lo[dd]) : 0.;
+  }
+  std::vector<std::pair<unsigned, int> > keyed(nall_real);
+  for (int ii = 0; ii < nall_real; ++ii){
+    const int idx = bkw_map[ii];
+    unsigned key = 0;
+    for (int dd = 0; dd < 3; ++dd){
+      key |= morton_spread(unsigned((dcoord[idx * 3 + dd] - lo[dd]) * scale[dd])) << dd;
+    }
+    keyed[ii] = std::pair<unsigned, int>(key, idx);
+  }
+  // sort each type of the local atoms, and the ghost atoms, ties by the input order
+  int stt = 0;
+  while (stt < nall_real) {
+    int end = nall_real;
+    if (stt < nloc_real) {
+      end = stt + 1;
+      while (end < nloc_real && type[end] == type[stt]) ++end;
+    }
+    std::sort(keyed.begin() + stt, keyed.begin() + end);
+    stt = end;
+  }
+  for (int ii = 0; ii < nall_real; ++ii){
+    bkw_map[ii] = keyed[ii].second;
+    fwd_map[bkw_map[ii]] = ii;
+    type[ii] = datype[bkw_map[ii]];
+  }
+  return true;
+}
+
+template bool deepmd::PermutationPlan::build<double>(const std::vector<int> &, const std::vector<double> &, const int &, const int &);
+template bool deepmd::PermutationPlan::build<float>(const std::vector<int> &, const std::vector<float> &, const int &, const int &);
+
+template <typename VT_OUT, typename VT_IN>
+void
+deepmd::PermutationPlan::
+forward(VT_OUT * out,
+	const VT_IN * in,
+	const int & stride,
+	const int & nmodel) const
+{
+  const int nn = nmodel < 0 ? bkw_map.size() : nmodel;
+  for (int ii = 0; ii < nn; ++ii){
+    const int in_ii = bkw_map[ii];
+    for (int dd = 0; dd < stride; ++dd){
+      out[ii * stride + dd] = in[in_ii * stride + dd];
+    }
+  }
+}
+
+template <typename VT_OUT, typename VT_IN>
+void
+deepmd::PermutationPlan::
+backward(VT_OUT * out,
+	 const VT_IN * in,
+	 const int & stride,
+	 const int & nmodel) const
+{
+  const int nn = nmodel < 0 ? bkw_map.size() : nmodel;
+  std::fill(out, out + fwd_map.size() * stride, (VT_OUT)0);
+  for (int ii = 0; ii < nn; ++ii){
+    const int out_ii = bkw_map[ii];
+    for (int dd = 0; dd < stride; ++dd){
+      out[out_ii * stride + dd] = in[ii * stride + dd];
+    }
+  }
+}
+
+template void deepmd::PermutationPlan::forward<double, double>(double *, const double *, const int &, const int &) const;
+template void deepmd::PermutationPlan::forward<double, float>(double *, const float *, const int &, const int &) const;
+template void deepmd::PermutationPlan::forward<float, double>(float *, const double *, const int &, const int &) const;
+template void deepmd::PermutationPlan::forward<float, float>(float *, const float *, const int &, const int &) const;
+template void deepmd::PermutationPlan::backward<double, double>(double *, const double *, const int &, const int &) const;
+template void deepmd::PermutationPlan::backward<double, float>(double *, const float *, const int &, const int &) const;
+template void deepmd::PermutationPlan::backward<float, double>(float *, const double *, const int &, const int &) const;
+template void deepmd::PermutationPlan::backward<float, float>(float *, const float *, const int &, const int &) const;
+
 void
 deepmd::NeighborListData::
 copy_from_nlist(const InputNlist & inlist)
 {
   int inum = inlist.inum;
   ilist.resize(inum);
-  jlist.resize(inum);
-  memcpy(&ilist[0], inlist.ilist, inum*sizeof(int));
+  jrange.resize(inum + 1);
+  if (inum > 0) {
+    memcpy(&ilist[0], inlist.ilist, inum*sizeof(int));
+  }
+  jrange[0] = 0;
+  for(int ii = 0; ii < inum; ++ii){
+    jrange[ii+1] = jrange[ii] + inlist.numneigh[ii];
+  }
+  jlist.resize(jrange[inum]);
+#pragma omp parallel for
   for(int ii = 0; ii < inum; ++ii){
-    int jnum = inlist.numneigh[ii];
-    jlist[ii].resize(jnum);
-    memcpy(&jlist[ii][0], inlist.firstneigh[ii], jnum*sizeof(int));
+    memcpy(jlist.data() + jrange[ii], inlist.firstneigh[ii], inlist.numneigh[ii]*sizeof(int));
   }
 }
 
@@ -200,11 +392,13 @@ shuffle(const std::vector<int> & fwd_map)
       ilist[ii] = fwd_map[ilist[ii]];
     }
   }
-  for(unsigned ii = 0; ii < jlist.size(); ++ii){
-    for(unsigned jj = 0; jj < jlist[ii].size(); ++jj){
-      if(jlist[ii][jj] < nloc){
-	jlist[ii][jj] = fwd_map[jlist[ii][jj]];
-      }
+  // a single pass over the flat neighbor array
+  const int nneigh = jlist.size();
+  int * jdata = jlist.data();
+#pragma omp parallel for
+  for(int kk = 0; kk < nneigh; ++kk){
+    if(jdata[kk] < nloc){
+      jdata[kk] = fwd_map[jdata[kk]];
     }
   }
 }
@@ -214,30 +408,44 @@ deepmd::NeighborListData::
 shuffle_exclude_empty (const std::vector<int> & fwd_map)
 {
   shuffle(fwd_map);
-  std::vector<int > new_ilist;
-  std::vector<std::vector<int> > new_jlist;
-  new_ilist.reserve(ilist.size());
-  new_jlist.reserve(jlist.size());
-  for(int ii = 0; ii < ilist.size(); ++ii){
+  // the number of the kept neighbors of each atom, zero if the atom is excluded
+  const int inum = ilist.size();
+  std::vector<int > jnum(inum, 0);
+#pragma omp parallel for
+  for(int ii = 0; ii < inum; ++ii){
     if(ilist[ii] >= 0){
-      new_ilist.push_back(ilist[ii]);
+      for(int jj = jrange[ii]; jj < jrange[ii+1]; ++jj){
+	jnum[ii] += (jlist[jj] >= 0);
+      }
     }
   }
-  int new_inum = new_ilist.size();
-  for(int ii = 0; ii < jlist.size(); ++ii){
+  // the kept atoms and the offsets of their neighbors
+  std::vector<int > old_idx;
+  old_idx.reserve(inum);
+  tmp_ilist.clear();
+  tmp_jrange.assign(1, 0);
+  for(int ii = 0; ii < inum; ++ii){
     if(ilist[ii] >= 0){
-      std::vector<int> tmp_jlist;
-      tmp_jlist.reserve(jlist[ii].size());
-      for(int jj = 0; jj < jlist[ii].size(); ++jj){
-	if(jlist[ii][jj] >= 0){
-	  tmp_jlist.push_back(jlist[ii][jj]);
-	}
+      old_idx.push_back(ii);
+      tmp_ilist.push_back(ilist[ii]);
+      tmp_jrange.push_back(tmp_jrange.back() + jnum[ii]);
+    }
+  }
+  const int new_inum = tmp_ilist.size();
+  tmp_jlist.resize(tmp_jrange[new_inum]);
+#pragma omp parallel for
+  for(int kk = 0; kk < new_inum; ++kk){
+    const int ii = old_idx[kk];
+    int * out = tmp_jlist.data() + tmp_jrange[kk];
+    for(int jj = jrange[ii]; jj < jrange[ii+1]; ++jj){
+      if(jlist[jj] >= 0){
+	*(out++) = jlist[jj];
       }
-      new_jlist.push_back(tmp_jlist);
     }
   }
-  ilist = new_ilist;
-  jlist = new_jlist;
+  ilist.swap(tmp_ilist);
+  jlist.swap(tmp_jlist);
+  jrange.swap(tmp_jrange);
 }
 
 void 
@@ -248,13 +456,81 @@ make_inlist(InputNlist & inlist)
   numneigh.resize(nloc);
   firstneigh.resize(nloc);
   for(int ii = 0; ii < nloc; ++ii){
-    numneigh[ii] = jlist[ii].size();
-    firstneigh[ii] = &jlist[ii][0];
+    numneigh[ii] = jrange[ii+1] - jrange[ii];
+    firstneigh[ii] = jlist.data() + jrange[ii];
   }
   inlist.inum = nloc;
-  inlist.ilist = &ilist[0];
-  inlist.numneigh = &numneigh[0];
-  inlist.firstneigh = &firstneigh[0];
+  inlist.ilist = ilist.data();
+  inlist.numneigh = numneigh.data();
+  inlist.firstneigh = firstneigh.data();
+}
+
+void
+deepmd::
+make_warmup_frame(std::vector<double> & coord,
+		  std::vector<int> & atype,
+		  std::vector<double> & box,
+		  NeighborListData & nlist_data,
+		  const int & nloc,
+		  const int & nghost,
+		  const int & ntypes,
+		  const double & rcut,
+		  const std::vector<int> & sel)
+{
+  int nnei = 0;
+  for (int ii = 0; ii < sel.size(); ++ii){
+    nnei += sel[ii];
+  }
+  double density = 0.1;
+  if (nnei > 0) {
+    density = nnei / (4. / 3. * M_PI * rcut * rcut * rcut);
+  }
+  const double length = std::cbrt(std::max(nloc, 1) / density);
+  box.assign(9, 0.);
+  box[0] = box[4] = box[8] = length;
+  const int nall = nloc + nghost;
+  coord.resize(nall * 3);
+  atype.resize(nall);
+  // a fixed seed, so that the warm up is reproducible
+  std::mt19937 gen(20220401);
+  std::uniform_real_distribution<double> uniform(0., 1.);
+  for (int ii = 0; ii < nloc; ++ii){
+    for (int dd = 0; dd < 3; ++dd){
+      coord[ii * 3 + dd] = uniform(gen) * length;
+    }
+  }
+  for (int ii = nloc; ii < nall; ++ii){
+    bool inside = true;
+    while (inside) {
+      inside = true;
+      for (int dd = 0; dd < 3; ++dd){
+	coord[ii * 3 + dd] = uniform(gen) * (length + 2 * rcut) - rcut;
+	inside = inside && coord[ii * 3 + dd] >= 0 && coord[ii * 3 + dd] < length;
+      }
+    }
+  }
+  for (int ii = 0; ii < nall; ++ii){
+    atype[ii] = ii % ntypes;
+  }
+  // build the neighbor list, the buffer is enlarged if it is not large enough
+  deepmd::Region<double> region;
+  deepmd::init_region_cpu(region, &box[0]);
+  int mem_size = std::max(2 * nnei, 64);
+  std::vector<int> ilist(nloc), numneigh(nloc), jlist;
+  std::vector<int*> firstneigh(nloc);
+  while (true) {
+    jlist.resize((size_t)nloc * mem_size);
+    for (int ii = 0; ii < nloc; ++ii){
+      firstneigh[ii] = &jlist[(size_t)ii * mem_size];
+    }
+    InputNlist inlist(nloc, ilist.data(), numneigh.data(), firstneigh.data());
+    int max_list_size = 0;
+    if (build_nlist_cell_cpu(inlist, &max_list_size, coord.data(), nloc, nall, mem_size, rcut, region) == 0) {
+      nlist_data.copy_from_nlist(inlist);
+      break;
+    }
+    mem_size = max_list_size;
+  }
 }
 
 void
@@ -266,6 +542,93 @@ check_status(const tensorflow::Status& status) {
   }
 }
 
+void
+deepmd::StepTracer::
+write(const std::string & trace)
+{
+  std::ofstream ofs(file);
+  if (!ofs.is_open()) {
+    throw deepmd::deepmd_exception("Cannot write the trace to " + file);
+  }
+  ofs << trace;
+  file.clear();
+}
+
+void
+deepmd::
+session_run(tensorflow::Session* session,
+	    const std::vector<std::pair<std::string, tensorflow::Tensor>> & input_tensors,
+	    const std::vector<std::string> & output_names,
+	    std::vector<tensorflow::Tensor> & output_tensors,
+	    StepTracer * tracer)
+{
+  if (tracer == NULL || !tracer->requested()) {
+    check_status (session->Run(input_tensors, output_names, {}, &output_tensors));
+    return;
+  }
+  tensorflow::RunOptions run_options;
+  run_options.set_trace_level(tensorflow::RunOptions::FULL_TRACE);
+  tensorflow::RunMetadata run_metadata;
+  check_status (session->Run(run_options, input_tensors, output_names, {}, &output_tensors, &run_metadata));
+  tracer->write(step_stats_to_chrome_trace(run_metadata.step_stats()));
+}
+
+static std::string
+json_string(const std::string & str)
+{
+  std::ostringstream oss;
+  oss << '"';
+  for (char cc : str) {
+    if (cc == '"' || cc == '\\') {
+      oss << '\\' << cc;
+    }
+    else if ((unsigned char)cc < 0x20) {
+      oss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)cc << std::dec;
+    }
+    else {
+      oss << cc;
+    }
+  }
+  oss << '"';
+  return oss.str();
+}
+
+std::string
+deepmd::
+step_stats_to_chrome_trace(const tensorflow::StepStats & step_stats)
+{
+  std::ostringstream oss;
+  oss << "{\"traceEvents\": [";
+  bool first = true;
+  for (int pid = 0; pid < step_stats.dev_stats_size(); ++pid) {
+    const tensorflow::DeviceStepStats & dev_stats = step_stats.dev_stats(pid);
+    oss << (first ? "\n" : ",\n");
+    first = false;
+    oss << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid 
+	<< ", \"args\": {\"name\": " << json_string(dev_stats.device()) << "}}";
+    for (int ii = 0; ii < dev_stats.node_stats_size(); ++ii) {
+      const tensorflow::NodeExecStats & node_stats = dev_stats.node_stats(ii);
+      // the label is "node = Op(inputs)", as parsed by tensorflow.python.client.timeline
+      const std::string & label = node_stats.timeline_label();
+      std::string op = node_stats.node_name();
+      size_t op_start = label.find(" = ");
+      if (op_start != std::string::npos) {
+	op_start += 3;
+	op = label.substr(op_start, label.find('(', op_start) - op_start);
+      }
+      oss << ",\n{\"name\": " << json_string(op) 
+	  << ", \"cat\": \"Op\", \"ph\": \"X\", \"pid\": " << pid 
+	  << ", \"tid\": " << node_stats.thread_id()
+	  << ", \"ts\": " << node_stats.all_start_micros()
+	  << ", \"dur\": " << node_stats.all_end_rel_micros()
+	  << ", \"args\": {\"name\": " << json_string(node_stats.node_name()) 
+	  << ", \"op\": " << json_string(op) << "}}";
+    }
+  }
+  oss << "\n]}\n";
+  return oss.str();
+}
+
 void
 throw_env_not_set_warning(std::string env_name)
 {
@@ -308,6 +671,116 @@ get_env_nthreads(int & num_intra_nthreads,
   }
 }
 
+int
+deepmd::
+get_env_model_devi_concurrency(const int & numb_models)
+{
+  int num_concurrent = numb_models;
+  const char* env_concurrent = std::getenv("DP_MODEL_DEVI_CONCURRENCY");
+  if (env_concurrent && 
+      std::string(env_concurrent) != std::string("") && 
+      atoi(env_concurrent) > 0
+      ) {
+    num_concurrent = std::min(atoi(env_concurrent), numb_models);
+  }
+  return std::max(num_concurrent, 1);
+}
+
+bool
+deepmd::
+get_env_spatial_sort()
+{
+  const char* env_spatial_sort = std::getenv("DP_SPATIAL_SORT");
+  return env_spatial_sort && 
+      std::string(env_spatial_sort) != std::string("") && 
+      std::string(env_spatial_sort) != std::string("0");
+}
+
+deepmd::PhaseTimer::
+PhaseTimer()
+{
+  const char* env_timing = std::getenv("DP_TIMING");
+  is_enabled = env_timing && 
+      std::string(env_timing) != std::string("") && 
+      std::string(env_timing) != std::string("0");
+}
+
+void
+deepmd::PhaseTimer::
+add(const char * phase, const double & seconds_)
+{
+  // a few phases, a linear search is fast enough
+  int idx = 0;
+  for (; idx < phases.size(); ++idx){
+    if (phases[idx] == phase) break;
+  }
+  if (idx == phases.size()) {
+    phases.push_back(phase);
+    seconds.push_back(0.);
+    counts.push_back(0);
+  }
+  seconds[idx] += seconds_;
+  counts[idx] ++;
+}
+
+void
+deepmd::PhaseTimer::
+clear()
+{
+  phases.clear();
+  seconds.clear();
+  counts.clear();
+}
+
+std::string
+deepmd::PhaseTimer::
+get_report(const std::string & pre) const
+{
+  if (!is_enabled) {
+    return "";
+  }
+  double total = 0.;
+  for (int ii = 0; ii < seconds.size(); ++ii){
+    total += seconds[ii];
+  }
+  std::ostringstream os;
+  os << pre << std::left << std::setw(24) << "phase" << std::right
+     << std::setw(12) << "calls"
+     << std::setw(14) << "total (s)"
+     << std::setw(14) << "avg (ms)"
+     << std::setw(10) << "%" << std::endl;
+  for (int ii = 0; ii < phases.size(); ++ii){
+    os << pre << std::left << std::setw(24) << phases[ii] << std::right
+       << std::setw(12) << counts[ii]
+       << std::setw(14) << std::fixed << std::setprecision(4) << seconds[ii]
+       << std::setw(14) << std::fixed << std::setprecision(4) << seconds[ii] * 1e3 / counts[ii]
+       << std::setw(10) << std::fixed << std::setprecision(1) << (total > 0 ? seconds[ii] / total * 100. : 0.)
+       << std::endl;
+  }
+  return os.str();
+}
+
+deepmd::ScopedTimer::
+ScopedTimer(PhaseTimer * timer_, const char * phase_)
+    : timer(NULL), phase(phase_)
+{
+  if (timer_ != NULL && timer_->enabled()) {
+    timer = timer_;
+    start = std::chrono::steady_clock::now();
+  }
+}
+
+void
+deepmd::ScopedTimer::
+stop()
+{
+  if (timer != NULL) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    timer->add(phase, elapsed.count());
+    timer = NULL;
+  }
+}
+
 void
 deepmd::
 load_op_library()
@@ -336,6 +809,24 @@ name_prefix(const std::string & scope)
   return prefix;
 }
 
+// the tensor named name in input_tensors, if it has the same type and shape,
+// so that its buffer is reused. otherwise a new tensor.
+static Tensor
+reuse_input_tensor (
+    const std::vector<std::pair<std::string, Tensor>> & input_tensors,
+    const std::string & name,
+    const tensorflow::DataType & dtype,
+    const TensorShape & shape)
+{
+  for (unsigned ii = 0; ii < input_tensors.size(); ++ii){
+    const Tensor & tensor = input_tensors[ii].second;
+    if (input_tensors[ii].first == name && tensor.dtype() == dtype && tensor.shape().IsSameSize(shape)){
+      return tensor;
+    }
+  }
+  return Tensor(dtype, shape);
+}
+
 template <typename MODELTYPE, typename VALUETYPE>
 int
 deepmd::
@@ -348,22 +839,24 @@ session_input_tensors (
     const double &			cell_size,
     const std::vector<VALUETYPE> &	fparam_,
     const std::vector<VALUETYPE> &	aparam_,
-    const deepmd::AtomMap&	atommap,
+    const deepmd::PermutationPlan&	plan,
     const std::string				scope)
 {
-  bool b_pbc = (dbox.size() == 9);
-
-  int nframes = 1;
-  int nall = dcoord_.size() / 3;
-  int nloc = nall;
-  assert (nall == datype_.size());
-
-  std::vector<int > datype = atommap.get_type();
+  int nall_in = datype_.size();
+  assert (nall_in == plan.get_nall());
+  // coordinates of several frames may be provided in a single call
+  int nframes = nall_in > 0 ? (dcoord_.size() / (nall_in * 3)) : 1;
+  assert (nframes * nall_in * 3 == dcoord_.size());
+  bool b_pbc = (dbox.size() == nframes * 9);
+  int nall = plan.get_nall_real();
+  int nloc = plan.get_nloc_real();
+
+  const std::vector<int > & datype = plan.get_type();
   std::vector<int > type_count (ntypes, 0);
-  for (unsigned ii = 0; ii < datype.size(); ++ii){
+  for (int ii = 0; ii < nloc; ++ii){
     type_count[datype[ii]] ++;
   }
-  datype.insert (datype.end(), datype_.begin() + nloc, datype_.end());
+  int daparam_atom = nall_in > 0 ? aparam_.size() / (nframes * nall_in) : 0;
 
   TensorShape coord_shape ;
   coord_shape.AddDim (nframes);
@@ -385,10 +878,10 @@ session_input_tensors (
   natoms_shape.AddDim (2 + ntypes);
   TensorShape fparam_shape ;
   fparam_shape.AddDim (nframes);
-  fparam_shape.AddDim (fparam_.size());
+  fparam_shape.AddDim (fparam_.size() / nframes);
   TensorShape aparam_shape ;
   aparam_shape.AddDim (nframes);
-  aparam_shape.AddDim (aparam_.size());
+  aparam_shape.AddDim (nloc * daparam_atom);
   
   tensorflow::DataType model_type;
   if(std::is_same<MODELTYPE, double>::value){
@@ -400,14 +893,18 @@ session_input_tensors (
   else{
     throw deepmd::deepmd_exception("unsupported data type");
   }
-  Tensor coord_tensor	(model_type, coord_shape);
-  Tensor box_tensor	(model_type, box_shape);
-  Tensor fparam_tensor  (model_type, fparam_shape);
-  Tensor aparam_tensor  (model_type, aparam_shape);
+  std::string prefix = "";
+  if (scope != ""){
+    prefix = scope + "/";
+  }
+  Tensor coord_tensor	= reuse_input_tensor(input_tensors, prefix+"t_coord", model_type, coord_shape);
+  Tensor box_tensor	= reuse_input_tensor(input_tensors, prefix+"t_box", model_type, box_shape);
+  Tensor fparam_tensor  = reuse_input_tensor(input_tensors, prefix+"t_fparam", model_type, fparam_shape);
+  Tensor aparam_tensor  = reuse_input_tensor(input_tensors, prefix+"t_aparam", model_type, aparam_shape);
 
-  Tensor type_tensor	(DT_INT32, type_shape);
-  Tensor mesh_tensor	(DT_INT32, mesh_shape);
-  Tensor natoms_tensor	(DT_INT32, natoms_shape);
+  Tensor type_tensor	= reuse_input_tensor(input_tensors, prefix+"t_type", DT_INT32, type_shape);
+  Tensor mesh_tensor	= reuse_input_tensor(input_tensors, prefix+"t_mesh", DT_INT32, mesh_shape);
+  Tensor natoms_tensor	= reuse_input_tensor(input_tensors, prefix+"t_natoms", DT_INT32, natoms_shape);
 
   auto coord = coord_tensor.matrix<MODELTYPE> ();
   auto type = type_tensor.matrix<int> ();
@@ -417,16 +914,13 @@ session_input_tensors (
   auto fparam = fparam_tensor.matrix<MODELTYPE> ();
   auto aparam = aparam_tensor.matrix<MODELTYPE> ();
 
-  std::vector<VALUETYPE> dcoord (dcoord_);
-  atommap.forward<VALUETYPE> (dcoord.begin(), dcoord_.begin(), 3);
+  int dfparam = fparam_.size() / nframes;
   
   for (int ii = 0; ii < nframes; ++ii){
-    for (int jj = 0; jj < nall * 3; ++jj){
-      coord(ii, jj) = dcoord[jj];
-    }
+    plan.forward(coord.data() + ii * nall * 3, dcoord_.data() + ii * nall_in * 3, 3);
     if(b_pbc){
       for (int jj = 0; jj < 9; ++jj){
-	box(ii, jj) = dbox[jj];
+	box(ii, jj) = dbox[ii * 9 + jj];
       }
     }
     else{
@@ -437,11 +931,11 @@ session_input_tensors (
     for (int jj = 0; jj < nall; ++jj){
       type(ii, jj) = datype[jj];
     }
-    for (int jj = 0; jj < fparam_.size(); ++jj){
-      fparam(ii, jj) = fparam_[jj];
+    for (int jj = 0; jj < dfparam; ++jj){
+      fparam(ii, jj) = fparam_[ii * dfparam + jj];
     }
-    for (int jj = 0; jj < aparam_.size(); ++jj){
-      aparam(ii, jj) = aparam_[jj];
+    if (daparam_atom > 0) {
+      plan.forward(aparam.data() + ii * nloc * daparam_atom, aparam_.data() + ii * nall_in * daparam_atom, daparam_atom);
     }
   }
   if (b_pbc){
@@ -456,10 +950,6 @@ session_input_tensors (
   natoms (1) = nall;
   for (int ii = 0; ii < ntypes; ++ii) natoms(ii+2) = type_count[ii];
 
-  std::string prefix = "";
-  if (scope != ""){
-    prefix = scope + "/";
-  }
   input_tensors = {
     {prefix+"t_coord",	coord_tensor}, 
     {prefix+"t_type",	type_tensor},
@@ -488,24 +978,26 @@ session_input_tensors (
     InputNlist &				dlist, 
     const std::vector<VALUETYPE> &	fparam_,
     const std::vector<VALUETYPE> &	aparam_,
-    const deepmd::AtomMap&	atommap,
-    const int					nghost,
+    const deepmd::PermutationPlan&	plan,
     const int					ago,
     const std::string				scope)
 {
   assert (dbox.size() == 9);
 
   int nframes = 1;
-  int nall = dcoord_.size() / 3;
-  int nloc = nall - nghost;
-  assert (nall == datype_.size());  
-
-  std::vector<int > datype = atommap.get_type();
+  int nall_in = dcoord_.size() / 3;
+  int nloc_in = plan.get_nloc();
+  assert (nall_in == datype_.size());  
+  assert (nall_in == plan.get_nall());
+  int nall = plan.get_nall_real();
+  int nloc = plan.get_nloc_real();
+
+  const std::vector<int > & datype = plan.get_type();
   std::vector<int > type_count (ntypes, 0);
-  for (unsigned ii = 0; ii < datype.size(); ++ii){
+  for (int ii = 0; ii < nloc; ++ii){
     type_count[datype[ii]] ++;
   }
-  datype.insert (datype.end(), datype_.begin() + nloc, datype_.end());
+  int daparam_atom = nloc_in > 0 ? aparam_.size() / nloc_in : 0;
 
   TensorShape coord_shape ;
   coord_shape.AddDim (nframes);
@@ -525,7 +1017,7 @@ session_input_tensors (
   fparam_shape.AddDim (fparam_.size());
   TensorShape aparam_shape ;
   aparam_shape.AddDim (nframes);
-  aparam_shape.AddDim (aparam_.size());
+  aparam_shape.AddDim (nloc * daparam_atom);
   
   tensorflow::DataType model_type;
   if(std::is_same<MODELTYPE, double>::value){
@@ -537,14 +1029,18 @@ session_input_tensors (
   else{
     throw deepmd::deepmd_exception("unsupported data type");
   }
-  Tensor coord_tensor	(model_type, coord_shape);
-  Tensor box_tensor	(model_type, box_shape);
-  Tensor fparam_tensor  (model_type, fparam_shape);
-  Tensor aparam_tensor  (model_type, aparam_shape);
+  std::string prefix = "";
+  if (scope != ""){
+    prefix = scope + "/";
+  }
+  Tensor coord_tensor	= reuse_input_tensor(input_tensors, prefix+"t_coord", model_type, coord_shape);
+  Tensor box_tensor	= reuse_input_tensor(input_tensors, prefix+"t_box", model_type, box_shape);
+  Tensor fparam_tensor  = reuse_input_tensor(input_tensors, prefix+"t_fparam", model_type, fparam_shape);
+  Tensor aparam_tensor  = reuse_input_tensor(input_tensors, prefix+"t_aparam", model_type, aparam_shape);
 
-  Tensor type_tensor	(DT_INT32, type_shape);
-  Tensor mesh_tensor	(DT_INT32, mesh_shape);
-  Tensor natoms_tensor	(DT_INT32, natoms_shape);
+  Tensor type_tensor	= reuse_input_tensor(input_tensors, prefix+"t_type", DT_INT32, type_shape);
+  Tensor mesh_tensor	= reuse_input_tensor(input_tensors, prefix+"t_mesh", DT_INT32, mesh_shape);
+  Tensor natoms_tensor	= reuse_input_tensor(input_tensors, prefix+"t_natoms", DT_INT32, natoms_shape);
 
   auto coord = coord_tensor.matrix<MODELTYPE> ();
   auto type = type_tensor.matrix<int> ();
@@ -554,13 +1050,8 @@ session_input_tensors (
   auto fparam = fparam_tensor.matrix<MODELTYPE> ();
   auto aparam = aparam_tensor.matrix<MODELTYPE> ();
 
-  std::vector<VALUETYPE> dcoord (dcoord_);
-  atommap.forward<VALUETYPE> (dcoord.begin(), dcoord_.begin(), 3);
-  
   for (int ii = 0; ii < nframes; ++ii){
-    for (int jj = 0; jj < nall * 3; ++jj){
-      coord(ii, jj) = dcoord[jj];
-    }
+    plan.forward(coord.data() + ii * nall * 3, dcoord_.data(), 3);
     for (int jj = 0; jj < 9; ++jj){
       box(ii, jj) = dbox[jj];
     }
@@ -570,8 +1061,8 @@ session_input_tensors (
     for (int jj = 0; jj < fparam_.size(); ++jj){
       fparam(ii, jj) = fparam_[jj];
     }
-    for (int jj = 0; jj < aparam_.size(); ++jj){
-      aparam(ii, jj) = aparam_[jj];
+    if (daparam_atom > 0) {
+      plan.forward(aparam.data() + ii * nloc * daparam_atom, aparam_.data(), daparam_atom, nloc);
     }
   }
   
@@ -592,10 +1083,6 @@ session_input_tensors (
   natoms (1) = nall;
   for (int ii = 0; ii < ntypes; ++ii) natoms(ii+2) = type_count[ii];
 
-  std::string prefix = "";
-  if (scope != ""){
-    prefix = scope + "/";
-  }
   input_tensors = {
     {prefix+"t_coord",	coord_tensor}, 
     {prefix+"t_type",	type_tensor},
@@ -674,6 +1161,146 @@ session_get_dtype(tensorflow::Session* session, const std::string name_, const s
   return (int)output_rc.dtype();
 }
 
+bool
+deepmd::
+graph_has_node(const tensorflow::GraphDef & graph_def, const std::string & name)
+{
+  for (int ii = 0; ii < graph_def.node_size(); ii++) {
+    if (graph_def.node(ii).name() == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void
+deepmd::GraphMetadata::
+init(const tensorflow::GraphDef & graph_def)
+{
+  names.clear();
+  consts.clear();
+  sel.clear();
+  bool found_sel = false;
+  for (int ii = 0; ii < graph_def.node_size(); ii++) {
+    const tensorflow::NodeDef & node = graph_def.node(ii);
+    names.insert(node.name());
+    if (node.op() == "Const" && node.name().find("_attr/") != std::string::npos) {
+      auto it = node.attr().find("value");
+      Tensor tensor;
+      if (it == node.attr().end() || !tensor.FromProto(it->second.tensor())) {
+	continue;
+      }
+      ConstValue & value = consts[node.name()];
+      value.dtype = (int)tensor.dtype();
+      const int nn = tensor.NumElements();
+      if (tensor.dtype() == DT_STRING) {
+	auto ot = tensor.flat<STRINGTYPE>();
+	for (int jj = 0; jj < nn; ++jj) {
+	  value.strings.push_back(std::string(ot(jj)));
+	}
+      }
+      else if (tensor.dtype() == DT_DOUBLE) {
+	auto ot = tensor.flat<double>();
+	value.values.assign(ot.data(), ot.data() + nn);
+      }
+      else if (tensor.dtype() == DT_FLOAT) {
+	auto ot = tensor.flat<float>();
+	value.values.assign(ot.data(), ot.data() + nn);
+      }
+      else if (tensor.dtype() == DT_INT32) {
+	auto ot = tensor.flat<int>();
+	value.values.assign(ot.data(), ot.data() + nn);
+      }
+      else {
+	// not an attribute that is read
+	consts.erase(node.name());
+      }
+    }
+    if (!found_sel && (node.name() == "DescrptSeA" || node.name() == "DescrptSeR")) {
+      auto it = node.attr().find("sel_a");
+      if (it == node.attr().end()) {
+	it = node.attr().find("sel");
+      }
+      if (it != node.attr().end()) {
+	const auto & list = it->second.list();
+	for (int jj = 0; jj < list.i_size(); ++jj) {
+	  sel.push_back(list.i(jj));
+	}
+      }
+      found_sel = true;
+    }
+  }
+}
+
+bool
+deepmd::GraphMetadata::
+has_const(const std::string & name, const std::string & scope) const
+{
+  return consts.count(name_prefix(scope) + name) > 0;
+}
+
+const deepmd::GraphMetadata::ConstValue &
+deepmd::GraphMetadata::
+find_const(const std::string & name, const std::string & scope) const
+{
+  auto it = consts.find(name_prefix(scope) + name);
+  if (it == consts.end()) {
+    throw deepmd::tf_exception("the constant " + name_prefix(scope) + name + " is not found in the graph");
+  }
+  return it->second;
+}
+
+template<typename VT>
+static void
+const_to_vector(std::vector<VT> & o_vec, const std::vector<double> & values, const std::vector<std::string> &)
+{
+  o_vec.assign(values.begin(), values.end());
+}
+
+template<>
+void
+const_to_vector<deepmd::STRINGTYPE>(std::vector<deepmd::STRINGTYPE> & o_vec, const std::vector<double> &, const std::vector<std::string> & strings)
+{
+  o_vec.assign(strings.begin(), strings.end());
+}
+
+template<typename VT>
+VT
+deepmd::GraphMetadata::
+get_scalar(const std::string & name, const std::string & scope) const
+{
+  std::vector<VT> o_vec;
+  get_vector<VT>(o_vec, name, scope);
+  if (o_vec.size() == 0) {
+    throw deepmd::tf_exception("the constant " + name_prefix(scope) + name + " is empty");
+  }
+  return o_vec[0];
+}
+
+template<typename VT>
+void
+deepmd::GraphMetadata::
+get_vector(std::vector<VT> & o_vec, const std::string & name, const std::string & scope) const
+{
+  const ConstValue & value = find_const(name, scope);
+  const_to_vector<VT>(o_vec, value.values, value.strings);
+}
+
+int
+deepmd::GraphMetadata::
+get_dtype(const std::string & name, const std::string & scope) const
+{
+  return find_const(name, scope).dtype;
+}
+
+template int deepmd::GraphMetadata::get_scalar<int>(const std::string &, const std::string &) const;
+template float deepmd::GraphMetadata::get_scalar<float>(const std::string &, const std::string &) const;
+template double deepmd::GraphMetadata::get_scalar<double>(const std::string &, const std::string &) const;
+template deepmd::STRINGTYPE deepmd::GraphMetadata::get_scalar<deepmd::STRINGTYPE>(const std::string &, const std::string &) const;
+template void deepmd::GraphMetadata::get_vector<int>(std::vector<int> &, const std::string &, const std::string &) const;
+template void deepmd::GraphMetadata::get_vector<float>(std::vector<float> &, const std::string &, const std::string &) const;
+template void deepmd::GraphMetadata::get_vector<double>(std::vector<double> &, const std::string &, const std::string &) const;
 
 template<typename VT>
 void 
@@ -959,6 +1586,156 @@ read_file_to_string(std::string model, std::string & file_content)
 }
 
 
+deepmd::SharedModelFile::
+SharedModelFile()
+    : buffer(NULL), buffer_size(0), owner(false)
+{
+}
+
+deepmd::SharedModelFile::
+~SharedModelFile()
+{
+  release();
+}
+
+#if defined(_WIN32)
+void
+deepmd::SharedModelFile::
+create(const std::string & model, const std::string & prefix)
+{
+  throw deepmd::deepmd_exception("the shared model file is not supported on Windows");
+}
+
+void
+deepmd::SharedModelFile::
+attach(const std::string & name)
+{
+  throw deepmd::deepmd_exception("the shared model file is not supported on Windows");
+}
+
+void
+deepmd::SharedModelFile::
+release()
+{
+}
+#else
+static std::string
+errno_message(const std::string & what, const std::string & name)
+{
+  return what + " " + name + " failed: " + std::strerror(errno);
+}
+
+// hostname, pid and a nonce, so that the jobs sharing a node do not collide
+static std::string
+unique_segment_name(const std::string & prefix, std::mt19937_64 & gen)
+{
+  char host[65] = {0};
+  gethostname(host, sizeof(host) - 1);
+  std::ostringstream ss;
+  ss << prefix << host << "_" << getpid() << "_" << std::hex << gen();
+  return ss.str();
+}
+
+void
+deepmd::SharedModelFile::
+create(const std::string & model, const std::string & prefix)
+{
+  release();
+  int fd = open(model.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw deepmd::deepmd_exception(errno_message("open", model));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    throw deepmd::deepmd_exception("cannot read the model file " + model);
+  }
+  size_t nbytes = st.st_size;
+  void * src = mmap(NULL, nbytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (src == MAP_FAILED) {
+    throw deepmd::deepmd_exception(errno_message("mmap", model));
+  }
+  // an existing segment belongs to someone else and is never replaced,
+  // another name is drawn instead
+  const int max_trial = 16;
+  std::mt19937_64 gen(std::random_device{}() ^ (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count());
+  std::string name;
+  int shm_fd = -1;
+  for (int ii = 0; ii < max_trial && shm_fd < 0; ++ii) {
+    name = unique_segment_name(prefix, gen);
+    shm_fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (shm_fd < 0 && errno != EEXIST) {
+      break;
+    }
+  }
+  if (shm_fd < 0) {
+    std::string message = errno_message("shm_open", name);
+    munmap(src, nbytes);
+    throw deepmd::deepmd_exception(message);
+  }
+  void * dst = MAP_FAILED;
+  if (ftruncate(shm_fd, nbytes) == 0) {
+    dst = mmap(NULL, nbytes, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+  }
+  std::string message = errno_message("mmap", name);
+  close(shm_fd);
+  if (dst == MAP_FAILED) {
+    munmap(src, nbytes);
+    shm_unlink(name.c_str());
+    throw deepmd::deepmd_exception(message);
+  }
+  memcpy(dst, src, nbytes);
+  munmap(src, nbytes);
+  mprotect(dst, nbytes, PROT_READ);
+  shm_name = name;
+  buffer = (char *)dst;
+  buffer_size = nbytes;
+  owner = true;
+}
+
+void
+deepmd::SharedModelFile::
+attach(const std::string & name)
+{
+  release();
+  int shm_fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (shm_fd < 0) {
+    throw deepmd::deepmd_exception(errno_message("shm_open", name));
+  }
+  struct stat st;
+  void * dst = MAP_FAILED;
+  if (fstat(shm_fd, &st) == 0 && st.st_size > 0) {
+    dst = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, shm_fd, 0);
+  }
+  std::string message = errno_message("mmap", name);
+  close(shm_fd);
+  if (dst == MAP_FAILED) {
+    throw deepmd::deepmd_exception(message);
+  }
+  shm_name = name;
+  buffer = (char *)dst;
+  buffer_size = st.st_size;
+  owner = false;
+}
+
+void
+deepmd::SharedModelFile::
+release()
+{
+  if (buffer != NULL) {
+    munmap(buffer, buffer_size);
+    if (owner) {
+      shm_unlink(shm_name.c_str());
+    }
+  }
+  shm_name.clear();
+  buffer = NULL;
+  buffer_size = 0;
+  owner = false;
+}
+#endif
+
 void
 deepmd::
 convert_pbtxt_to_pb(std::string fn_pb_txt, std::string fn_pb)
@@ -983,7 +1760,7 @@ session_input_tensors<double, double> (std::vector<std::pair<std::string, tensor
 		       const double &		cell_size,
 		       const std::vector<double> &	fparam_,
 		       const std::vector<double> &	aparam_,
-		       const deepmd::AtomMap&atommap,
+		       const deepmd::PermutationPlan&plan,
 		       const std::string		scope);
 template
 int
@@ -996,7 +1773,7 @@ session_input_tensors<float, double> (std::vector<std::pair<std::string, tensorf
 		       const double &		cell_size,
 		       const std::vector<double> &	fparam_,
 		       const std::vector<double> &	aparam_,
-		       const deepmd::AtomMap&atommap,
+		       const deepmd::PermutationPlan&plan,
 		       const std::string		scope);
 
 template
@@ -1010,7 +1787,7 @@ session_input_tensors<double, float> (std::vector<std::pair<std::string, tensorf
 		       const double &		cell_size,
 		       const std::vector<float> &	fparam_,
 		       const std::vector<float> &	aparam_,
-		       const deepmd::AtomMap&atommap,
+		       const deepmd::PermutationPlan&plan,
 		       const std::string		scope);
 template
 int
@@ -1023,7 +1800,7 @@ session_input_tensors<float, float> (std::vector<std::pair<std::string, tensorfl
 		       const double &		cell_size,
 		       const std::vector<float> &	fparam_,
 		       const std::vector<float> &	aparam_,
-		       const deepmd::AtomMap&atommap,
+		       const deepmd::PermutationPlan&plan,
 		       const std::string		scope);
 
 template
@@ -1037,8 +1814,7 @@ session_input_tensors<double, double> (std::vector<std::pair<std::string, tensor
 		       InputNlist &		dlist, 
 		       const std::vector<double> &	fparam_,
 		       const std::vector<double> &	aparam_,
-		       const deepmd::AtomMap&atommap,
-		       const int			nghost,
+		       const deepmd::PermutationPlan&plan,
 		       const int			ago,
 		       const std::string		scope);
 template
@@ -1052,8 +1828,7 @@ session_input_tensors<float, double> (std::vector<std::pair<std::string, tensorf
 		       InputNlist &		dlist, 
 		       const std::vector<double> &	fparam_,
 		       const std::vector<double> &	aparam_,
-		       const deepmd::AtomMap&atommap,
-		       const int			nghost,
+		       const deepmd::PermutationPlan&plan,
 		       const int			ago,
 		       const std::string		scope);
 
@@ -1068,8 +1843,7 @@ session_input_tensors<double, float> (std::vector<std::pair<std::string, tensorf
 		       InputNlist &		dlist, 
 		       const std::vector<float> &	fparam_,
 		       const std::vector<float> &	aparam_,
-		       const deepmd::AtomMap&atommap,
-		       const int			nghost,
+		       const deepmd::PermutationPlan&plan,
 		       const int			ago,
 		       const std::string		scope);
 template
@@ -1083,8 +1857,7 @@ session_input_tensors<float, float> (std::vector<std::pair<std::string, tensorfl
 		       InputNlist &		dlist, 
 		       const std::vector<float> &	fparam_,
 		       const std::vector<float> &	aparam_,
-		       const deepmd::AtomMap&atommap,
-		       const int			nghost,
+		       const deepmd::PermutationPlan&plan,
 		       const int			ago,
 		       const std::string		scope);
 
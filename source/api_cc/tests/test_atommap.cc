@@ -0,0 +1,43 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+#include "AtomMap.h"
+
+class TestAtomMap : public ::testing::Test
+{
+protected:
+  std::vector<int> atype = {1, 0, 2, 1, 0, 1, 2, 0, 0};
+  // the atoms sorted by type, stable in the original index
+  std::vector<int> expected_bkw_map = {1, 4, 7, 8, 0, 3, 5, 2, 6};
+  std::vector<int> expected_type = {0, 0, 0, 0, 1, 1, 1, 2, 2};
+
+  void check(const deepmd::AtomMap & atommap, 
+	     const std::vector<int> & atype_, 
+	     const std::vector<int> & bkw_map, 
+	     const std::vector<int> & type) {
+    EXPECT_EQ(atommap.get_bkw_map(), bkw_map);
+    EXPECT_EQ(atommap.get_type(), type);
+    const std::vector<int> & fwd_map = atommap.get_fwd_map();
+    for (int ii = 0; ii < atype_.size(); ++ii){
+      EXPECT_EQ(bkw_map[fwd_map[ii]], ii);
+    }
+  }
+};
+
+TEST_F(TestAtomMap, sort)
+{
+  deepmd::AtomMap atommap(atype.begin(), atype.end());
+  check(atommap, atype, expected_bkw_map, expected_type);
+  std::vector<double> coord(atype.size() * 3), coord_fwd(atype.size() * 3), coord_bkw(atype.size() * 3);
+  for (int ii = 0; ii < coord.size(); ++ii) coord[ii] = ii;
+  atommap.forward<double>(coord_fwd.begin(), coord.begin(), 3);
+  atommap.backward<double>(coord_bkw.begin(), coord_fwd.begin(), 3);
+  EXPECT_EQ(coord_bkw, coord);
+}
+
+TEST_F(TestAtomMap, negative_type)
+{
+  std::vector<int> atype_neg = {1, -1, 0, -1, 1};
+  deepmd::AtomMap atommap(atype_neg.begin(), atype_neg.end());
+  check(atommap, atype_neg, {1, 3, 2, 0, 4}, {-1, -1, 0, 1, 1});
+}
@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include "common.h"
+
+TEST(TestChromeTrace, convert)
+{
+  tensorflow::StepStats step_stats;
+  tensorflow::DeviceStepStats * dev_stats = step_stats.add_dev_stats();
+  dev_stats->set_device("/job:localhost/replica:0/task:0/device:CPU:0");
+  tensorflow::NodeExecStats * node_stats = dev_stats->add_node_stats();
+  node_stats->set_node_name("o_force");
+  node_stats->set_timeline_label("o_force = ProdForceSeA(net_deriv, em_deriv)");
+  node_stats->set_all_start_micros(1000);
+  node_stats->set_all_end_rel_micros(25);
+  node_stats->set_thread_id(3);
+  node_stats = dev_stats->add_node_stats();
+  node_stats->set_node_name("_SOURCE");
+  node_stats->set_all_start_micros(990);
+  node_stats->set_all_end_rel_micros(1);
+  std::string trace = deepmd::step_stats_to_chrome_trace(step_stats);
+  EXPECT_NE(trace.find("{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, \"args\": {\"name\": \"/job:localhost/replica:0/task:0/device:CPU:0\"}}"), std::string::npos);
+  EXPECT_NE(trace.find("{\"name\": \"ProdForceSeA\", \"cat\": \"Op\", \"ph\": \"X\", \"pid\": 0, \"tid\": 3, \"ts\": 1000, \"dur\": 25, \"args\": {\"name\": \"o_force\", \"op\": \"ProdForceSeA\"}}"), std::string::npos);
+  // the node name is used if there is no label
+  EXPECT_NE(trace.find("{\"name\": \"_SOURCE\""), std::string::npos);
+  EXPECT_EQ(trace.find("{\"traceEvents\": ["), 0);
+  EXPECT_EQ(trace.substr(trace.size() - 4), "\n]}\n");
+}
+
+TEST(TestChromeTrace, escape)
+{
+  tensorflow::StepStats step_stats;
+  tensorflow::DeviceStepStats * dev_stats = step_stats.add_dev_stats();
+  dev_stats->set_device("dev\"\\\n");
+  std::string trace = deepmd::step_stats_to_chrome_trace(step_stats);
+  EXPECT_NE(trace.find("\"dev\\\"\\\\\\u000a\""), std::string::npos);
+}
+
+TEST(TestChromeTrace, tracer)
+{
+  deepmd::StepTracer tracer;
+  EXPECT_FALSE(tracer.requested());
+  tracer.request("test_chrome_trace.json");
+  EXPECT_TRUE(tracer.requested());
+  tracer.write("{}");
+  // the request is consumed
+  EXPECT_FALSE(tracer.requested());
+  std::ifstream ifs("test_chrome_trace.json");
+  std::string content;
+  ifs >> content;
+  EXPECT_EQ(content, "{}");
+  remove("test_chrome_trace.json");
+}
@@ -196,6 +196,93 @@ TYPED_TEST(TestInferDeepPotA, cpu_build_nlist_atomic)
 }
 
 
+TYPED_TEST(TestInferDeepPotA, cpu_build_nlist_nframes)
+{
+  using VALUETYPE = TypeParam;
+  std::vector<VALUETYPE>& coord = this->coord;
+  std::vector<int>& atype = this->atype;
+  std::vector<VALUETYPE>& box = this->box;
+  std::vector<VALUETYPE>& expected_f = this->expected_f;
+  int& natoms = this->natoms;
+  double& expected_tot_e = this->expected_tot_e;
+  std::vector<VALUETYPE>&expected_tot_v = this->expected_tot_v;
+  deepmd::DeepPot& dp = this->dp;
+  int nframes = 2;
+  // the second frame is the first one shifted by a lattice vector
+  std::vector<VALUETYPE> coord_nf(coord), box_nf(box);
+  for(int ii = 0; ii < natoms; ++ii){
+    coord_nf.push_back(coord[ii*3+0] + box[0]);
+    coord_nf.push_back(coord[ii*3+1]);
+    coord_nf.push_back(coord[ii*3+2]);
+  }
+  box_nf.insert(box_nf.end(), box.begin(), box.end());
+  std::vector<double> ener;
+  std::vector<VALUETYPE> force, virial;
+  dp.compute(ener, force, virial, coord_nf, atype, box_nf);
+
+  EXPECT_EQ(ener.size(), nframes);
+  EXPECT_EQ(force.size(), nframes*natoms*3);
+  EXPECT_EQ(virial.size(), nframes*9);
+
+  for(int kk = 0; kk < nframes; ++kk){
+    EXPECT_LT(fabs(ener[kk] - expected_tot_e), EPSILON);
+    for(int ii = 0; ii < natoms*3; ++ii){
+      EXPECT_LT(fabs(force[kk*natoms*3+ii] - expected_f[ii]), EPSILON);
+    }
+    for(int ii = 0; ii < 3*3; ++ii){
+      EXPECT_LT(fabs(virial[kk*9+ii] - expected_tot_v[ii]), EPSILON);
+    }
+  }
+}
+
+
+TYPED_TEST(TestInferDeepPotA, cpu_build_nlist_nframes_atomic)
+{
+  using VALUETYPE = TypeParam;
+  std::vector<VALUETYPE>& coord = this->coord;
+  std::vector<int>& atype = this->atype;
+  std::vector<VALUETYPE>& box = this->box;
+  std::vector<VALUETYPE>& expected_e = this->expected_e;
+  std::vector<VALUETYPE>& expected_f = this->expected_f;
+  std::vector<VALUETYPE>& expected_v = this->expected_v;
+  int& natoms = this->natoms;
+  double& expected_tot_e = this->expected_tot_e;
+  std::vector<VALUETYPE>&expected_tot_v = this->expected_tot_v;
+  deepmd::DeepPot& dp = this->dp;
+  int nframes = 3;
+  std::vector<VALUETYPE> coord_nf, box_nf;
+  for(int kk = 0; kk < nframes; ++kk){
+    coord_nf.insert(coord_nf.end(), coord.begin(), coord.end());
+    box_nf.insert(box_nf.end(), box.begin(), box.end());
+  }
+  std::vector<double> ener;
+  std::vector<VALUETYPE> force, virial, atom_ener, atom_vir;
+  dp.compute(ener, force, virial, atom_ener, atom_vir, coord_nf, atype, box_nf);
+
+  EXPECT_EQ(ener.size(), nframes);
+  EXPECT_EQ(force.size(), nframes*natoms*3);
+  EXPECT_EQ(virial.size(), nframes*9);
+  EXPECT_EQ(atom_ener.size(), nframes*natoms);
+  EXPECT_EQ(atom_vir.size(), nframes*natoms*9);
+
+  for(int kk = 0; kk < nframes; ++kk){
+    EXPECT_LT(fabs(ener[kk] - expected_tot_e), EPSILON);
+    for(int ii = 0; ii < natoms*3; ++ii){
+      EXPECT_LT(fabs(force[kk*natoms*3+ii] - expected_f[ii]), EPSILON);
+    }
+    for(int ii = 0; ii < 3*3; ++ii){
+      EXPECT_LT(fabs(virial[kk*9+ii] - expected_tot_v[ii]), EPSILON);
+    }
+    for(int ii = 0; ii < natoms; ++ii){
+      EXPECT_LT(fabs(atom_ener[kk*natoms+ii] - expected_e[ii]), EPSILON);
+    }
+    for(int ii = 0; ii < natoms*9; ++ii){
+      EXPECT_LT(fabs(atom_vir[kk*natoms*9+ii] - expected_v[ii]), EPSILON);
+    }
+  }
+}
+
+
 TYPED_TEST(TestInferDeepPotA, cpu_lmp_nlist)
 {
   using VALUETYPE = TypeParam;
@@ -527,6 +614,52 @@ TYPED_TEST(TestInferDeepPotA, cpu_lmp_nlist_type_sel_atomic)
   }
 }
 
+TYPED_TEST(TestInferDeepPotA, cpu_lmp_nlist_warmup)
+{
+  using VALUETYPE = TypeParam;
+  std::vector<VALUETYPE>& coord = this->coord;
+  std::vector<int>& atype = this->atype;
+  std::vector<VALUETYPE>& box = this->box;
+  std::vector<VALUETYPE>& expected_f = this->expected_f;
+  int& natoms = this->natoms;
+  double& expected_tot_e = this->expected_tot_e;
+  std::vector<VALUETYPE>&expected_tot_v = this->expected_tot_v;
+  deepmd::DeepPot& dp = this->dp;
+  // the results are not changed by the synthetic frames
+  dp.warmup(100);
+  dp.warmup(100, 200);
+  float rc = dp.cutoff();
+  int nloc = coord.size() / 3;  
+  std::vector<VALUETYPE> coord_cpy;
+  std::vector<int> atype_cpy, mapping;  
+  std::vector<std::vector<int > > nlist_data;
+  _build_nlist<VALUETYPE>(nlist_data, coord_cpy, atype_cpy, mapping,
+	       coord, atype, box, rc);
+  int nall = coord_cpy.size() / 3;
+  std::vector<int> ilist(nloc), numneigh(nloc);
+  std::vector<int*> firstneigh(nloc);
+  deepmd::InputNlist inlist(nloc, &ilist[0], &numneigh[0], &firstneigh[0]);
+  convert_nlist(inlist, nlist_data);  
+  
+  // the list is rebuilt after warmup even if ago > 0
+  double ener;
+  std::vector<VALUETYPE> force_, virial;
+  dp.compute(ener, force_, virial, coord_cpy, atype_cpy, box, nall-nloc, inlist, 1);
+  std::vector<VALUETYPE> force;
+  _fold_back<VALUETYPE>(force, force_, mapping, nloc, nall, 3);
+
+  EXPECT_EQ(force.size(), natoms*3);
+  EXPECT_EQ(virial.size(), 9);
+
+  EXPECT_LT(fabs(ener - expected_tot_e), EPSILON);
+  for(int ii = 0; ii < natoms*3; ++ii){
+    EXPECT_LT(fabs(force[ii] - expected_f[ii]), EPSILON);    
+  }
+  for(int ii = 0; ii < 3*3; ++ii){
+    EXPECT_LT(fabs(virial[ii] - expected_tot_v[ii]), EPSILON);
+  }
+}
+
 TYPED_TEST(TestInferDeepPotA, print_summary)
 {
   deepmd::DeepPot& dp = this->dp;
@@ -472,3 +472,99 @@ TYPED_TEST(TestInferDeepPotModeDeviPython, cpu_lmp_list_std)
   EXPECT_LT(fabs(mymin(std_v) - expected_md_v[1]), EPSILON);
   EXPECT_LT(fabs(mystd(std_v) - expected_md_v[2]), EPSILON);
 }
+
+TYPED_TEST(TestInferDeepPotModeDeviPython, cpu_lmp_list_std_fused)
+{
+  using VALUETYPE = TypeParam;
+  std::vector<VALUETYPE>& coord = this->coord;
+  std::vector<int>& atype = this->atype;
+  std::vector<VALUETYPE>& box = this->box;
+  deepmd::DeepPotModelDevi& dp_md = this->dp_md;
+  std::vector<VALUETYPE>& expected_md_f = this->expected_md_f;
+  float rc = dp_md.cutoff();
+  int nloc = coord.size() / 3;  
+  std::vector<VALUETYPE> coord_cpy;
+  std::vector<int> atype_cpy, mapping;  
+  std::vector<std::vector<int > > nlist_data;
+  _build_nlist<VALUETYPE>(nlist_data, coord_cpy, atype_cpy, mapping,
+	       coord, atype, box, rc);
+  int nall = coord_cpy.size() / 3;
+  std::vector<int> ilist(nloc), numneigh(nloc);
+  std::vector<int*> firstneigh(nloc);
+  deepmd::InputNlist inlist(nloc, &ilist[0], &numneigh[0], &firstneigh[0]);
+  convert_nlist(inlist, nlist_data);  
+
+  std::vector<double > emd;
+  std::vector<std::vector<VALUETYPE> > fmd, vmd;
+  dp_md.compute(emd, fmd, vmd, coord_cpy, atype_cpy, box, nall-nloc, inlist, 0);
+  std::vector<VALUETYPE > avg_f, avg_v, std_f;
+  dp_md.compute_avg(avg_f, fmd);
+  dp_md.compute_avg(avg_v, vmd);
+  dp_md.compute_std_f(std_f, avg_f, fmd);
+
+  double ener;
+  std::vector<VALUETYPE> force, virial, std_f_fused;
+  VALUETYPE max_devi_f, min_devi_f, avg_devi_f;
+  dp_md.compute(ener, force, virial, std_f_fused, max_devi_f, min_devi_f, avg_devi_f, coord_cpy, atype_cpy, box, nall-nloc, inlist, 1);
+
+  EXPECT_LT(fabs(ener - 0.5 * (emd[0] + emd[1])), EPSILON);
+  EXPECT_EQ(force.size(), avg_f.size());
+  for(int ii = 0; ii < force.size(); ++ii){
+    EXPECT_LT(fabs(force[ii] - avg_f[ii]), EPSILON);
+  }
+  EXPECT_EQ(virial.size(), 9);
+  for(int ii = 0; ii < 9; ++ii){
+    EXPECT_LT(fabs(virial[ii] - avg_v[ii]), EPSILON);
+  }
+  EXPECT_EQ(std_f_fused.size(), nloc);
+  for(int ii = 0; ii < nloc; ++ii){
+    EXPECT_LT(fabs(std_f_fused[ii] - std_f[ii]), EPSILON);
+  }
+  EXPECT_LT(fabs(max_devi_f - expected_md_f[0]), EPSILON);
+  EXPECT_LT(fabs(min_devi_f - expected_md_f[1]), EPSILON);
+  EXPECT_LT(fabs(avg_devi_f - expected_md_f[2]), EPSILON);
+}
+
+TYPED_TEST(TestInferDeepPotModeDeviPython, cpu_lmp_list_std_fused_reproducible)
+{
+  using VALUETYPE = TypeParam;
+  std::vector<VALUETYPE>& coord = this->coord;
+  std::vector<int>& atype = this->atype;
+  std::vector<VALUETYPE>& box = this->box;
+  // with three models the order of the sums matters
+  setenv("DP_MODEL_DEVI_CONCURRENCY", "3", 1);
+  deepmd::DeepPotModelDevi dp_md;
+  dp_md.init(std::vector<std::string>({"deeppot.pb", "deeppot-1.pb", "deeppot.pb"}));
+  unsetenv("DP_MODEL_DEVI_CONCURRENCY");
+  float rc = dp_md.cutoff();
+  int nloc = coord.size() / 3;  
+  std::vector<VALUETYPE> coord_cpy;
+  std::vector<int> atype_cpy, mapping;  
+  std::vector<std::vector<int > > nlist_data;
+  _build_nlist<VALUETYPE>(nlist_data, coord_cpy, atype_cpy, mapping,
+	       coord, atype, box, rc);
+  int nall = coord_cpy.size() / 3;
+  std::vector<int> ilist(nloc), numneigh(nloc);
+  std::vector<int*> firstneigh(nloc);
+  deepmd::InputNlist inlist(nloc, &ilist[0], &numneigh[0], &firstneigh[0]);
+  convert_nlist(inlist, nlist_data);  
+
+  double ener0;
+  std::vector<VALUETYPE> force0, virial0, std_f0;
+  VALUETYPE max_devi_f0, min_devi_f0, avg_devi_f0;
+  dp_md.compute(ener0, force0, virial0, std_f0, max_devi_f0, min_devi_f0, avg_devi_f0, coord_cpy, atype_cpy, box, nall-nloc, inlist, 0);
+  // the results are the same bit by bit, whichever model finishes first
+  for (int step = 0; step < 10; ++step) {
+    double ener;
+    std::vector<VALUETYPE> force, virial, std_f;
+    VALUETYPE max_devi_f, min_devi_f, avg_devi_f;
+    dp_md.compute(ener, force, virial, std_f, max_devi_f, min_devi_f, avg_devi_f, coord_cpy, atype_cpy, box, nall-nloc, inlist, 1);
+    EXPECT_EQ(ener, ener0);
+    EXPECT_EQ(force, force0);
+    EXPECT_EQ(virial, virial0);
+    EXPECT_EQ(std_f, std_f0);
+    EXPECT_EQ(max_devi_f, max_devi_f0);
+    EXPECT_EQ(min_devi_f, min_devi_f0);
+    EXPECT_EQ(avg_devi_f, avg_devi_f0);
+  }
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "common.h"
+
+class TestNeighborListData : public ::testing::Test
+{
+protected:
+  std::vector<int> ilist = {0, 1, 2, 3};
+  std::vector<std::vector<int>> jlist = {
+    {1, 2, 4},
+    {0, 3},
+    {},
+    {5, 0, 1, 2},
+  };
+  std::vector<int> numneigh;
+  std::vector<int*> firstneigh;
+  deepmd::InputNlist inlist;
+  void SetUp() override {
+    numneigh.resize(ilist.size());
+    firstneigh.resize(ilist.size());
+    inlist = deepmd::InputNlist(ilist.size(), &ilist[0], &numneigh[0], &firstneigh[0]);
+    deepmd::convert_nlist(inlist, jlist);
+  };
+  void check(const deepmd::InputNlist & nlist,
+	     const std::vector<int> & expected_ilist,
+	     const std::vector<std::vector<int>> & expected_jlist) {
+    EXPECT_EQ(nlist.inum, expected_ilist.size());
+    for (int ii = 0; ii < nlist.inum; ++ii){
+      EXPECT_EQ(nlist.ilist[ii], expected_ilist[ii]);
+      std::vector<int> jj_list(nlist.firstneigh[ii], nlist.firstneigh[ii] + nlist.numneigh[ii]);
+      EXPECT_EQ(jj_list, expected_jlist[ii]);
+    }
+  }
+};
+
+TEST_F(TestNeighborListData, copy)
+{
+  deepmd::NeighborListData nlist_data;
+  nlist_data.copy_from_nlist(inlist);
+  EXPECT_EQ(nlist_data.jrange, std::vector<int>({0, 3, 5, 5, 9}));
+  deepmd::InputNlist nlist;
+  nlist_data.make_inlist(nlist);
+  check(nlist, ilist, jlist);
+  // the neighbors are not copied
+  EXPECT_EQ(nlist.firstneigh[1], nlist_data.jlist.data() + 3);
+}
+
+TEST_F(TestNeighborListData, shuffle)
+{
+  deepmd::NeighborListData nlist_data;
+  nlist_data.copy_from_nlist(inlist);
+  // the atoms beyond the map are kept
+  nlist_data.shuffle(std::vector<int>({3, 2, 1, 0}));
+  deepmd::InputNlist nlist;
+  nlist_data.make_inlist(nlist);
+  check(nlist, {3, 2, 1, 0}, {{2, 1, 4}, {3, 0}, {}, {5, 3, 2, 1}});
+}
+
+TEST_F(TestNeighborListData, shuffle_exclude_empty)
+{
+  deepmd::NeighborListData nlist_data;
+  nlist_data.copy_from_nlist(inlist);
+  std::vector<int> fwd_map = {1, -1, 0, 2, 3, -1};
+  nlist_data.shuffle_exclude_empty(fwd_map);
+  deepmd::InputNlist nlist;
+  nlist_data.make_inlist(nlist);
+  check(nlist, {1, 0, 2}, {{0, 3}, {}, {1, 0}});
+  // the buffers are reused by the next update
+  nlist_data.copy_from_nlist(inlist);
+  nlist_data.shuffle_exclude_empty(fwd_map);
+  nlist_data.make_inlist(nlist);
+  check(nlist, {1, 0, 2}, {{0, 3}, {}, {1, 0}});
+}
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "common.h"
+
+class TestPermutationPlan : public ::testing::Test
+{
+protected:
+  int ntypes = 2;
+  int nghost = 3;
+  // the last 3 atoms are ghosts, -1 and 2 are virtual atoms
+  std::vector<int> atype = {1, 0, -1, 1, 2, 0, 0, -1, 1};
+  // the real local atoms sorted by type, followed by the real ghosts
+  std::vector<int> expected_bkw_map = {1, 5, 0, 3, 6, 8};
+  std::vector<int> expected_fwd_map = {2, 0, -1, 3, -1, 1, 4, -1, 5};
+  std::vector<int> expected_type = {0, 0, 1, 1, 0, 1};
+  std::vector<double> coord;
+  void SetUp() override {
+    coord.resize(atype.size() * 3);
+    for (int ii = 0; ii < coord.size(); ++ii){
+      coord[ii] = 0.1 * ii;
+    }
+  };
+};
+
+TEST_F(TestPermutationPlan, build)
+{
+  deepmd::PermutationPlan plan;
+  EXPECT_TRUE(plan.build(atype, nghost, ntypes));
+  EXPECT_EQ(plan.get_bkw_map(), expected_bkw_map);
+  EXPECT_EQ(plan.get_fwd_map(), expected_fwd_map);
+  EXPECT_EQ(plan.get_type(), expected_type);
+  EXPECT_EQ(plan.get_nall(), 9);
+  EXPECT_EQ(plan.get_nloc(), 6);
+  EXPECT_EQ(plan.get_nall_real(), 6);
+  EXPECT_EQ(plan.get_nloc_real(), 4);
+  // kept while the types are unchanged
+  EXPECT_FALSE(plan.build(atype, nghost, ntypes));
+  std::vector<int> atype_1 = atype;
+  atype_1[1] = 1;
+  EXPECT_TRUE(plan.build(atype_1, nghost, ntypes));
+  EXPECT_EQ(plan.get_bkw_map(), std::vector<int>({5, 0, 1, 3, 6, 8}));
+  EXPECT_TRUE(plan.build(atype, nghost, ntypes));
+  EXPECT_EQ(plan.get_bkw_map(), expected_bkw_map);
+}
+
+TEST_F(TestPermutationPlan, spatial_sort)
+{
+  // the atoms are placed in the reverse order along a line
+  std::vector<double> coord_rev(coord.size());
+  for (int ii = 0; ii < coord.size(); ++ii){
+    coord_rev[ii] = - coord[ii];
+  }
+  deepmd::PermutationPlan plan;
+  EXPECT_FALSE(plan.get_spatial_sort());
+  // kept as the type sort if the spatial sort is disabled
+  EXPECT_TRUE(plan.build(atype, coord_rev, nghost, ntypes));
+  EXPECT_EQ(plan.get_bkw_map(), expected_bkw_map);
+  EXPECT_FALSE(plan.build(atype, coord_rev, nghost, ntypes));
+  plan.set_spatial_sort(true);
+  // each type of the local atoms and the ghost atoms are reversed
+  std::vector<int> expected_bkw_map_rev = {5, 1, 3, 0, 8, 6};
+  EXPECT_TRUE(plan.build(atype, coord_rev, nghost, ntypes));
+  EXPECT_EQ(plan.get_bkw_map(), expected_bkw_map_rev);
+  EXPECT_EQ(plan.get_type(), std::vector<int>({0, 0, 1, 1, 1, 0}));
+  EXPECT_EQ(plan.get_nloc_real(), 4);
+  for (int ii = 0; ii < plan.get_nall_real(); ++ii){
+    EXPECT_EQ(plan.get_fwd_map()[expected_bkw_map_rev[ii]], ii);
+  }
+  // rebuilt at each call as the atoms move
+  EXPECT_TRUE(plan.build(atype, coord, nghost, ntypes));
+  EXPECT_EQ(plan.get_bkw_map(), expected_bkw_map);
+  EXPECT_EQ(plan.get_fwd_map(), expected_fwd_map);
+}
+
+TEST_F(TestPermutationPlan, compose)
+{
+  // the plan is the real atom selection followed by the type sort
+  std::vector<int> real_fwd_map, real_bkw_map;
+  int nghost_real;
+  deepmd::select_real_atoms(real_fwd_map, real_bkw_map, nghost_real, coord, atype, nghost, ntypes);
+  std::vector<int> atype_real(real_bkw_map.size());
+  deepmd::select_map<int>(atype_real, atype, real_fwd_map, 1);
+  int nloc_real = real_bkw_map.size() - nghost_real;
+  deepmd::AtomMap atommap(atype_real.begin(), atype_real.begin() + nloc_real);
+
+  deepmd::PermutationPlan plan;
+  plan.build(atype, nghost, ntypes);
+  EXPECT_EQ(plan.get_nloc_real(), nloc_real);
+  EXPECT_EQ(plan.get_nall_real(), real_bkw_map.size());
+  const std::vector<int> & sort_bkw_map = atommap.get_bkw_map();
+  for (int ii = 0; ii < plan.get_nall_real(); ++ii){
+    int sort_ii = ii < nloc_real ? sort_bkw_map[ii] : ii;
+    EXPECT_EQ(plan.get_bkw_map()[ii], real_bkw_map[sort_ii]);
+  }
+}
+
+TEST_F(TestPermutationPlan, forward_backward)
+{
+  deepmd::PermutationPlan plan;
+  plan.build(atype, nghost, ntypes);
+  std::vector<float> coord_model(plan.get_nall_real() * 3);
+  plan.forward(coord_model.data(), coord.data(), 3);
+  for (int ii = 0; ii < plan.get_nall_real(); ++ii){
+    for (int dd = 0; dd < 3; ++dd){
+      EXPECT_FLOAT_EQ(coord_model[ii * 3 + dd], coord[expected_bkw_map[ii] * 3 + dd]);
+    }
+  }
+  // the excluded atoms are zero
+  std::vector<double> coord_back(coord.size(), 1.);
+  plan.backward(coord_back.data(), coord_model.data(), 3);
+  for (int ii = 0; ii < atype.size(); ++ii){
+    for (int dd = 0; dd < 3; ++dd){
+      if (expected_fwd_map[ii] >= 0) {
+	EXPECT_FLOAT_EQ(coord_back[ii * 3 + dd], coord[ii * 3 + dd]);
+      }
+      else {
+	EXPECT_EQ(coord_back[ii * 3 + dd], 0.);
+      }
+    }
+  }
+}
+
+TEST_F(TestPermutationPlan, local)
+{
+  // atomic data only of the local atoms
+  deepmd::PermutationPlan plan;
+  plan.build(atype, nghost, ntypes);
+  int nloc = plan.get_nloc();
+  int nloc_real = plan.get_nloc_real();
+  std::vector<double> aparam(coord.begin(), coord.begin() + nloc * 2);
+  std::vector<double> aparam_model(nloc_real * 2);
+  plan.forward(aparam_model.data(), aparam.data(), 2, nloc_real);
+  for (int ii = 0; ii < nloc_real; ++ii){
+    for (int dd = 0; dd < 2; ++dd){
+      EXPECT_EQ(aparam_model[ii * 2 + dd], aparam[expected_bkw_map[ii] * 2 + dd]);
+    }
+  }
+  std::vector<double> ae_model = {1., 2., 3., 4.};
+  std::vector<double> ae(atype.size(), -1.);
+  plan.backward(ae.data(), ae_model.data(), 1, nloc_real);
+  std::vector<double> expected_ae = {3., 1., 0., 4., 0., 2., 0., 0., 0.};
+  EXPECT_EQ(ae, expected_ae);
+}
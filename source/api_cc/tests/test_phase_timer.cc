@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string>
+#include "common.h"
+
+TEST(TestPhaseTimer, disabled)
+{
+  unsetenv("DP_TIMING");
+  deepmd::PhaseTimer timer;
+  EXPECT_FALSE(timer.enabled());
+  {
+    deepmd::ScopedTimer scoped(&timer, "session_run");
+  }
+  EXPECT_EQ(timer.get_report(), "");
+  // a NULL timer is ignored
+  deepmd::ScopedTimer scoped(NULL, "session_run");
+}
+
+TEST(TestPhaseTimer, enabled)
+{
+  setenv("DP_TIMING", "1", 1);
+  deepmd::PhaseTimer timer;
+  unsetenv("DP_TIMING");
+  EXPECT_TRUE(timer.enabled());
+  timer.add("build_plan", 1.0);
+  timer.add("session_run", 2.0);
+  timer.add("build_plan", 1.0);
+  {
+    deepmd::ScopedTimer scoped(&timer, "output");
+    // stopped only once
+    scoped.stop();
+  }
+  std::string report = timer.get_report("# ");
+  // the phases are in the order they are first timed
+  size_t pos_plan = report.find("# build_plan");
+  size_t pos_run = report.find("# session_run");
+  size_t pos_output = report.find("# output");
+  EXPECT_NE(pos_plan, std::string::npos);
+  EXPECT_LT(pos_plan, pos_run);
+  EXPECT_LT(pos_run, pos_output);
+  EXPECT_NE(report.find("2.0000"), std::string::npos);
+  EXPECT_NE(report.find("1000.0000"), std::string::npos);
+  timer.clear();
+  EXPECT_EQ(timer.get_report().find("build_plan"), std::string::npos);
+}
+
+TEST(TestPhaseTimer, zero)
+{
+  setenv("DP_TIMING", "0", 1);
+  deepmd::PhaseTimer timer;
+  unsetenv("DP_TIMING");
+  EXPECT_FALSE(timer.enabled());
+}
@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include "common.h"
+
+class TestSharedModelFile : public ::testing::Test
+{
+protected:
+  std::string file_name = "shared_model_file.pb";
+  std::string shm_name;
+  std::string content;
+  void SetUp() override {
+    shm_name = "/deepmd_test_" + std::to_string(getpid());
+    for (int ii = 0; ii < 10000; ++ii){
+      content.push_back(char(ii % 256));
+    }
+    std::ofstream ofs(file_name, std::ios::binary);
+    ofs.write(content.data(), content.size());
+  };
+  void TearDown() override {
+    remove(file_name.c_str());
+  };
+};
+
+TEST_F(TestSharedModelFile, create_attach)
+{
+  deepmd::SharedModelFile creator, attached;
+  creator.create(file_name, shm_name);
+  EXPECT_EQ(std::string(creator.data(), creator.size()), content);
+  attached.attach(shm_name);
+  EXPECT_EQ(std::string(attached.data(), attached.size()), content);
+  // the same physical pages are mapped twice
+  EXPECT_NE(attached.data(), creator.data());
+  // the attached mapping outlives the segment
+  creator.release();
+  EXPECT_EQ(creator.size(), 0);
+  EXPECT_EQ(std::string(attached.data(), attached.size()), content);
+  deepmd::SharedModelFile late;
+  EXPECT_THROW(late.attach(shm_name), deepmd::deepmd_exception);
+}
+
+TEST_F(TestSharedModelFile, missing_file)
+{
+  deepmd::SharedModelFile creator;
+  EXPECT_THROW(creator.create("not_a_model.pb", shm_name), deepmd::deepmd_exception);
+  EXPECT_EQ(creator.data(), (const char *)NULL);
+}
@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "common.h"
+
+TEST(TestWarmupFrame, frame)
+{
+  int nloc = 200, nghost = 300, ntypes = 2;
+  double rcut = 3.0;
+  std::vector<int> sel = {20, 40};
+  std::vector<double> coord, box;
+  std::vector<int> atype;
+  deepmd::NeighborListData nlist_data;
+  deepmd::make_warmup_frame(coord, atype, box, nlist_data, nloc, nghost, ntypes, rcut, sel);
+  EXPECT_EQ(coord.size(), (nloc + nghost) * 3);
+  EXPECT_EQ(atype.size(), nloc + nghost);
+  double length = box[0];
+  EXPECT_EQ(box[4], length);
+  EXPECT_EQ(box[8], length);
+  // the local atoms are in the box, the ghost atoms are in the shell
+  for (int ii = 0; ii < nloc + nghost; ++ii){
+    bool inside = true;
+    for (int dd = 0; dd < 3; ++dd){
+      double xx = coord[ii * 3 + dd];
+      EXPECT_GE(xx, -rcut);
+      EXPECT_LT(xx, length + rcut);
+      inside = inside && xx >= 0 && xx < length;
+    }
+    EXPECT_EQ(inside, ii < nloc);
+    EXPECT_EQ(atype[ii], ii % ntypes);
+  }
+  // the neighbor list is complete
+  deepmd::InputNlist nlist;
+  nlist_data.make_inlist(nlist);
+  EXPECT_EQ(nlist.inum, nloc);
+  int nnei = 0;
+  for (int ii = 0; ii < nloc; ++ii){
+    std::vector<int> expected;
+    for (int jj = 0; jj < nloc + nghost; ++jj){
+      double r2 = 0;
+      for (int dd = 0; dd < 3; ++dd){
+	double dx = coord[ii * 3 + dd] - coord[jj * 3 + dd];
+	r2 += dx * dx;
+      }
+      if (jj != ii && r2 < rcut * rcut) expected.push_back(jj);
+    }
+    std::vector<int> jlist(nlist.firstneigh[ii], nlist.firstneigh[ii] + nlist.numneigh[ii]);
+    std::sort(jlist.begin(), jlist.end());
+    EXPECT_EQ(jlist, expected);
+    nnei += jlist.size();
+  }
+  // about sum(sel) neighbors in the bulk
+  EXPECT_GT(nnei, nloc * 10);
+}
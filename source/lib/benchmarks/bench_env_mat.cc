@@ -0,0 +1,26 @@
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "prod_env_mat.h"
+#include "bench_system.h"
+
+static void
+BM_prod_env_mat_a_cpu(benchmark::State& state, const BenchBoxType type)
+{
+  BenchSystem sys(type, state.range(0));
+  BenchThreads threads(state.range(1));
+  const int nnei = sys.sec.back();
+  std::vector<double> em((size_t)sys.nloc * nnei * 4), em_deriv((size_t)sys.nloc * nnei * 4 * 3);
+  std::vector<double> rij((size_t)sys.nloc * nnei * 3);
+  std::vector<int> nlist((size_t)sys.nloc * nnei);
+  std::vector<double> avg(sys.ntypes * nnei * 4, 0.), std(sys.ntypes * nnei * 4, 1.);
+  for (auto _ : state) {
+    deepmd::prod_env_mat_a_cpu(
+	&em[0], &em_deriv[0], &rij[0], &nlist[0],
+	&sys.posi_cpy[0], &sys.atype_cpy[0], sys.inlist, sys.max_nbor_size,
+	&avg[0], &std[0], sys.nloc, sys.nall, sys.rc, sys.rc_smth, sys.sec);
+    benchmark::DoNotOptimize(em.data());
+  }
+  set_atom_steps(state, sys.nloc);
+}
+BENCHMARK_CAPTURE(BM_prod_env_mat_a_cpu, water, kWater)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_prod_env_mat_a_cpu, metal, kMetal)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
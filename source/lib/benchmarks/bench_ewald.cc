@@ -0,0 +1,27 @@
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "ewald.h"
+#include "bench_system.h"
+
+// the reciprocal part of the Ewald sum of the water box with the SPC/E charges
+static void
+BM_ewald_recp(benchmark::State& state)
+{
+  BenchSystem sys(kWater, state.range(0));
+  BenchThreads threads(state.range(1));
+  std::vector<double> charge(sys.nloc);
+  for (int ii = 0; ii < sys.nloc; ++ii) {
+    charge[ii] = sys.atype[ii] == 0 ? -0.8476 : 0.4238;
+  }
+  deepmd::EwaldParameters<double> eparam;
+  double ener;
+  std::vector<double> force, virial;
+  for (auto _ : state) {
+    deepmd::ewald_recp(ener, force, virial, sys.posi, charge, sys.region, eparam);
+    benchmark::DoNotOptimize(ener);
+  }
+  set_atom_steps(state, sys.nloc);
+}
+// the number of the reciprocal vectors grows with the volume at a fixed spacing,
+// so the cost is quadratic in the number of atoms
+BENCHMARK(BM_ewald_recp)->Apply(bench_args<12288>)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,82 @@
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "coord.h"
+#include "neighbor_list.h"
+#include "bench_system.h"
+
+struct NlistBuffer
+{
+  int mem_size = 256;
+  std::vector<int> ilist, numneigh;
+  std::vector<int> jlist;
+  std::vector<int*> firstneigh;
+  deepmd::InputNlist nlist;
+  NlistBuffer(const int nloc) 
+      : ilist(nloc), numneigh(nloc), jlist((size_t)nloc * mem_size), firstneigh(nloc) {
+    for (int ii = 0; ii < nloc; ++ii) {
+      firstneigh[ii] = &jlist[(size_t)ii * mem_size];
+    }
+    nlist = deepmd::InputNlist(nloc, &ilist[0], &numneigh[0], &firstneigh[0]);
+  }
+};
+
+static void
+BM_build_nlist_cpu(benchmark::State& state, const BenchBoxType type)
+{
+  BenchSystem sys(type, state.range(0));
+  BenchThreads threads(state.range(1));
+  NlistBuffer buff(sys.nloc);
+  int max_list_size;
+  for (auto _ : state) {
+    int ret = deepmd::build_nlist_cpu(
+	buff.nlist, &max_list_size, &sys.posi_cpy[0], 
+	sys.nloc, sys.nall, buff.mem_size, sys.rc);
+    benchmark::DoNotOptimize(ret);
+  }
+  set_atom_steps(state, sys.nloc);
+}
+// the all-pairs search is quadratic, larger systems take hours
+BENCHMARK_CAPTURE(BM_build_nlist_cpu, water, kWater)->Apply(bench_args<12288>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_build_nlist_cpu, metal, kMetal)->Apply(bench_args<12288>)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void
+BM_build_nlist_cell_cpu(benchmark::State& state, const BenchBoxType type)
+{
+  BenchSystem sys(type, state.range(0));
+  BenchThreads threads(state.range(1));
+  NlistBuffer buff(sys.nloc);
+  int max_list_size;
+  for (auto _ : state) {
+    int ret = deepmd::build_nlist_cell_cpu(
+	buff.nlist, &max_list_size, &sys.posi_cpy[0], 
+	sys.nloc, sys.nall, buff.mem_size, sys.rc, sys.region);
+    benchmark::DoNotOptimize(ret);
+  }
+  set_atom_steps(state, sys.nloc);
+}
+BENCHMARK_CAPTURE(BM_build_nlist_cell_cpu, water, kWater)->Apply(bench_args<kMaxAtoms>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_build_nlist_cell_cpu, metal, kMetal)->Apply(bench_args<kMaxAtoms>)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void
+BM_copy_coord_cpu(benchmark::State& state, const BenchBoxType type)
+{
+  BenchSystem sys(type, state.range(0), false);
+  BenchThreads threads(state.range(1));
+  const int mem_cpy = sys.posi_cpy.size() / 3;
+  std::vector<double> posi_cpy(mem_cpy * 3);
+  std::vector<int> atype_cpy(mem_cpy), mapping(mem_cpy);
+  int nall;
+  for (auto _ : state) {
+    int ret = deepmd::copy_coord_cpu(
+	&posi_cpy[0], &atype_cpy[0], &mapping[0], &nall,
+	&sys.posi[0], &sys.atype[0], sys.nloc, mem_cpy, sys.rc, sys.region);
+    benchmark::DoNotOptimize(ret);
+  }
+  set_atom_steps(state, sys.nloc);
+}
+BENCHMARK_CAPTURE(BM_copy_coord_cpu, water, kWater)->Apply(bench_args<kMaxAtoms>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_copy_coord_cpu, metal, kMetal)->Apply(bench_args<kMaxAtoms>)->Unit(benchmark::kMillisecond)->UseRealTime();
+// the boxes thinner than rc have several images of each atom in the
+// thin directions
+BENCHMARK_CAPTURE(BM_copy_coord_cpu, metal_rod, kMetalRod)->Apply(bench_args<kMaxAtoms>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_copy_coord_cpu, metal_slab, kMetalSlab)->Apply(bench_args<kMaxAtoms>)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,41 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+#include "pair_tab.h"
+#include "bench_system.h"
+
+// a random table of each pair of types from 0 to 6 A with the stride 0.01 A,
+// evaluated on the formatted neighbor list of a system
+static void
+BM_pair_tab_cpu(benchmark::State& state, const BenchBoxType type)
+{
+  BenchSystem sys(type, state.range(0));
+  BenchThreads threads(state.range(1));
+  BenchEnvMat env(sys);
+  const int nspline = 600;
+  std::vector<double> tab_info = {0., 0.01, (double)nspline, (double)sys.ntypes};
+  std::vector<double> tab_data(sys.ntypes * sys.ntypes * nspline * 4);
+  std::mt19937 gen(20230601);
+  std::uniform_real_distribution<double> dist(-1., 1.);
+  for (auto & xx : tab_data) xx = dist(gen);
+  // the local atoms are sorted by type
+  std::vector<int> natoms(2 + sys.ntypes, 0);
+  natoms[0] = sys.nloc;
+  natoms[1] = sys.nall;
+  for (int ii = 0; ii < sys.nloc; ++ii) {
+    natoms[2 + sys.atype[ii]]++;
+  }
+  std::vector<int> sel_r(sys.ntypes, 0);
+  std::vector<double> scale(sys.nloc, 1.);
+  std::vector<double> energy(sys.nloc), force(sys.nall * 3), virial(sys.nall * 9);
+  for (auto _ : state) {
+    deepmd::pair_tab_cpu(
+	&energy[0], &force[0], &virial[0], &tab_info[0], &tab_data[0],
+	&env.rij[0], &scale[0], &sys.atype_cpy[0], &env.nlist[0], &natoms[0], 
+	sys.sel, sel_r);
+    benchmark::DoNotOptimize(energy.data());
+  }
+  set_atom_steps(state, sys.nloc);
+}
+BENCHMARK_CAPTURE(BM_pair_tab_cpu, water, kWater)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_pair_tab_cpu, metal, kMetal)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,74 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+#include "prod_force.h"
+#include "prod_virial.h"
+#include "bench_system.h"
+
+// the derivatives of the environment matrix of a system, 
+// and random derivatives of the network
+struct ProdForceSystem
+{
+  int nloc, nall, nnei;
+  BenchEnvMat env;
+  std::vector<double> net_deriv, force, virial, atom_virial;
+  ProdForceSystem(const BenchSystem & sys) 
+      : nloc(sys.nloc), nall(sys.nall), env(sys) {
+    nnei = env.nnei;
+    std::mt19937 gen(20230601);
+    std::uniform_real_distribution<double> dist(-1., 1.);
+    net_deriv.resize((size_t)nloc * nnei * 4);
+    for (auto & xx : net_deriv) xx = dist(gen);
+    force.resize(nall * 3);
+    virial.resize(9);
+    atom_virial.resize(nall * 9);
+  }
+};
+
+static void
+BM_prod_force_a_cpu(benchmark::State& state, const BenchBoxType type)
+{
+  ProdForceSystem sys(BenchSystem(type, state.range(0)));
+  BenchThreads threads(state.range(1));
+  for (auto _ : state) {
+    deepmd::prod_force_a_cpu(
+	&sys.force[0], &sys.net_deriv[0], &sys.env.em_deriv[0], &sys.env.nlist[0], 
+	sys.nloc, sys.nall, sys.nnei);
+    benchmark::DoNotOptimize(sys.force.data());
+  }
+  set_atom_steps(state, sys.nloc);
+}
+BENCHMARK_CAPTURE(BM_prod_force_a_cpu, water, kWater)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_prod_force_a_cpu, metal, kMetal)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void
+BM_prod_virial_a_cpu(benchmark::State& state, const BenchBoxType type)
+{
+  ProdForceSystem sys(BenchSystem(type, state.range(0)));
+  BenchThreads threads(state.range(1));
+  for (auto _ : state) {
+    deepmd::prod_virial_a_cpu(
+	&sys.virial[0], &sys.atom_virial[0], &sys.net_deriv[0], &sys.env.em_deriv[0], 
+	&sys.env.rij[0], &sys.env.nlist[0], sys.nloc, sys.nall, sys.nnei);
+    benchmark::DoNotOptimize(sys.virial.data());
+  }
+  set_atom_steps(state, sys.nloc);
+}
+BENCHMARK_CAPTURE(BM_prod_virial_a_cpu, water, kWater)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_prod_virial_a_cpu, metal, kMetal)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void
+BM_prod_virial_a_cpu_no_atomic(benchmark::State& state, const BenchBoxType type)
+{
+  ProdForceSystem sys(BenchSystem(type, state.range(0)));
+  BenchThreads threads(state.range(1));
+  for (auto _ : state) {
+    deepmd::prod_virial_a_cpu(
+	&sys.virial[0], (double *)NULL, &sys.net_deriv[0], &sys.env.em_deriv[0], 
+	&sys.env.rij[0], &sys.env.nlist[0], sys.nloc, sys.nall, sys.nnei);
+    benchmark::DoNotOptimize(sys.virial.data());
+  }
+  set_atom_steps(state, sys.nloc);
+}
+BENCHMARK_CAPTURE(BM_prod_virial_a_cpu_no_atomic, water, kWater)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_prod_virial_a_cpu_no_atomic, metal, kMetal)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,231 @@
+#pragma once
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+#include "coord.h"
+#include "neighbor_list.h"
+#include "prod_env_mat.h"
+
+// the systems of the benchmarks, generated with a fixed seed
+enum BenchBoxType {
+  // water molecules at 1 g/cm^3, types O and H sorted, sel = {46, 92}
+  kWater,
+  // a perturbed fcc lattice of copper, sel = {96}
+  kMetal,
+  // the fcc copper of 2 x 2 cells in cross section, thinner than 2 rc
+  kMetalRod,
+  // the fcc copper of one cell in thickness, thinner than rc
+  kMetalSlab,
+};
+
+// the largest number of atoms of a benchmark, the kernels over
+// the formatted neighbor lists hold nloc x nnei x 12 derivatives
+const int kMaxAtoms = 786432;
+const int kMaxAtomsNeighbor = 98304;
+
+// split n into three factors as close as possible
+inline void
+balanced_factors(int * nn, const int n)
+{
+  nn[0] = std::max(1, (int)std::cbrt(n + 0.5));
+  while (n % nn[0] != 0) nn[0]--;
+  int n12 = n / nn[0];
+  nn[1] = std::max(1, (int)std::sqrt(n12 + 0.5));
+  while (n12 % nn[1] != 0) nn[1]--;
+  nn[2] = n12 / nn[1];
+}
+
+// the atoms of a periodic box, copied with the periodic images within rc,
+// and the neighbor list of the local atoms unless build_nlist is false
+struct BenchSystem
+{
+  double rc = 6., rc_smth = 0.5;
+  int ntypes, nloc, nall, max_nbor_size;
+  std::vector<int> sel, sec;
+  std::vector<double> boxt, posi, posi_cpy;
+  std::vector<int> atype, atype_cpy, mapping;
+  deepmd::Region<double> region;
+  std::vector<int> ilist, numneigh, jlist;
+  std::vector<int*> firstneigh;
+  deepmd::InputNlist inlist;
+  BenchSystem(const BenchBoxType type, const int natoms, const bool build_nlist = true)
+      : nloc(natoms) {
+    std::mt19937 gen(20230601);
+    std::uniform_real_distribution<double> uniform(-1., 1.);
+    std::normal_distribution<double> normal(0., 1.);
+    int nn[3];
+    double cell;
+    posi.resize(nloc * 3);
+    atype.resize(nloc);
+    if (type == kWater) {
+      // O on a perturbed simple cubic lattice, H at 1 A in random directions
+      ntypes = 2;
+      sel = {46, 92};
+      const int nmol = nloc / 3;
+      balanced_factors(nn, nmol);
+      cell = std::cbrt(3. / 0.1);
+      for (int ii = 0; ii < nmol; ++ii) {
+	int idx[3] = {ii % nn[0], ii / nn[0] % nn[1], ii / nn[0] / nn[1]};
+	for (int dd = 0; dd < 3; ++dd) {
+	  posi[ii * 3 + dd] = (idx[dd] + 0.5 + 0.1 * uniform(gen)) * cell;
+	}
+	atype[ii] = 0;
+	for (int kk = 0; kk < 2; ++kk) {
+	  const int hh = nmol + ii * 2 + kk;
+	  double dir[3], norm = 0.;
+	  for (int dd = 0; dd < 3; ++dd) {
+	    dir[dd] = normal(gen);
+	    norm += dir[dd] * dir[dd];
+	  }
+	  norm = std::sqrt(norm);
+	  for (int dd = 0; dd < 3; ++dd) {
+	    posi[hh * 3 + dd] = posi[ii * 3 + dd] + dir[dd] / norm;
+	  }
+	  atype[hh] = 1;
+	}
+      }
+    }
+    else {
+      // 4 atoms in each fcc cell with a = 3.61 A
+      ntypes = 1;
+      sel = {96};
+      const int ncell = nloc / 4;
+      if (type == kMetalRod) {
+	nn[0] = ncell / 4; nn[1] = 2; nn[2] = 2;
+      }
+      else if (type == kMetalSlab) {
+	nn[0] = std::max(1, (int)std::sqrt(ncell + 0.5));
+	while (ncell % nn[0] != 0) nn[0]--;
+	nn[1] = ncell / nn[0]; nn[2] = 1;
+      }
+      else {
+	balanced_factors(nn, ncell);
+      }
+      cell = 3.61;
+      const double basis[4][3] = {{0., 0., 0.}, {0.5, 0.5, 0.}, {0.5, 0., 0.5}, {0., 0.5, 0.5}};
+      for (int ii = 0; ii < nloc / 4; ++ii) {
+	int idx[3] = {ii % nn[0], ii / nn[0] % nn[1], ii / nn[0] / nn[1]};
+	for (int kk = 0; kk < 4; ++kk) {
+	  for (int dd = 0; dd < 3; ++dd) {
+	    posi[(ii * 4 + kk) * 3 + dd] = (idx[dd] + basis[kk][dd]) * cell + 0.05 * uniform(gen);
+	  }
+	  atype[ii * 4 + kk] = 0;
+	}
+      }
+    }
+    boxt = {nn[0] * cell, 0., 0., 0., nn[1] * cell, 0., 0., 0., nn[2] * cell};
+    init_region_cpu(region, &boxt[0]);
+    // the atoms out of the box are wrapped
+    for (int ii = 0; ii < nloc; ++ii) {
+      for (int dd = 0; dd < 3; ++dd) {
+	posi[ii * 3 + dd] -= std::floor(posi[ii * 3 + dd] / boxt[dd * 4]) * boxt[dd * 4];
+      }
+    }
+    sec.resize(sel.size() + 1, 0);
+    for (int ii = 0; ii < int(sel.size()); ++ii) {
+      sec[ii + 1] = sec[ii] + sel[ii];
+    }
+    // copy the periodic images. the exact nall is given if the buffers
+    // are too small, so the copy is redone at most once
+    if (deepmd::copy_coord_cpu(
+	    posi_cpy.data(), atype_cpy.data(), mapping.data(), &nall,
+	    &posi[0], &atype[0], nloc, int(mapping.size()), rc, region) == 1) {
+      posi_cpy.resize(nall * 3);
+      atype_cpy.resize(nall);
+      mapping.resize(nall);
+      deepmd::copy_coord_cpu(
+	  &posi_cpy[0], &atype_cpy[0], &mapping[0], &nall,
+	  &posi[0], &atype[0], nloc, nall, rc, region);
+    }
+    if (!build_nlist) return;
+    // build the neighbor list
+    int mem_size = 2 * sec.back();
+    ilist.resize(nloc);
+    numneigh.resize(nloc);
+    firstneigh.resize(nloc);
+    while (true) {
+      jlist.resize((size_t)nloc * mem_size);
+      for (int ii = 0; ii < nloc; ++ii) {
+	firstneigh[ii] = &jlist[(size_t)ii * mem_size];
+      }
+      inlist = deepmd::InputNlist(nloc, &ilist[0], &numneigh[0], &firstneigh[0]);
+      if (deepmd::build_nlist_cell_cpu(
+	      inlist, &max_nbor_size, &posi_cpy[0],
+	      nloc, nall, mem_size, rc, region) == 0) {
+	break;
+      }
+      mem_size = max_nbor_size;
+    }
+    max_nbor_size = deepmd::max_numneigh(inlist);
+  }
+};
+
+// the environment matrix of a system and its derivatives,
+// the inputs of the kernels over the formatted neighbor lists
+struct BenchEnvMat
+{
+  int nnei;
+  std::vector<double> em, em_deriv, rij;
+  std::vector<int> nlist;
+  BenchEnvMat(const BenchSystem & sys)
+      : nnei(sys.sec.back()) {
+    em.resize((size_t)sys.nloc * nnei * 4);
+    em_deriv.resize((size_t)sys.nloc * nnei * 4 * 3);
+    rij.resize((size_t)sys.nloc * nnei * 3);
+    nlist.resize((size_t)sys.nloc * nnei);
+    std::vector<double> avg(sys.ntypes * nnei * 4, 0.), std(sys.ntypes * nnei * 4, 1.);
+    deepmd::prod_env_mat_a_cpu(
+	&em[0], &em_deriv[0], &rij[0], &nlist[0],
+	&sys.posi_cpy[0], &sys.atype_cpy[0], sys.inlist, sys.max_nbor_size,
+	&avg[0], &std[0], sys.nloc, sys.nall, sys.rc, sys.rc_smth, sys.sec);
+  }
+};
+
+// set the number of OpenMP threads in the scope of a benchmark
+struct BenchThreads
+{
+  int nthreads_old;
+  BenchThreads(const int nthreads) {
+#if defined(_OPENMP)
+    nthreads_old = omp_get_max_threads();
+    omp_set_num_threads(nthreads);
+#endif
+  }
+  ~BenchThreads() {
+#if defined(_OPENMP)
+    omp_set_num_threads(nthreads_old);
+#endif
+  }
+};
+
+// the throughput of a benchmark, one iteration is one step of natoms atoms
+inline void
+set_atom_steps(benchmark::State & state, const int natoms)
+{
+  state.counters["atom_steps/s"] = benchmark::Counter(
+      (double)state.iterations() * natoms, benchmark::Counter::kIsRate);
+}
+
+// the arguments {natoms, threads}, natoms = 192 x 8^n up to MAX_NATOMS,
+// the threads are doubled up to the maximum of OpenMP
+template <int MAX_NATOMS>
+void
+bench_args(benchmark::internal::Benchmark * bench)
+{
+  int max_threads = 1;
+#if defined(_OPENMP)
+  max_threads = omp_get_max_threads();
+#endif
+  bench->ArgNames({"natoms", "threads"});
+  for (int natoms = 192; natoms <= MAX_NATOMS; natoms *= 8) {
+    for (int nthreads = 1; ; nthreads *= 2) {
+      bench->Args({natoms, std::min(nthreads, max_threads)});
+      if (nthreads >= max_threads) break;
+    }
+  }
+}
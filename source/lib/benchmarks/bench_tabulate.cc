@@ -0,0 +1,110 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+#include "tabulate.h"
+#include "bench_system.h"
+
+// a random table of two ranges, lower = 0, upper = 1, max = 2,
+// with the strides 0.01 and 0.1, evaluated on the environment matrix
+// of a system, as in the compressed se_a descriptor.
+struct TabulateSystem
+{
+  int nloc, nnei, last_layer_size = 128, nspline;
+  std::vector<double> table, table_soa, table_info, em_x, em, out;
+  std::vector<double> dy, dy_dem_x, dy_dem, dz_dy;
+  TabulateSystem(const BenchSystem & sys) 
+      : nloc(sys.nloc) {
+    BenchEnvMat env(sys);
+    nnei = env.nnei;
+    table_info = {0., 1., 2., 0.01, 0.1, -1.};
+    nspline = 100 + 10;
+    std::mt19937 gen(20230601);
+    std::uniform_real_distribution<double> dist(0., 1.);
+    table.resize(nspline * last_layer_size * 6);
+    for (auto & xx : table) xx = dist(gen);
+    table_soa.resize(table.size());
+    deepmd::tabulate_fusion_se_a_table_soa_cpu(&table_soa[0], &table[0], nspline, last_layer_size);
+    em.swap(env.em);
+    em_x.resize((size_t)nloc * nnei);
+    for (size_t ii = 0; ii < em_x.size(); ++ii) {
+      em_x[ii] = em[ii * 4];
+    }
+    out.resize((size_t)nloc * 4 * last_layer_size);
+    dy.resize(out.size());
+    for (auto & xx : dy) xx = dist(gen);
+    dy_dem_x.resize(em_x.size());
+    dy_dem.resize(em.size());
+    dz_dy.resize(out.size());
+  }
+};
+
+static void
+BM_tabulate_fusion_se_a_cpu(benchmark::State& state, const BenchBoxType type)
+{
+  TabulateSystem sys(BenchSystem(type, state.range(0)));
+  BenchThreads threads(state.range(1));
+  for (auto _ : state) {
+    deepmd::tabulate_fusion_se_a_cpu(
+	&sys.out[0], &sys.table[0], &sys.table_info[0], &sys.em_x[0], &sys.em[0], 
+	sys.nloc, sys.nnei, sys.last_layer_size);
+    benchmark::DoNotOptimize(sys.out.data());
+  }
+  set_atom_steps(state, sys.nloc);
+}
+BENCHMARK_CAPTURE(BM_tabulate_fusion_se_a_cpu, water, kWater)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_tabulate_fusion_se_a_cpu, metal, kMetal)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void
+BM_tabulate_fusion_se_a_soa_cpu(benchmark::State& state, const BenchBoxType type)
+{
+  TabulateSystem sys(BenchSystem(type, state.range(0)));
+  BenchThreads threads(state.range(1));
+  for (auto _ : state) {
+    deepmd::tabulate_fusion_se_a_soa_cpu(
+	&sys.out[0], &sys.table_soa[0], &sys.table_info[0], &sys.em_x[0], &sys.em[0], 
+	sys.nloc, sys.nnei, sys.last_layer_size);
+    benchmark::DoNotOptimize(sys.out.data());
+  }
+  set_atom_steps(state, sys.nloc);
+}
+BENCHMARK_CAPTURE(BM_tabulate_fusion_se_a_soa_cpu, water, kWater)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_tabulate_fusion_se_a_soa_cpu, metal, kMetal)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void
+BM_tabulate_fusion_se_a_grad_cpu(benchmark::State& state, const BenchBoxType type)
+{
+  TabulateSystem sys(BenchSystem(type, state.range(0)));
+  BenchThreads threads(state.range(1));
+  for (auto _ : state) {
+    deepmd::tabulate_fusion_se_a_grad_cpu(
+	&sys.dy_dem_x[0], &sys.dy_dem[0], &sys.table[0], &sys.table_info[0], 
+	&sys.em_x[0], &sys.em[0], &sys.dy[0],
+	sys.nloc, sys.nnei, sys.last_layer_size);
+    benchmark::DoNotOptimize(sys.dy_dem.data());
+  }
+  set_atom_steps(state, sys.nloc);
+}
+BENCHMARK_CAPTURE(BM_tabulate_fusion_se_a_grad_cpu, water, kWater)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_tabulate_fusion_se_a_grad_cpu, metal, kMetal)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void
+BM_tabulate_fusion_se_a_grad_grad_cpu(benchmark::State& state, const BenchBoxType type)
+{
+  TabulateSystem sys(BenchSystem(type, state.range(0)));
+  BenchThreads threads(state.range(1));
+  // the gradients of the first order are the inputs
+  deepmd::tabulate_fusion_se_a_grad_cpu(
+      &sys.dy_dem_x[0], &sys.dy_dem[0], &sys.table[0], &sys.table_info[0], 
+      &sys.em_x[0], &sys.em[0], &sys.dy[0],
+      sys.nloc, sys.nnei, sys.last_layer_size);
+  for (auto _ : state) {
+    deepmd::tabulate_fusion_se_a_grad_grad_cpu(
+	&sys.dz_dy[0], &sys.table[0], &sys.table_info[0], 
+	&sys.em_x[0], &sys.em[0], &sys.dy_dem_x[0], &sys.dy_dem[0],
+	sys.nloc, sys.nnei, sys.last_layer_size);
+    benchmark::DoNotOptimize(sys.dz_dy.data());
+  }
+  set_atom_steps(state, sys.nloc);
+}
+BENCHMARK_CAPTURE(BM_tabulate_fusion_se_a_grad_grad_cpu, water, kWater)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_tabulate_fusion_se_a_grad_grad_cpu, metal, kMetal)->Apply(bench_args<kMaxAtomsNeighbor>)->Unit(benchmark::kMillisecond)->UseRealTime();
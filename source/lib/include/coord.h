@@ -21,7 +21,10 @@ normalize_coord_cpu(
 // returns
 //	0: succssful
 //	1: the memory is not large enough to hold all copied coords and types.
-//	   i.e. nall > mem_nall
+//	   i.e. nall > mem_nall, nall is still set to the exact number,
+//	   so a second call with the outputs of that size succeeds.
+// the local atoms are copied first in their order, followed by the images
+// in the ghost cells of the box sorted by spatial cells.
 template <typename FPTYPE>
 int
 copy_coord_cpu(
@@ -17,6 +17,25 @@ void env_mat_a_cpu (
     const float &			rmin,
     const float &			rmax) ;
 
+// compute the env mat of atom i_idx without allocation.
+// descrpt_a, descrpt_a_deriv and rij_a should hold
+// sec.back() * 4, sec.back() * 12 and sec.back() * 3 elements.
+// the neighbors of each type are computed in blocks with simd, and the
+// env mat is normalized by avg and std of sec.back() * 4 elements if given.
+template<typename FPTYPE> 
+void env_mat_a_cpu (
+    FPTYPE *				descrpt_a,
+    FPTYPE *				descrpt_a_deriv,
+    FPTYPE *				rij_a,
+    const FPTYPE *			posi,
+    const int &				i_idx,
+    const int *				fmt_nlist,
+    const std::vector<int > &		sec, 
+    const float &			rmin,
+    const float &			rmax,
+    const FPTYPE *			avg = NULL,
+    const FPTYPE *			std = NULL) ;
+
 template<typename FPTYPE> 
 void env_mat_r_cpu (
     std::vector<FPTYPE > &	        descrpt_a,
@@ -97,6 +97,29 @@ int format_nlist_i_fill_a (
     const std::vector<int > &		sec_r);
 
 
+template<typename FPTYPE> 
+struct NeighborInfo 
+{
+  int type;
+  FPTYPE dist;
+  int index;
+  NeighborInfo () 
+      : type (0), dist(0), index(0) 
+      {
+      }
+  NeighborInfo (int tt, FPTYPE dd, int ii) 
+      : type (tt), dist(dd), index(ii) 
+      {
+      }
+  bool operator < (const NeighborInfo & b) const 
+      {
+	return (type < b.type || 
+		(type == b.type && 
+		 (dist < b.dist || 
+		  (dist == b.dist && index < b.index) ) ) );
+      }
+};
+
 template<typename FPTYPE> 
 int format_nlist_i_cpu (
     std::vector<int > &			fmt_nei_idx_a,
@@ -107,5 +130,51 @@ int format_nlist_i_cpu (
     const float &			rcut,
     const std::vector<int > &		sec_a);
 
+// format the neighbor list of atom i_idx without allocation.
+// fmt_nei_idx_a should hold sec_a.back() ints.
+// sel_nei and nei_iter are the scratch reused between the calls.
+// the neighbors are bucketed by type, and only the nearest sel
+// neighbors of each type are sorted.
+template<typename FPTYPE> 
+int format_nlist_i_cpu (
+    int *				fmt_nei_idx_a,
+    std::vector<NeighborInfo<float> > &	sel_nei,
+    std::vector<int > &			nei_iter,
+    const FPTYPE *			posi,
+    const int *				type,
+    const int &				i_idx,
+    const int *				nei_idx_a, 
+    const int &				nnei_i,
+    const float &			rcut,
+    const std::vector<int > &		sec_a);
 
+// select the candidate neighbors of atom i_idx for reformat_nlist_i_cpu,
+// the nearest sel neighbors of each type in nei_idx_a regardless of rcut.
+// cand_nei_idx_a should hold sec_a.back() ints.
+// returns the margin, the largest displacement of the atoms for which
+// the neighbors of atom i_idx within rcut stay among the candidates.
+template<typename FPTYPE> 
+float select_nlist_cand_i_cpu (
+    int *				cand_nei_idx_a,
+    std::vector<NeighborInfo<float> > &	sel_nei,
+    std::vector<int > &			nei_iter,
+    const FPTYPE *			posi,
+    const int *				type,
+    const int &				i_idx,
+    const int *				nei_idx_a, 
+    const int &				nnei_i,
+    const float &			rcut,
+    const std::vector<int > &		sec_a);
 
+// format the neighbor list of atom i_idx from its candidates, the ones
+// within rcut are sorted again by distance. equal to format_nlist_i_cpu
+// as long as no atom has moved by more than the margin of the candidates.
+template<typename FPTYPE> 
+void reformat_nlist_i_cpu (
+    int *				fmt_nei_idx_a,
+    std::vector<NeighborInfo<float> > &	sel_nei,
+    const int *				cand_nei_idx_a,
+    const FPTYPE *			posi,
+    const int &				i_idx,
+    const float &			rcut,
+    const std::vector<int > &		sec_a);
@@ -85,6 +85,66 @@ build_nlist_cpu(
     const int & mem_size,
     const float & rcut);
 
+// build neighbor list with the linked cells.
+// the atoms are binned on a grid aligned with the box vectors of region,
+// the number of cells per box vector is given by compute_cell_info.
+// the grid covers all the nall atoms, which are not required to be in the box.
+// outputs
+//	nlist, max_list_size
+//	max_list_size is the maximal size of jlist.
+// inputs
+//	c_cpy, nloc, nall, mem_size, rcut, region
+//	mem_size is the size of allocated memory for jlist.
+// returns
+//	0: succssful
+//	1: the memory is not large enough to hold all neighbors.
+//	   i.e. max_list_size > mem_nall
+template <typename FPTYPE>
+int
+build_nlist_cell_cpu(
+    InputNlist & nlist,
+    int * max_list_size,
+    const FPTYPE * c_cpy,
+    const int & nloc, 
+    const int & nall, 
+    const int & mem_size,
+    const float & rcut,
+    const deepmd::Region<FPTYPE> & region);
+
+// check if a neighbor list built with the cutoff rcut + skin at the
+// reference coordinates is still valid, i.e. no local atom has moved
+// by more than half of the skin.
+// inputs
+//	coord, ref_coord, nloc, skin
+// returns
+//	true:  the neighbor list is still valid
+//	false: the neighbor list should be rebuilt
+template <typename FPTYPE>
+bool
+nlist_skin_valid_cpu(
+    const FPTYPE * coord,
+    const FPTYPE * ref_coord,
+    const int & nloc,
+    const float & skin);
+
+// filter a neighbor list built with the cutoff rcut + skin down to the
+// neighbors within rcut.
+// outputs
+//	nlist, max_list_size
+//	max_list_size is the maximal size of jlist.
+// inputs
+//	nlist_skin, c_cpy, rcut
+//	nlist.ilist, nlist.numneigh should hold nlist_skin.inum ints,
+//	nlist.firstneigh[ii] should hold nlist_skin.numneigh[ii] ints.
+template <typename FPTYPE>
+void
+filter_nlist_cpu(
+    InputNlist & nlist,
+    int * max_list_size,
+    const InputNlist & nlist_skin,
+    const FPTYPE * c_cpy,
+    const float & rcut);
+
 void use_nei_info_cpu(
     int * nlist, 
     int * ntype,
@@ -24,6 +24,34 @@ void prod_env_mat_a_cpu(
     const std::vector<int> sec,
     const int * f_type = NULL);
 
+// prod_env_mat_a_cpu with the neighbors of each atom chosen among its
+// candidates cached between the calls, see select_nlist_cand_i_cpu.
+// cand and margin hold nloc * sec.back() and nloc elements, the margins
+// refer to the reference coordinates of the cache. max_disp is the largest
+// displacement of the atoms from them, the candidates of an atom are
+// selected again from inlist when it exceeds the margin of the atom.
+// negative margins and zero max_disp select all the candidates and make
+// coord the reference.
+template<typename FPTYPE>
+void prod_env_mat_a_cand_cpu(
+    FPTYPE * em, 
+    FPTYPE * em_deriv, 
+    FPTYPE * rij, 
+    int * nlist, 
+    int * cand, 
+    FPTYPE * margin, 
+    const FPTYPE max_disp, 
+    const FPTYPE * coord, 
+    const int * type, 
+    const InputNlist & inlist,
+    const int max_nbor_size,
+    const FPTYPE * avg, 
+    const FPTYPE * std, 
+    const int nloc, 
+    const float rcut, 
+    const float rcut_smth, 
+    const std::vector<int> sec);
+
 template<typename FPTYPE>
 void prod_env_mat_r_cpu(
     FPTYPE * em, 
@@ -2,6 +2,7 @@
 
 namespace deepmd{
 
+// the atom virial is not computed if atom_virial is NULL
 template<typename FPTYPE>
 void prod_virial_a_cpu(
     FPTYPE * virial, 
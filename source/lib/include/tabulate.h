@@ -13,6 +13,28 @@ void tabulate_fusion_se_a_cpu(
     const int nnei, 
     const int last_layer_size);
 
+// convert the table of tabulate_fusion_se_a_cpu from the layout
+// [nspline][last_layer_size][6] to the layout [nspline][6][last_layer_size]
+template<typename FPTYPE>
+void tabulate_fusion_se_a_table_soa_cpu(
+    FPTYPE * table_soa,
+    const FPTYPE * table, 
+    const int nspline, 
+    const int last_layer_size);
+
+// tabulate_fusion_se_a_cpu with the table converted by
+// tabulate_fusion_se_a_table_soa_cpu, vectorized over last_layer_size
+template<typename FPTYPE>
+void tabulate_fusion_se_a_soa_cpu(
+    FPTYPE * out,
+    const FPTYPE * table_soa, 
+    const FPTYPE * table_info, 
+    const FPTYPE * em_x, 
+    const FPTYPE * em, 
+    const int nloc, 
+    const int nnei, 
+    const int last_layer_size);
+
 template<typename FPTYPE>
 void tabulate_fusion_se_a_grad_cpu(
     FPTYPE * dy_dem_x, 
@@ -1,6 +1,9 @@
 #include "coord.h"
 #include "neighbor_list.h"
 #include "SimulationRegion.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 using namespace deepmd;
@@ -26,6 +29,48 @@ normalize_coord_cpu(
 }
 
 
+// the box is divided into nat_ncell cells no thinner than rcut, the
+// images in the nat_ngcell layers of ghost cells around are copied
+template <typename FPTYPE>
+static void
+ghost_cell_layers(
+    FPTYPE * to_face,
+    int * nat_ncell,
+    int * nat_ngcell,
+    const float & rcut,
+    const Region<FPTYPE> & region)
+{
+  for (int dd = 0; dd < 3; ++dd){
+    const FPTYPE * rec_d = region.rec_boxt + dd * 3;
+    to_face[dd] = (FPTYPE)1. / sqrt(deepmd::dot3(rec_d, rec_d));
+    nat_ncell[dd] = std::max(1, int(to_face[dd] / rcut));
+    nat_ngcell[dd] = int(rcut / (to_face[dd] / nat_ncell[dd])) + 1;
+  }
+}
+
+// the images [stt, end) of an atom at the fractional coordinates ri,
+// the image kk is in the ghost cell cc + kk * nat_ncell.
+// returns the number of images, including the atom itself
+template <typename FPTYPE>
+static inline int
+image_range(
+    int * stt,
+    int * end,
+    const FPTYPE * ri,
+    const int * nat_ncell,
+    const int * nat_ngcell)
+{
+  int nimg = 1;
+  for (int dd = 0; dd < 3; ++dd){
+    const int nc = nat_ncell[dd], ng = nat_ngcell[dd];
+    const int cc = std::min(std::max(int(std::floor(ri[dd] * nc)), 0), nc - 1);
+    stt[dd] = - ((cc + ng) / nc);
+    end[dd] = (2 * nc + ng - 1 - cc) / nc;
+    nimg *= end[dd] - stt[dd];
+  }
+  return nimg;
+}
+
 template <typename FPTYPE>
 int
 deepmd::
@@ -42,28 +87,101 @@ copy_coord_cpu(
     const Region<FPTYPE> & region)
 {
   const int mem_nall = mem_nall_;
-  std::vector<double> coord(nloc * 3);
-  std::vector<int> atype(nloc);
-  std::copy(in_c, in_c+nloc*3, coord.begin());
-  std::copy(in_t, in_t+nloc, atype.begin());
-  SimulationRegion<double> tmpr;
-  double tmp_boxt[9];
-  std::copy(region.boxt, region.boxt+9, tmp_boxt);
-  tmpr.reinitBox(tmp_boxt);
-  
-  std::vector<double > out_coord;
-  std::vector<int> out_atype, out_mapping, ncell, ngcell;
-  copy_coord(out_coord, out_atype, out_mapping, ncell, ngcell, coord, atype, rcut, tmpr);
-  
-  *nall = out_atype.size();
-  if(*nall > mem_nall){
+  FPTYPE to_face[3], ext_frac[3];
+  int nat_ncell[3], nat_ngcell[3];
+  ghost_cell_layers(to_face, nat_ncell, nat_ngcell, rcut, region);
+  for (int dd = 0; dd < 3; ++dd){
+    ext_frac[dd] = FPTYPE(nat_ngcell[dd]) / nat_ncell[dd];
+  }
+  // the cells sorting the ghosts are about rcut / 2 wide, and coarser
+  // when there would be much more cells than atoms
+  int ncell[3];
+  FPTYPE cell_size = 0.5 * rcut;
+  while (true) {
+    long long total_cellnum = 1;
+    for (int dd = 0; dd < 3; ++dd){
+      ncell[dd] = std::max(1, int((1 + 2 * ext_frac[dd]) * to_face[dd] / cell_size));
+      total_cellnum *= ncell[dd];
+    }
+    if (total_cellnum <= 2 * (long long)nloc + 512) break;
+    cell_size *= 2;
+  }
+  const int total_cellnum = ncell[0] * ncell[1] * ncell[2];
+
+  // count the images of each atom
+  std::vector<FPTYPE> inter(nloc * 3);
+  std::vector<int> img_stt(nloc * 3), img_end(nloc * 3);
+  int nghost = 0;
+  for (int ii = 0; ii < nloc; ++ii){
+    FPTYPE * ri = &inter[ii * 3];
+    convert_to_inter_cpu(ri, region, in_c + ii * 3);
+    // the image in the box is the local atom itself
+    nghost += image_range(&img_stt[ii * 3], &img_end[ii * 3], ri, nat_ncell, nat_ngcell) - 1;
+  }
+  *nall = nloc + nghost;
+  if (*nall > mem_nall){
     // size of the output arrays is not large enough
     return 1;
   }
-  else{
-    std::copy(out_coord.begin(), out_coord.end(), out_c);
-    std::copy(out_atype.begin(), out_atype.end(), out_t);
-    std::copy(out_mapping.begin(), out_mapping.end(), mapping);
+
+  // first pass: the sorting cell of each ghost, and the number of
+  // ghosts in each cell. the cell index is separable in the dimensions.
+  std::vector<int> ghost_cell(nghost);
+  std::vector<int> cell_ghost_stt(total_cellnum + 1, 0);
+  std::vector<int> img_cell[3];
+  const int cell_stride[3] = {ncell[1] * ncell[2], ncell[2], 1};
+  int gg = 0;
+  for (int ii = 0; ii < nloc; ++ii){
+    const int * stt = &img_stt[ii * 3], * end = &img_end[ii * 3];
+    for (int dd = 0; dd < 3; ++dd){
+      img_cell[dd].resize(end[dd] - stt[dd]);
+      for (int kk = stt[dd]; kk < end[dd]; ++kk){
+	FPTYPE uu = (inter[ii * 3 + dd] + kk + ext_frac[dd]) / (1 + 2 * ext_frac[dd]);
+	int idx = std::min(std::max(int(uu * ncell[dd]), 0), ncell[dd] - 1);
+	img_cell[dd][kk - stt[dd]] = idx * cell_stride[dd];
+      }
+    }
+    for (int k0 = stt[0]; k0 < end[0]; ++k0){
+      for (int k1 = stt[1]; k1 < end[1]; ++k1){
+	const int c01 = img_cell[0][k0 - stt[0]] + img_cell[1][k1 - stt[1]];
+	for (int k2 = stt[2]; k2 < end[2]; ++k2){
+	  if (k0 == 0 && k1 == 0 && k2 == 0) continue;
+	  const int cid = c01 + img_cell[2][k2 - stt[2]];
+	  ghost_cell[gg++] = cid;
+	  cell_ghost_stt[cid + 1] ++;
+	}
+      }
+    }
+  }
+  for (int cc = 0; cc < total_cellnum; ++cc){
+    cell_ghost_stt[cc + 1] += cell_ghost_stt[cc];
+  }
+
+  // copy local atoms
+  std::copy(in_c, in_c + nloc * 3, out_c);
+  std::copy(in_t, in_t + nloc, out_t);
+  for (int ii = 0; ii < nloc; ++ii) mapping[ii] = ii;
+
+  // second pass: fill the ghosts sorted by cells, in the same order
+  // as the first pass
+  const FPTYPE * boxt = region.boxt;
+  gg = 0;
+  for (int ii = 0; ii < nloc; ++ii){
+    const int * stt = &img_stt[ii * 3], * end = &img_end[ii * 3];
+    for (int k0 = stt[0]; k0 < end[0]; ++k0){
+      for (int k1 = stt[1]; k1 < end[1]; ++k1){
+	for (int k2 = stt[2]; k2 < end[2]; ++k2){
+	  if (k0 == 0 && k1 == 0 && k2 == 0) continue;
+	  const int idx = nloc + cell_ghost_stt[ghost_cell[gg++]] ++;
+	  for (int dd = 0; dd < 3; ++dd){
+	    out_c[idx * 3 + dd] = in_c[ii * 3 + dd] 
+		+ (k0 * boxt[0 * 3 + dd] + k1 * boxt[1 * 3 + dd] + k2 * boxt[2 * 3 + dd]);
+	  }
+	  out_t[idx] = in_t[ii];
+	  mapping[idx] = ii;
+	}
+      }
+    }
   }
   return 0;
 }
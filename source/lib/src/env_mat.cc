@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "env_mat.h"
 #include "switcher.h"
 
@@ -106,65 +107,150 @@ env_mat_a_cpu (
     const float &			rmin,
     const float &			rmax) 
 {  
-    // compute the diff of the neighbors
     rij_a.resize (sec_a.back() * 3);
-    fill (rij_a.begin(), rij_a.end(), (FPTYPE)0.0);
-    for (int ii = 0; ii < int(sec_a.size()) - 1; ++ii) {
-        for (int jj = sec_a[ii]; jj < sec_a[ii + 1]; ++jj) {
-            if (fmt_nlist_a[jj] < 0) break;
-            const int & j_idx = fmt_nlist_a[jj];
-            for (int dd = 0; dd < 3; ++dd) {
-                rij_a[jj * 3 + dd] = posi[j_idx * 3 + dd] - posi[i_idx * 3 + dd];
-            }
-        }
-    }
-    // 1./rr, cos(theta), cos(phi), sin(phi)
     descrpt_a.resize (sec_a.back() * 4);
-    fill (descrpt_a.begin(), descrpt_a.end(), (FPTYPE)0.0);
-    // deriv wrt center: 3
     descrpt_a_deriv.resize (sec_a.back() * 4 * 3);
-    fill (descrpt_a_deriv.begin(), descrpt_a_deriv.end(), (FPTYPE)0.0);
+    env_mat_a_cpu (
+	descrpt_a.data(), descrpt_a_deriv.data(), rij_a.data(), 
+	posi.data(), i_idx, fmt_nlist_a.data(), sec_a, rmin, rmax);
+}
+
+// the number of neighbors staged in the structure-of-arrays buffers
+// of env_mat_a_cpu, a multiple of the simd width
+#define ENV_MAT_A_BLOCK 64
 
+// clone the vectorized kernels for AVX-512 and AVX2 with FMA,
+// the best one supported by the CPU is selected at runtime.
+#if defined(__GNUC__) && (__GNUC__ >= 9) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define ENV_MAT_TARGET_CLONES __attribute__((target_clones("arch=skylake-avx512", "arch=haswell", "default")))
+#else
+#define ENV_MAT_TARGET_CLONES
+#endif
+
+// the env mat of nn <= ENV_MAT_A_BLOCK neighbors from their rij in the
+// structure-of-arrays form, the values before normalization are in
+// value[cc * ENV_MAT_A_BLOCK + kk] and the derivatives in
+// deriv[cc * ENV_MAT_A_BLOCK + kk]
+template<typename FPTYPE> 
+ENV_MAT_TARGET_CLONES
+static void
+env_mat_a_block (
+    FPTYPE * __restrict			value,
+    FPTYPE * __restrict			deriv,
+    const FPTYPE * __restrict		rx,
+    const FPTYPE * __restrict		ry,
+    const FPTYPE * __restrict		rz,
+    const int				nn,
+    const float				rmin,
+    const float				rmax)
+{
+    const int bb = ENV_MAT_A_BLOCK;
+    const FPTYPE drr = rmax - rmin;
+    // with rmin >= rmax the switch is a step at rmin, as in spline5_switch
+    const bool has_switch = drr > (FPTYPE)0.;
+    const FPTYPE du = has_switch ? (FPTYPE)1. / drr : (FPTYPE)0.;
+    #pragma omp simd
+    for (int kk = 0; kk < nn; ++kk) {
+        const FPTYPE xx = rx[kk], yy = ry[kk], zz = rz[kk];
+        FPTYPE nr2 = xx * xx + yy * yy + zz * zz;
+        FPTYPE inr = (FPTYPE)1./sqrt(nr2);
+        FPTYPE nr = nr2 * inr;
+        FPTYPE inr2 = inr * inr;
+        FPTYPE inr4 = inr2 * inr2;
+        FPTYPE inr3 = inr4 * nr;
+        // spline5_switch without branches, the polynomial gives exactly
+        // 1 and 0 and zero derivatives at the ends of the clamped uu
+        FPTYPE uu = has_switch ? (nr - rmin) / drr : (nr < rmin ? (FPTYPE)0. : (FPTYPE)1.);
+        uu = uu < (FPTYPE)0. ? (FPTYPE)0. : (uu > (FPTYPE)1. ? (FPTYPE)1. : uu);
+        FPTYPE sw = uu*uu*uu * ((FPTYPE)-6. * uu*uu + (FPTYPE)15. * uu - (FPTYPE)10.) + (FPTYPE)1.;
+        FPTYPE dsw = ( (FPTYPE)3. * uu*uu * ((FPTYPE)-6. * uu*uu + (FPTYPE)15. * uu - (FPTYPE)10.) + uu*uu*uu * ((FPTYPE)-12. * uu + (FPTYPE)15.) ) * du;
+        // 1./rr, x/r2, y/r2, z/r2
+        FPTYPE v0 = (FPTYPE)1./nr;
+        FPTYPE v1 = xx / nr2;
+        FPTYPE v2 = yy / nr2;
+        FPTYPE v3 = zz / nr2;
+        FPTYPE sx = dsw * xx * inr, sy = dsw * yy * inr, sz = dsw * zz * inr;
+        // deriv of component 1/r
+        deriv[ 0 * bb + kk] = xx * inr3 * sw - v0 * sx;
+        deriv[ 1 * bb + kk] = yy * inr3 * sw - v0 * sy;
+        deriv[ 2 * bb + kk] = zz * inr3 * sw - v0 * sz;
+        // deriv of component x/r2
+        deriv[ 3 * bb + kk] = ((FPTYPE)2. * xx * xx * inr4 - inr2) * sw - v1 * sx;
+        deriv[ 4 * bb + kk] = ((FPTYPE)2. * xx * yy * inr4	) * sw - v1 * sy;
+        deriv[ 5 * bb + kk] = ((FPTYPE)2. * xx * zz * inr4	) * sw - v1 * sz;
+        // deriv of component y/r2
+        deriv[ 6 * bb + kk] = ((FPTYPE)2. * yy * xx * inr4	) * sw - v2 * sx;
+        deriv[ 7 * bb + kk] = ((FPTYPE)2. * yy * yy * inr4 - inr2) * sw - v2 * sy;
+        deriv[ 8 * bb + kk] = ((FPTYPE)2. * yy * zz * inr4	) * sw - v2 * sz;
+        // deriv of component z/r2
+        deriv[ 9 * bb + kk] = ((FPTYPE)2. * zz * xx * inr4	) * sw - v3 * sx;
+        deriv[10 * bb + kk] = ((FPTYPE)2. * zz * yy * inr4	) * sw - v3 * sy;
+        deriv[11 * bb + kk] = ((FPTYPE)2. * zz * zz * inr4 - inr2) * sw - v3 * sz;
+        // 4 value components
+        value[0 * bb + kk] = v0 * sw;
+        value[1 * bb + kk] = v1 * sw;
+        value[2 * bb + kk] = v2 * sw;
+        value[3 * bb + kk] = v3 * sw;
+    }
+}
+
+template<typename FPTYPE> 
+void 
+deepmd::
+env_mat_a_cpu (
+    FPTYPE *				descrpt_a,
+    FPTYPE *				descrpt_a_deriv,
+    FPTYPE *				rij_a,
+    const FPTYPE *			posi,
+    const int &				i_idx,
+    const int *				fmt_nlist_a,
+    const std::vector<int > &		sec_a, 
+    const float &			rmin,
+    const float &			rmax,
+    const FPTYPE *			avg,
+    const FPTYPE *			std) 
+{  
+    const int bb = ENV_MAT_A_BLOCK;
+    FPTYPE rx[bb], ry[bb], rz[bb];
+    FPTYPE value[4 * bb], deriv[12 * bb];
+    const FPTYPE * posi_i = posi + i_idx * 3;
     for (int sec_iter = 0; sec_iter < int(sec_a.size()) - 1; ++sec_iter) {
-        for (int nei_iter = sec_a[sec_iter]; nei_iter < sec_a[sec_iter+1]; ++nei_iter) {      
-            if (fmt_nlist_a[nei_iter] < 0) break;
-            const FPTYPE * rr = &rij_a[nei_iter * 3];
-            FPTYPE nr2 = deepmd::dot3(rr, rr);
-            FPTYPE inr = (FPTYPE)1./sqrt(nr2);
-            FPTYPE nr = nr2 * inr;
-            FPTYPE inr2 = inr * inr;
-            FPTYPE inr4 = inr2 * inr2;
-            FPTYPE inr3 = inr4 * nr;
-            FPTYPE sw, dsw;
-            deepmd::spline5_switch(sw, dsw, nr, rmin, rmax);
-            int idx_deriv = nei_iter * 4 * 3;	// 4 components time 3 directions
-            int idx_value = nei_iter * 4;	// 4 components
-            // 4 value components
-            descrpt_a[idx_value + 0] = (FPTYPE)1./nr;
-            descrpt_a[idx_value + 1] = rr[0] / nr2;
-            descrpt_a[idx_value + 2] = rr[1] / nr2;
-            descrpt_a[idx_value + 3] = rr[2] / nr2;
-            // deriv of component 1/r
-            descrpt_a_deriv[idx_deriv + 0] = rr[0] * inr3 * sw - descrpt_a[idx_value + 0] * dsw * rr[0] * inr;
-            descrpt_a_deriv[idx_deriv + 1] = rr[1] * inr3 * sw - descrpt_a[idx_value + 0] * dsw * rr[1] * inr;
-            descrpt_a_deriv[idx_deriv + 2] = rr[2] * inr3 * sw - descrpt_a[idx_value + 0] * dsw * rr[2] * inr;
-            // deriv of component x/r2
-            descrpt_a_deriv[idx_deriv + 3] = ((FPTYPE)2. * rr[0] * rr[0] * inr4 - inr2) * sw - descrpt_a[idx_value + 1] * dsw * rr[0] * inr;
-            descrpt_a_deriv[idx_deriv + 4] = ((FPTYPE)2. * rr[0] * rr[1] * inr4	) * sw - descrpt_a[idx_value + 1] * dsw * rr[1] * inr;
-            descrpt_a_deriv[idx_deriv + 5] = ((FPTYPE)2. * rr[0] * rr[2] * inr4	) * sw - descrpt_a[idx_value + 1] * dsw * rr[2] * inr;
-            // deriv of component y/r2
-            descrpt_a_deriv[idx_deriv + 6] = ((FPTYPE)2. * rr[1] * rr[0] * inr4	) * sw - descrpt_a[idx_value + 2] * dsw * rr[0] * inr;
-            descrpt_a_deriv[idx_deriv + 7] = ((FPTYPE)2. * rr[1] * rr[1] * inr4 - inr2) * sw - descrpt_a[idx_value + 2] * dsw * rr[1] * inr;
-            descrpt_a_deriv[idx_deriv + 8] = ((FPTYPE)2. * rr[1] * rr[2] * inr4	) * sw - descrpt_a[idx_value + 2] * dsw * rr[2] * inr;
-            // deriv of component z/r2
-            descrpt_a_deriv[idx_deriv + 9] = ((FPTYPE)2. * rr[2] * rr[0] * inr4	) * sw - descrpt_a[idx_value + 3] * dsw * rr[0] * inr;
-            descrpt_a_deriv[idx_deriv +10] = ((FPTYPE)2. * rr[2] * rr[1] * inr4	) * sw - descrpt_a[idx_value + 3] * dsw * rr[1] * inr;
-            descrpt_a_deriv[idx_deriv +11] = ((FPTYPE)2. * rr[2] * rr[2] * inr4 - inr2) * sw - descrpt_a[idx_value + 3] * dsw * rr[2] * inr;
-            // 4 value components
-            descrpt_a[idx_value + 0] *= sw;
-            descrpt_a[idx_value + 1] *= sw;
-            descrpt_a[idx_value + 2] *= sw;
-            descrpt_a[idx_value + 3] *= sw;
+        int nei_end = sec_a[sec_iter];
+        while (nei_end < sec_a[sec_iter+1] && fmt_nlist_a[nei_end] >= 0) {
+            nei_end ++;
+        }
+        for (int nei_start = sec_a[sec_iter]; nei_start < nei_end; nei_start += bb) {
+            const int nn = std::min (bb, nei_end - nei_start);
+            // stage the diff of the neighbors
+            for (int kk = 0; kk < nn; ++kk) {
+                const FPTYPE * posi_j = posi + fmt_nlist_a[nei_start + kk] * 3;
+                FPTYPE * rr = rij_a + (nei_start + kk) * 3;
+                rr[0] = rx[kk] = posi_j[0] - posi_i[0];
+                rr[1] = ry[kk] = posi_j[1] - posi_i[1];
+                rr[2] = rz[kk] = posi_j[2] - posi_i[2];
+            }
+            env_mat_a_block (value, deriv, rx, ry, rz, nn, rmin, rmax);
+            // write the normalized env mat of the neighbors
+            for (int kk = 0; kk < nn; ++kk) {
+                const int idx_value = (nei_start + kk) * 4;
+                for (int cc = 0; cc < 4; ++cc) {
+                    const FPTYPE vv = value[cc * bb + kk];
+                    descrpt_a[idx_value + cc] = avg ? (vv - avg[idx_value + cc]) / std[idx_value + cc] : vv;
+                    for (int dd = 0; dd < 3; ++dd) {
+                        const FPTYPE dv = deriv[(cc * 3 + dd) * bb + kk];
+                        descrpt_a_deriv[(idx_value + cc) * 3 + dd] = avg ? dv / std[idx_value + cc] : dv;
+                    }
+                }
+            }
+        }
+        // the empty slots
+        for (int nei_iter = nei_end; nei_iter < sec_a[sec_iter+1]; ++nei_iter) {
+            std::fill (rij_a + nei_iter * 3, rij_a + nei_iter * 3 + 3, (FPTYPE)0.);
+            std::fill (descrpt_a_deriv + nei_iter * 12, descrpt_a_deriv + nei_iter * 12 + 12, (FPTYPE)0.);
+            for (int cc = 0; cc < 4; ++cc) {
+                const int idx_value = nei_iter * 4 + cc;
+                descrpt_a[idx_value] = avg ? ((FPTYPE)0. - avg[idx_value]) / std[idx_value] : (FPTYPE)0.;
+            }
         }
     }
 }
@@ -333,6 +419,38 @@ env_mat_a_cpu<float> (
     const float &			rmax) ;
 
 
+template
+void 
+deepmd::
+env_mat_a_cpu<double> (
+    double *				descrpt_a,
+    double *				descrpt_a_deriv,
+    double *				rij_a,
+    const double *			posi,
+    const int &				i_idx,
+    const int *				fmt_nlist_a,
+    const std::vector<int > &		sec_a, 
+    const float &			rmin,
+    const float &			rmax,
+    const double *			avg,
+    const double *			std);
+
+template
+void 
+deepmd::
+env_mat_a_cpu<float> (
+    float *				descrpt_a,
+    float *				descrpt_a_deriv,
+    float *				rij_a,
+    const float *			posi,
+    const int &				i_idx,
+    const int *				fmt_nlist_a,
+    const std::vector<int > &		sec_a, 
+    const float &			rmin,
+    const float &			rmax,
+    const float *			avg,
+    const float *			std);
+
 template
 void 
 deepmd::
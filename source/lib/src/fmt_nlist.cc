@@ -1,6 +1,8 @@
 #include <vector>
 #include <cassert>
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include "fmt_nlist.h"
 #include "SimulationRegion.h"
 #include <iostream>
@@ -8,28 +10,51 @@
 
 using namespace deepmd;
 
+// sort the neighbors by type in place with a counting sort,
+// the neighbors of type tt are in [bucket[tt], bucket[tt+1]).
+// bucket[tt+1] holds the number of the neighbors of type tt on input,
+// next is the scratch of size ntypes.
 template<typename FPTYPE> 
-struct NeighborInfo 
+static void
+bucket_by_type (
+    std::vector<NeighborInfo<FPTYPE> > &	sel_nei,
+    int *					bucket,
+    int *					next,
+    const int &					ntypes)
 {
-  int type;
-  FPTYPE dist;
-  int index;
-  NeighborInfo () 
-      : type (0), dist(0), index(0) 
-      {
-      }
-  NeighborInfo (int tt, FPTYPE dd, int ii) 
-      : type (tt), dist(dd), index(ii) 
-      {
+  bucket[0] = 0;
+  for (int tt = 0; tt < ntypes; ++tt) {
+    bucket[tt+1] += bucket[tt];
+    next[tt] = bucket[tt];
+  }
+  for (int tt = 0; tt < ntypes; ++tt) {
+    while (next[tt] < bucket[tt+1]) {
+      const int nei_type = sel_nei[next[tt]].type;
+      if (nei_type == tt) {
+	next[tt] ++;
       }
-  bool operator < (const NeighborInfo & b) const 
-      {
-	return (type < b.type || 
-		(type == b.type && 
-		 (dist < b.dist || 
-		  (dist == b.dist && index < b.index) ) ) );
+      else {
+	std::swap (sel_nei[next[tt]], sel_nei[next[nei_type] ++]);
       }
-};
+    }
+  }
+}
+
+// sort the nearest nkeep neighbors of [begin, end) to the front,
+// the others are left in an unspecified order
+template<typename ITERATOR> 
+static void
+select_nearest (
+    ITERATOR		begin,
+    ITERATOR		end,
+    const int &		nkeep)
+{
+  if (end - begin > nkeep) {
+    std::nth_element (begin, begin + nkeep, end);
+    end = begin + nkeep;
+  }
+  std::sort (begin, end);
+}
 
 int format_nlist_i_fill_a (
     std::vector<int > &			fmt_nei_idx_a,
@@ -63,6 +88,7 @@ int format_nlist_i_fill_a (
   // allocate the information for all neighbors
   std::vector<NeighborInfo<double> > sel_nei ;
   sel_nei.reserve (nei_idx_a.size() + nei_idx_r.size());
+  std::vector<int > bucket (ntypes + 1, 0), next (ntypes);
   for (unsigned kk = 0; kk < nei_idx.size(); ++kk){
     double diff[3];
     const int & j_idx = nei_idx[kk];
@@ -77,27 +103,30 @@ int format_nlist_i_fill_a (
     double rr = sqrt(deepmd::dot3(diff, diff));    
     if (rr <= rcut) {
       sel_nei.push_back(NeighborInfo<double> (type[j_idx], rr, j_idx));
+      bucket[type[j_idx]+1] ++;
     }
   }
-  sort (sel_nei.begin(), sel_nei.end());  
+  bucket_by_type (sel_nei, &bucket[0], &next[0], ntypes);
   
-  std::vector<int > nei_iter = sec_a;
+  // the nearest sel_a neighbors of each type are in fmt_nei_idx_a, 
+  // and the following sel_r ones are in fmt_nei_idx_r
   int overflowed = -1;
-  for (unsigned kk = 0; kk < sel_nei.size(); ++kk){
-    const int & nei_type = sel_nei[kk].type;
-    if (nei_iter[nei_type] >= sec_a[nei_type+1]) {
-      int r_idx_iter = (nei_iter[nei_type] ++) - sec_a[nei_type+1] + sec_r[nei_type];
-      if (r_idx_iter >= sec_r[nei_type+1]) {
-	// return nei_type;
-	overflowed = nei_type;
+  for (int tt = 0; tt < ntypes; ++tt) {
+    const int nsel_a = sec_a[tt+1] - sec_a[tt];
+    const int nsel_r = sec_r[tt+1] - sec_r[tt];
+    const int nnei_t = bucket[tt+1] - bucket[tt];
+    if (nnei_t > nsel_a + nsel_r) {
+      overflowed = tt;
+    }
+    select_nearest (sel_nei.begin() + bucket[tt], sel_nei.begin() + bucket[tt+1], nsel_a + nsel_r);
+    for (int kk = 0; kk < std::min(nnei_t, nsel_a + nsel_r); ++kk) {
+      if (kk < nsel_a) {
+	fmt_nei_idx_a[sec_a[tt] + kk] = sel_nei[bucket[tt] + kk].index;
       }
       else {
-	fmt_nei_idx_r[r_idx_iter] = sel_nei[kk].index;
+	fmt_nei_idx_r[sec_r[tt] + kk - nsel_a] = sel_nei[bucket[tt] + kk].index;
       }
     }
-    else {
-      fmt_nei_idx_a[nei_iter[nei_type] ++] = sel_nei[kk].index;
-    }
   }
   return overflowed;
 }
@@ -114,42 +143,186 @@ int format_nlist_i_cpu (
     const std::vector<int > &   sec_a)
 {
     fmt_nei_idx_a.resize (sec_a.back());
-    fill (fmt_nei_idx_a.begin(), fmt_nei_idx_a.end(), -1);
-  
-    // gether all neighbors
-    std::vector<int > nei_idx (nei_idx_a);
-    // allocate the information for all neighbors
-    std::vector<NeighborInfo<float> > sel_nei;
-    sel_nei.reserve (nei_idx_a.size());
-    float rcut2 = rcut * rcut;
-    for (unsigned kk = 0; kk < nei_idx.size(); ++kk) {
-        // rcut is float in this function, so float rr is enough
-        float diff[3];
-        const int & j_idx = nei_idx[kk];
-        for (int dd = 0; dd < 3; ++dd) {
-            diff[dd] = (float)posi[j_idx * 3 + dd] - (float)posi[i_idx * 3 + dd];
-        }
-        float rr2 = deepmd::dot3(diff, diff);    
+    // scratch of each thread, reused by the following calls
+    static thread_local std::vector<NeighborInfo<float> > sel_nei;
+    static thread_local std::vector<int > nei_iter;
+    return format_nlist_i_cpu (
+	fmt_nei_idx_a.data(), sel_nei, nei_iter, 
+	posi.data(), type.data(), i_idx, 
+	nei_idx_a.data(), nei_idx_a.size(), rcut, sec_a);
+}
+
+// the squared distance between atoms i_idx and j_idx, computed in the
+// same way for formatting and reformatting the neighbor lists
+template<typename FPTYPE> 
+static inline float
+nei_dist2 (
+    const FPTYPE *		posi,
+    const int &			i_idx,
+    const int &			j_idx)
+{
+    // rcut is float in this function, so float rr is enough
+    float diff[3];
+    for (int dd = 0; dd < 3; ++dd) {
+        diff[dd] = (float)posi[j_idx * 3 + dd] - (float)posi[i_idx * 3 + dd];
+    }
+    return deepmd::dot3(diff, diff);
+}
+
+// gather the neighbors within sqrt(rcut2) into sel_nei, bucket them by
+// type and sort the nearest sel of each type to the front of the bucket.
+// the buckets are [nei_iter[tt], nei_iter[tt+1]).
+template<typename FPTYPE> 
+static int
+select_nlist_i (
+    std::vector<NeighborInfo<float> > & sel_nei,
+    std::vector<int > &		nei_iter,
+    const FPTYPE *		posi,
+    const int *			type,
+    const int &			i_idx,
+    const int *			nei_idx_a, 
+    const int &			nnei_i,
+    const float &		rcut2,
+    const std::vector<int > &   sec_a)
+{
+    // gether all neighbors and count them by type
+    const int ntypes = sec_a.size() - 1;
+    nei_iter.assign (2 * ntypes + 1, 0);
+    int * bucket = &nei_iter[0];
+    int * next = &nei_iter[ntypes + 1];
+    sel_nei.clear();
+    for (int kk = 0; kk < nnei_i; ++kk) {
+        const int & j_idx = nei_idx_a[kk];
+        float rr2 = nei_dist2 (posi, i_idx, j_idx);
         if (rr2 <= rcut2) {
             sel_nei.push_back(NeighborInfo<float>(type[j_idx], rr2, j_idx));
+            bucket[type[j_idx]+1] ++;
         }
     }
-    sort(sel_nei.begin(), sel_nei.end());  
+    bucket_by_type (sel_nei, bucket, next, ntypes);
   
-    std::vector<int > nei_iter = sec_a;
+    // only the nearest sel neighbors of each type are sorted
     int overflowed = -1;
-    for (unsigned kk = 0; kk < sel_nei.size(); ++kk) {
-        const int & nei_type = sel_nei[kk].type;
-        if (nei_iter[nei_type] < sec_a[nei_type+1]) {
-            fmt_nei_idx_a[nei_iter[nei_type] ++] = sel_nei[kk].index;
+    for (int tt = 0; tt < ntypes; ++tt) {
+        const int nsel = sec_a[tt+1] - sec_a[tt];
+        if (bucket[tt+1] - bucket[tt] > nsel) {
+            overflowed = tt;
         }
-	else{
-	  overflowed = nei_type;
-	}
+        select_nearest (sel_nei.begin() + bucket[tt], sel_nei.begin() + bucket[tt+1], nsel);
     }
     return overflowed;
 }
 
+template<typename FPTYPE> 
+int format_nlist_i_cpu (
+    int *			fmt_nei_idx_a,
+    std::vector<NeighborInfo<float> > & sel_nei,
+    std::vector<int > &		nei_iter,
+    const FPTYPE *		posi,
+    const int *			type,
+    const int &			i_idx,
+    const int *			nei_idx_a, 
+    const int &			nnei_i,
+    const float &		rcut,
+    const std::vector<int > &   sec_a)
+{
+    std::fill (fmt_nei_idx_a, fmt_nei_idx_a + sec_a.back(), -1);
+    int overflowed = select_nlist_i (
+	sel_nei, nei_iter, posi, type, i_idx, nei_idx_a, nnei_i, rcut * rcut, sec_a);
+    const int * bucket = &nei_iter[0];
+    const int ntypes = sec_a.size() - 1;
+    for (int tt = 0; tt < ntypes; ++tt) {
+        const int nsel = std::min (sec_a[tt+1] - sec_a[tt], bucket[tt+1] - bucket[tt]);
+        for (int kk = 0; kk < nsel; ++kk) {
+            fmt_nei_idx_a[sec_a[tt] + kk] = sel_nei[bucket[tt] + kk].index;
+        }
+    }
+    return overflowed;
+}
+
+template<typename FPTYPE> 
+float select_nlist_cand_i_cpu (
+    int *			cand_nei_idx_a,
+    std::vector<NeighborInfo<float> > & sel_nei,
+    std::vector<int > &		nei_iter,
+    const FPTYPE *		posi,
+    const int *			type,
+    const int &			i_idx,
+    const int *			nei_idx_a, 
+    const int &			nnei_i,
+    const float &		rcut,
+    const std::vector<int > &   sec_a)
+{
+    std::fill (cand_nei_idx_a, cand_nei_idx_a + sec_a.back(), -1);
+    select_nlist_i (
+	sel_nei, nei_iter, posi, type, i_idx, nei_idx_a, nnei_i, 
+	std::numeric_limits<float>::infinity(), sec_a);
+    const int * bucket = &nei_iter[0];
+    // the distances are rounded to float, which shifts them by a few
+    // float epsilons of the coordinates
+    float max_posi = 0;
+    for (int dd = 0; dd < 3; ++dd) {
+        max_posi = std::max (max_posi, std::fabs((float)posi[i_idx * 3 + dd]));
+    }
+    float margin = std::numeric_limits<float>::infinity();
+    const int ntypes = sec_a.size() - 1;
+    for (int tt = 0; tt < ntypes; ++tt) {
+        const int nsel = sec_a[tt+1] - sec_a[tt];
+        const int nnei_t = bucket[tt+1] - bucket[tt];
+        for (int kk = 0; kk < std::min(nnei_t, nsel); ++kk) {
+            cand_nei_idx_a[sec_a[tt] + kk] = sel_nei[bucket[tt] + kk].index;
+        }
+        if (nnei_t <= nsel) {
+            continue;
+        }
+        // the nearest neighbor left out of the candidates should not come
+        // within rcut, or should not get nearer than the farthest candidate.
+        // a distance changes by at most twice the displacement of the atoms.
+        float rr2_out = std::numeric_limits<float>::infinity();
+        for (int kk = bucket[tt] + nsel; kk < bucket[tt+1]; ++kk) {
+            rr2_out = std::min (rr2_out, sel_nei[kk].dist);
+        }
+        const float rr_out = sqrt(rr2_out);
+        float margin_t = 0.5f * (rr_out - rcut);
+        if (nsel > 0) {
+            const float rr_in = sqrt(sel_nei[bucket[tt] + nsel - 1].dist);
+            margin_t = std::max (margin_t, 0.25f * (rr_out - rr_in));
+        }
+        margin_t -= 16.f * std::numeric_limits<float>::epsilon() * (max_posi + rr_out);
+        margin = std::min (margin, margin_t);
+    }
+    return margin;
+}
+
+template<typename FPTYPE> 
+void reformat_nlist_i_cpu (
+    int *			fmt_nei_idx_a,
+    std::vector<NeighborInfo<float> > & sel_nei,
+    const int *			cand_nei_idx_a,
+    const FPTYPE *		posi,
+    const int &			i_idx,
+    const float &		rcut,
+    const std::vector<int > &   sec_a)
+{
+    const float rcut2 = rcut * rcut;
+    const int ntypes = sec_a.size() - 1;
+    for (int tt = 0; tt < ntypes; ++tt) {
+        // the candidates are nearly sorted, they only need a few swaps
+        sel_nei.clear();
+        for (int kk = sec_a[tt]; kk < sec_a[tt+1] && cand_nei_idx_a[kk] >= 0; ++kk) {
+            const int & j_idx = cand_nei_idx_a[kk];
+            float rr2 = nei_dist2 (posi, i_idx, j_idx);
+            if (rr2 <= rcut2) {
+                sel_nei.push_back(NeighborInfo<float>(tt, rr2, j_idx));
+            }
+        }
+        std::sort (sel_nei.begin(), sel_nei.end());
+        for (int kk = 0; kk < sec_a[tt+1] - sec_a[tt]; ++kk) {
+            fmt_nei_idx_a[sec_a[tt] + kk] = kk < int(sel_nei.size()) ? sel_nei[kk].index : -1;
+        }
+    }
+}
+
 template<typename FPTYPE> 
 void 
 deepmd::
@@ -216,6 +389,78 @@ int format_nlist_i_cpu<float> (
     const float &		rcut,
     const std::vector<int > &   sec_a);
 
+template
+int format_nlist_i_cpu<double> (
+    int *			fmt_nei_idx_a,
+    std::vector<NeighborInfo<float> > & sel_nei,
+    std::vector<int > &		nei_iter,
+    const double *		posi,
+    const int *			type,
+    const int &			i_idx,
+    const int *			nei_idx_a, 
+    const int &			nnei_i,
+    const float &		rcut,
+    const std::vector<int > &   sec_a);
+
+template
+int format_nlist_i_cpu<float> (
+    int *			fmt_nei_idx_a,
+    std::vector<NeighborInfo<float> > & sel_nei,
+    std::vector<int > &		nei_iter,
+    const float *		posi,
+    const int *			type,
+    const int &			i_idx,
+    const int *			nei_idx_a, 
+    const int &			nnei_i,
+    const float &		rcut,
+    const std::vector<int > &   sec_a);
+
+template
+float select_nlist_cand_i_cpu<double> (
+    int *			cand_nei_idx_a,
+    std::vector<NeighborInfo<float> > & sel_nei,
+    std::vector<int > &		nei_iter,
+    const double *		posi,
+    const int *			type,
+    const int &			i_idx,
+    const int *			nei_idx_a, 
+    const int &			nnei_i,
+    const float &		rcut,
+    const std::vector<int > &   sec_a);
+
+template
+float select_nlist_cand_i_cpu<float> (
+    int *			cand_nei_idx_a,
+    std::vector<NeighborInfo<float> > & sel_nei,
+    std::vector<int > &		nei_iter,
+    const float *		posi,
+    const int *			type,
+    const int &			i_idx,
+    const int *			nei_idx_a, 
+    const int &			nnei_i,
+    const float &		rcut,
+    const std::vector<int > &   sec_a);
+
+template
+void reformat_nlist_i_cpu<double> (
+    int *			fmt_nei_idx_a,
+    std::vector<NeighborInfo<float> > & sel_nei,
+    const int *			cand_nei_idx_a,
+    const double *		posi,
+    const int &			i_idx,
+    const float &		rcut,
+    const std::vector<int > &   sec_a);
+
+template
+void reformat_nlist_i_cpu<float> (
+    int *			fmt_nei_idx_a,
+    std::vector<NeighborInfo<float> > & sel_nei,
+    const int *			cand_nei_idx_a,
+    const float *		posi,
+    const int &			i_idx,
+    const float &		rcut,
+    const std::vector<int > &   sec_a);
+
 template
 void 
 deepmd::
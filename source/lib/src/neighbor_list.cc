@@ -1,5 +1,7 @@
 #include "neighbor_list.h"
+#include "coord.h"
 #include "device.h"
+#include <cmath>
 #include <iostream>
 #include <limits>
 // #include <iomanip> 
@@ -820,6 +822,180 @@ build_nlist_cpu(
   return 0;
 }
 
+template <typename FPTYPE>
+int
+deepmd::
+build_nlist_cell_cpu(
+    InputNlist & nlist,
+    int * max_list_size,
+    const FPTYPE * c_cpy,
+    const int & nloc, 
+    const int & nall, 
+    const int & mem_size_,
+    const float & rcut,
+    const deepmd::Region<FPTYPE> & region)
+{
+  const int mem_size = mem_size_;
+  *max_list_size = 0;
+  nlist.inum = nloc;
+  if (nall == 0) return 0;
+  int cell_info[23];
+  deepmd::compute_cell_info(cell_info, rcut, region);
+  const int * ncell = cell_info + 3;
+  const int * cell_iter = cell_info + 18;
+  // cell index of each atom along the box vectors
+  std::vector<int> atom_cell(nall * 3);
+  int cell_stt[3], cell_end[3];
+  for (int dd = 0; dd < 3; ++dd){
+    cell_stt[dd] = std::numeric_limits<int>::max();
+    cell_end[dd] = std::numeric_limits<int>::min();
+  }
+  for (int ii = 0; ii < nall; ++ii){
+    FPTYPE ri[3];
+    deepmd::convert_to_inter_cpu(ri, region, c_cpy + ii * 3);
+    for (int dd = 0; dd < 3; ++dd){
+      int idx = int(std::floor(ri[dd] * ncell[dd]));
+      atom_cell[ii * 3 + dd] = idx;
+      if (idx < cell_stt[dd]) cell_stt[dd] = idx;
+      if (idx >= cell_end[dd]) cell_end[dd] = idx + 1;
+    }
+  }
+  int ext_ncell[3];
+  long long total_cellnum = 1;
+  for (int dd = 0; dd < 3; ++dd){
+    ext_ncell[dd] = cell_end[dd] - cell_stt[dd];
+    total_cellnum *= ext_ncell[dd];
+  }
+  // the atoms are too sparse for the cells to pay off
+  if (total_cellnum > 8 * (long long)nall + 512){
+    return build_nlist_cpu(nlist, max_list_size, c_cpy, nloc, nall, mem_size, rcut);
+  }
+  // sort the atoms by cells
+  std::vector<int> atom_cellid(nall);
+  std::vector<int> cell_atom_stt(total_cellnum + 1, 0);
+  for (int ii = 0; ii < nall; ++ii){
+    int cid = 0;
+    for (int dd = 0; dd < 3; ++dd){
+      cid = cid * ext_ncell[dd] + atom_cell[ii * 3 + dd] - cell_stt[dd];
+    }
+    atom_cellid[ii] = cid;
+    cell_atom_stt[cid + 1] ++;
+  }
+  for (long long cc = 0; cc < total_cellnum; ++cc){
+    cell_atom_stt[cc + 1] += cell_atom_stt[cc];
+  }
+  std::vector<int> cell_atoms(nall);
+  {
+    std::vector<int> cell_fill(cell_atom_stt.begin(), cell_atom_stt.end() - 1);
+    for (int ii = 0; ii < nall; ++ii){
+      cell_atoms[cell_fill[atom_cellid[ii]]++] = ii;
+    }
+  }
+  FPTYPE rcut2 = rcut * rcut;
+  int max_size = 0;
+#pragma omp parallel
+  {
+    std::vector<int> jlist;
+    jlist.reserve(mem_size);
+#pragma omp for schedule(dynamic, 64) reduction(max: max_size)
+    for (int ii = 0; ii < nloc; ++ii){
+      nlist.ilist[ii] = ii;
+      jlist.clear();
+      int ci[3], c_stt[3], c_end[3];
+      for (int dd = 0; dd < 3; ++dd){
+	ci[dd] = atom_cell[ii * 3 + dd] - cell_stt[dd];
+	c_stt[dd] = std::max(ci[dd] - cell_iter[dd], 0);
+	c_end[dd] = std::min(ci[dd] + cell_iter[dd] + 1, ext_ncell[dd]);
+      }
+      for (int c0 = c_stt[0]; c0 < c_end[0]; ++c0){
+	for (int c1 = c_stt[1]; c1 < c_end[1]; ++c1){
+	  for (int c2 = c_stt[2]; c2 < c_end[2]; ++c2){
+	    const int cid = (c0 * ext_ncell[1] + c1) * ext_ncell[2] + c2;
+	    for (int kk = cell_atom_stt[cid]; kk < cell_atom_stt[cid + 1]; ++kk){
+	      const int jj = cell_atoms[kk];
+	      if(jj == ii) continue;
+	      FPTYPE diff[3];
+	      for(int dd = 0; dd < 3; ++dd){
+		diff[dd] = c_cpy[ii*3+dd] - c_cpy[jj*3+dd];
+	      }
+	      FPTYPE diff2 = deepmd::dot3(diff, diff);
+	      if(diff2 < rcut2){
+		jlist.push_back(jj);
+	      }
+	    }
+	  }
+	}
+      }
+      // keep the order of the all-pairs search
+      std::sort(jlist.begin(), jlist.end());
+      int list_size = jlist.size();
+      if (list_size > max_size) max_size = list_size;
+      if (list_size <= mem_size){
+	nlist.numneigh[ii] = list_size;
+	std::copy(jlist.begin(), jlist.end(), nlist.firstneigh[ii]);
+      }
+    }
+  }
+  *max_list_size = max_size;
+  return (max_size > mem_size) ? 1 : 0;
+}
+
+template <typename FPTYPE>
+bool
+deepmd::
+nlist_skin_valid_cpu(
+    const FPTYPE * coord,
+    const FPTYPE * ref_coord,
+    const int & nloc,
+    const float & skin)
+{
+  const FPTYPE half_skin = 0.5 * skin;
+  const FPTYPE half_skin2 = half_skin * half_skin;
+  for(int ii = 0; ii < nloc; ++ii){
+    FPTYPE diff[3];
+    for(int dd = 0; dd < 3; ++dd){
+      diff[dd] = coord[ii*3+dd] - ref_coord[ii*3+dd];
+    }
+    if(deepmd::dot3(diff, diff) > half_skin2){
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename FPTYPE>
+void
+deepmd::
+filter_nlist_cpu(
+    InputNlist & nlist,
+    int * max_list_size,
+    const InputNlist & nlist_skin,
+    const FPTYPE * c_cpy,
+    const float & rcut)
+{
+  *max_list_size = 0;
+  nlist.inum = nlist_skin.inum;
+  FPTYPE rcut2 = rcut * rcut;
+  for(int ii = 0; ii < nlist.inum; ++ii){
+    const int i_idx = nlist_skin.ilist[ii];
+    nlist.ilist[ii] = i_idx;
+    int list_size = 0;
+    for(int jj = 0; jj < nlist_skin.numneigh[ii]; ++jj){
+      const int j_idx = nlist_skin.firstneigh[ii][jj];
+      FPTYPE diff[3];
+      for(int dd = 0; dd < 3; ++dd){
+	diff[dd] = c_cpy[i_idx*3+dd] - c_cpy[j_idx*3+dd];
+      }
+      FPTYPE diff2 = deepmd::dot3(diff, diff);
+      if(diff2 < rcut2){
+	nlist.firstneigh[ii][list_size++] = j_idx;
+      }
+    }
+    nlist.numneigh[ii] = list_size;
+    if(list_size > *max_list_size) *max_list_size = list_size;
+  }
+}
+
 void 
 deepmd::
 use_nei_info_cpu(
@@ -893,6 +1069,70 @@ build_nlist_cpu<float>(
     const int & mem_size,
     const float & rcut);
 
+template
+int
+deepmd::
+build_nlist_cell_cpu<double>(
+    InputNlist & nlist,
+    int * max_list_size,
+    const double * c_cpy,
+    const int & nloc, 
+    const int & nall, 
+    const int & mem_size,
+    const float & rcut,
+    const deepmd::Region<double> & region);
+
+template
+int
+deepmd::
+build_nlist_cell_cpu<float>(
+    InputNlist & nlist,
+    int * max_list_size,
+    const float * c_cpy,
+    const int & nloc, 
+    const int & nall, 
+    const int & mem_size,
+    const float & rcut,
+    const deepmd::Region<float> & region);
+
+template
+bool
+deepmd::
+nlist_skin_valid_cpu<double>(
+    const double * coord,
+    const double * ref_coord,
+    const int & nloc,
+    const float & skin);
+
+template
+bool
+deepmd::
+nlist_skin_valid_cpu<float>(
+    const float * coord,
+    const float * ref_coord,
+    const int & nloc,
+    const float & skin);
+
+template
+void
+deepmd::
+filter_nlist_cpu<double>(
+    InputNlist & nlist,
+    int * max_list_size,
+    const InputNlist & nlist_skin,
+    const double * c_cpy,
+    const float & rcut);
+
+template
+void
+deepmd::
+filter_nlist_cpu<float>(
+    InputNlist & nlist,
+    int * max_list_size,
+    const InputNlist & nlist_skin,
+    const float * c_cpy,
+    const float & rcut);
+
 #if GOOGLE_CUDA || TENSORFLOW_USE_ROCM
 void deepmd::convert_nlist_gpu_device(
     InputNlist & gpu_nlist,
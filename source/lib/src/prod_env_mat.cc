@@ -22,7 +22,7 @@ prod_env_mat_a_cpu(
     const FPTYPE * avg, 
     const FPTYPE * std, 
     const int nloc, 
-    const int nall, 
+    const int /*nall*/, 
     const float rcut, 
     const float rcut_smth, 
     const std::vector<int> sec,
@@ -34,63 +34,87 @@ prod_env_mat_a_cpu(
   const int nnei = sec.back();
   const int nem = nnei * 4;
 
-  // set & normalize coord
-  std::vector<FPTYPE> d_coord3(nall * 3);
-  for (int ii = 0; ii < nall; ++ii) {
-    for (int dd = 0; dd < 3; ++dd) {
-      d_coord3[ii * 3 + dd] = coord[ii * 3 + dd];
-    }
+  // the index of each local atom in inlist
+  assert(nloc == inlist.inum);
+  std::vector<int> inlist_idx(nloc, -1);
+  for (int ii = 0; ii < inlist.inum; ++ii) {
+    inlist_idx[inlist.ilist[ii]] = ii;
   }
 
-  // set type
-  std::vector<int> d_f_type(nall);
-  for (int ii = 0; ii < nall; ++ii) {
-    d_f_type[ii] = f_type[ii];
+#pragma omp parallel
+  {
+    // scratch of each thread, reused for all the atoms
+    std::vector<NeighborInfo<float> > sel_nei;
+    sel_nei.reserve(max_nbor_size);
+    std::vector<int> nei_iter(sec.size());
+#pragma omp for
+    for (int ii = 0; ii < nloc; ++ii) {
+      // format the nlist and compute the normalized env mat in place in the outputs
+      int * fmt_nlist_a = nlist + ii * nnei;
+      FPTYPE * em_i = em + ii * nem;
+      FPTYPE * em_deriv_i = em_deriv + ii * nem * 3;
+      const int idx = inlist_idx[ii];
+      const int * nei_idx = idx >= 0 ? inlist.firstneigh[idx] : NULL;
+      const int nnei_i = idx >= 0 ? inlist.numneigh[idx] : 0;
+      format_nlist_i_cpu(fmt_nlist_a, sel_nei, nei_iter, coord, f_type, ii, nei_idx, nnei_i, rcut, sec);
+      env_mat_a_cpu (em_i, em_deriv_i, rij + ii * nnei * 3, coord, ii, fmt_nlist_a, sec, rcut_smth, rcut, avg + type[ii] * nem, std + type[ii] * nem);
+    }
   }
-  
-  // build nlist
-  std::vector<std::vector<int > > d_nlist_a(nloc);
+}
+
+template<typename FPTYPE>
+void
+deepmd::
+prod_env_mat_a_cand_cpu(
+    FPTYPE * em, 
+    FPTYPE * em_deriv, 
+    FPTYPE * rij, 
+    int * nlist, 
+    int * cand, 
+    FPTYPE * margin, 
+    const FPTYPE max_disp, 
+    const FPTYPE * coord, 
+    const int * type, 
+    const InputNlist & inlist,
+    const int max_nbor_size,
+    const FPTYPE * avg, 
+    const FPTYPE * std, 
+    const int nloc, 
+    const float rcut, 
+    const float rcut_smth, 
+    const std::vector<int> sec)
+{
+  const int nnei = sec.back();
+  const int nem = nnei * 4;
 
+  // the index of each local atom in inlist
   assert(nloc == inlist.inum);
-  for (unsigned ii = 0; ii < nloc; ++ii) {
-    d_nlist_a[ii].reserve(max_nbor_size);
-  }
-  for (unsigned ii = 0; ii < nloc; ++ii) {
-    int i_idx = inlist.ilist[ii];
-    for(unsigned jj = 0; jj < inlist.numneigh[ii]; ++jj){
-      int j_idx = inlist.firstneigh[ii][jj];
-      d_nlist_a[i_idx].push_back (j_idx);
-    }
+  std::vector<int> inlist_idx(nloc, -1);
+  for (int ii = 0; ii < inlist.inum; ++ii) {
+    inlist_idx[inlist.ilist[ii]] = ii;
   }
-    
-#pragma omp parallel for 
-  for (int ii = 0; ii < nloc; ++ii) {
-    std::vector<int> fmt_nlist_a;
-    int ret = format_nlist_i_cpu(fmt_nlist_a, d_coord3, d_f_type, ii, d_nlist_a[ii], rcut, sec);
-    std::vector<FPTYPE> d_em_a;
-    std::vector<FPTYPE> d_em_a_deriv;
-    std::vector<FPTYPE> d_em_r;
-    std::vector<FPTYPE> d_em_r_deriv;
-    std::vector<FPTYPE> d_rij_a;
-    env_mat_a_cpu (d_em_a, d_em_a_deriv, d_rij_a, d_coord3, d_f_type, ii, fmt_nlist_a, sec, rcut_smth, rcut);
 
-    // check sizes
-    assert (d_em_a.size() == nem);
-    assert (d_em_a_deriv.size() == nem * 3);
-    assert (d_rij_a.size() == nnei * 3);
-    assert (fmt_nlist_a.size() == nnei);
-    // record outputs
-    for (int jj = 0; jj < nem; ++jj) {
-      em[ii * nem + jj] = (d_em_a[jj] - avg[type[ii] * nem + jj]) / std[type[ii] * nem + jj];
-    }
-    for (int jj = 0; jj < nem * 3; ++jj) {
-      em_deriv[ii * nem * 3 + jj] = d_em_a_deriv[jj] / std[type[ii] * nem + jj / 3];
-    }
-    for (int jj = 0; jj < nnei * 3; ++jj) {
-      rij[ii * nnei * 3 + jj] = d_rij_a[jj];
-    }
-    for (int jj = 0; jj < nnei; ++jj) {
-      nlist[ii * nnei + jj] = fmt_nlist_a[jj];
+#pragma omp parallel
+  {
+    std::vector<NeighborInfo<float> > sel_nei;
+    sel_nei.reserve(max_nbor_size);
+    std::vector<int> nei_iter(sec.size());
+#pragma omp for
+    for (int ii = 0; ii < nloc; ++ii) {
+      int * fmt_nlist_a = nlist + ii * nnei;
+      int * cand_i = cand + ii * nnei;
+      FPTYPE * em_i = em + ii * nem;
+      FPTYPE * em_deriv_i = em_deriv + ii * nem * 3;
+      if (!(max_disp <= margin[ii])) {
+	// the candidates may miss a neighbor, select them again. the margin
+	// is kept relative to the coordinates max_disp refers to
+	const int idx = inlist_idx[ii];
+	const int * nei_idx = idx >= 0 ? inlist.firstneigh[idx] : NULL;
+	const int nnei_i = idx >= 0 ? inlist.numneigh[idx] : 0;
+	margin[ii] = select_nlist_cand_i_cpu(cand_i, sel_nei, nei_iter, coord, type, ii, nei_idx, nnei_i, rcut, sec) - max_disp;
+      }
+      reformat_nlist_i_cpu(fmt_nlist_a, sel_nei, cand_i, coord, ii, rcut, sec);
+      env_mat_a_cpu (em_i, em_deriv_i, rij + ii * nnei * 3, coord, ii, fmt_nlist_a, sec, rcut_smth, rcut, avg + type[ii] * nem, std + type[ii] * nem);
     }
   }
 }
@@ -221,6 +245,50 @@ prod_env_mat_a_cpu<float>(
     const std::vector<int> sec,
     const int * f_type);
 
+template
+void
+deepmd::
+prod_env_mat_a_cand_cpu<double>(
+    double * em, 
+    double * em_deriv, 
+    double * rij, 
+    int * nlist, 
+    int * cand, 
+    double * margin, 
+    const double max_disp, 
+    const double * coord, 
+    const int * type, 
+    const InputNlist & inlist,
+    const int max_nbor_size,
+    const double * avg, 
+    const double * std, 
+    const int nloc, 
+    const float rcut, 
+    const float rcut_smth, 
+    const std::vector<int> sec);
+
+template
+void
+deepmd::
+prod_env_mat_a_cand_cpu<float>(
+    float * em, 
+    float * em_deriv, 
+    float * rij, 
+    int * nlist, 
+    int * cand, 
+    float * margin, 
+    const float max_disp, 
+    const float * coord, 
+    const int * type, 
+    const InputNlist & inlist,
+    const int max_nbor_size,
+    const float * avg, 
+    const float * std, 
+    const int nloc, 
+    const float rcut, 
+    const float rcut_smth, 
+    const std::vector<int> sec);
+
 template
 void
 deepmd::
@@ -1,26 +1,10 @@
 #include <stdexcept>
 #include <cstring>
+#include <vector>
 #include "prod_force.h"
 #include "errors.h"
 #include <math.h>
 
-inline void
-make_index_range (
-    int & idx_start,
-    int & idx_end,
-    const int & nei_idx, 
-    const int & nnei) 
-{
-  if (nei_idx < nnei) {
-    idx_start = nei_idx * 4;
-    idx_end   = nei_idx * 4 + 4;
-  }
-  else {
-    throw deepmd::deepmd_exception("should no reach here");
-  }
-}
-
-
 template<typename FPTYPE>
 void 
 deepmd::
@@ -35,28 +19,67 @@ prod_force_a_cpu(
     const int start_index) 
 {
   const int ndescrpt = 4 * nnei;
+  const int npair = nloc * nnei;
 
   memset(force, 0, sizeof(FPTYPE) * nall * 3);
-  // compute force of a frame
-  for (int i_idx = start_index; i_idx < start_index + nloc; ++i_idx) {
-    // deriv wrt center atom
-    for (int aa = 0; aa < ndescrpt; ++aa) {
-      force[i_idx * 3 + 0] -= net_deriv[i_idx * ndescrpt + aa] * env_deriv[i_idx * ndescrpt * 3 + aa * 3 + 0];
-      force[i_idx * 3 + 1] -= net_deriv[i_idx * ndescrpt + aa] * env_deriv[i_idx * ndescrpt * 3 + aa * 3 + 1];
-      force[i_idx * 3 + 2] -= net_deriv[i_idx * ndescrpt + aa] * env_deriv[i_idx * ndescrpt * 3 + aa * 3 + 2];
-    }
-    // deriv wrt neighbors
+  // the force of each pair is stored, and gathered by the neighbor atoms
+  // afterwards, so that no two threads write to the same atom.
+  std::vector<FPTYPE> pair_force(npair * 3);
+  std::vector<int> nei_start(nall + 1, 0);
+  #pragma omp parallel for
+  for (int ii = 0; ii < nloc; ++ii) {
+    const int i_idx = start_index + ii;
+    const FPTYPE * i_net_deriv = net_deriv + i_idx * ndescrpt;
+    const FPTYPE * i_env_deriv = env_deriv + i_idx * ndescrpt * 3;
+    FPTYPE fi[3] = {(FPTYPE)0., (FPTYPE)0., (FPTYPE)0.};
     for (int jj = 0; jj < nnei; ++jj) {
-      int j_idx = nlist[i_idx * nnei + jj];
-      if (j_idx < 0) continue;
-      int aa_start, aa_end;
-      make_index_range (aa_start, aa_end, jj, nnei);
-      for (int aa = aa_start; aa < aa_end; ++aa) {
-        force[j_idx * 3 + 0] += net_deriv[i_idx * ndescrpt + aa] * env_deriv[i_idx * ndescrpt * 3 + aa * 3 + 0];
-        force[j_idx * 3 + 1] += net_deriv[i_idx * ndescrpt + aa] * env_deriv[i_idx * ndescrpt * 3 + aa * 3 + 1];
-        force[j_idx * 3 + 2] += net_deriv[i_idx * ndescrpt + aa] * env_deriv[i_idx * ndescrpt * 3 + aa * 3 + 2];
+      FPTYPE fij[3] = {(FPTYPE)0., (FPTYPE)0., (FPTYPE)0.};
+      for (int aa = jj * 4; aa < jj * 4 + 4; ++aa) {
+        fij[0] += i_net_deriv[aa] * i_env_deriv[aa * 3 + 0];
+        fij[1] += i_net_deriv[aa] * i_env_deriv[aa * 3 + 1];
+        fij[2] += i_net_deriv[aa] * i_env_deriv[aa * 3 + 2];
       }
+      // deriv wrt center atom
+      fi[0] -= fij[0];
+      fi[1] -= fij[1];
+      fi[2] -= fij[2];
+      // deriv wrt neighbors
+      FPTYPE * pf = &pair_force[(ii * nnei + jj) * 3];
+      pf[0] = fij[0];
+      pf[1] = fij[1];
+      pf[2] = fij[2];
+    }
+    force[i_idx * 3 + 0] = fi[0];
+    force[i_idx * 3 + 1] = fi[1];
+    force[i_idx * 3 + 2] = fi[2];
+  }
+  // transpose the neighbor list: the pairs having j as the neighbor,
+  // stored in the order of the pairs.
+  const int * i_nlist = nlist + start_index * nnei;
+  for (int pp = 0; pp < npair; ++pp) {
+    if (i_nlist[pp] >= 0) nei_start[i_nlist[pp] + 1] ++;
+  }
+  for (int jj = 0; jj < nall; ++jj) {
+    nei_start[jj + 1] += nei_start[jj];
+  }
+  std::vector<int> nei_end(nei_start.begin(), nei_start.end() - 1);
+  std::vector<int> nei_pair(nei_start[nall]);
+  for (int pp = 0; pp < npair; ++pp) {
+    if (i_nlist[pp] >= 0) nei_pair[nei_end[i_nlist[pp]] ++] = pp;
+  }
+  // the sum does not depend on the number of threads
+  #pragma omp parallel for schedule(dynamic, 64)
+  for (int j_idx = 0; j_idx < nall; ++j_idx) {
+    FPTYPE fj[3] = {(FPTYPE)0., (FPTYPE)0., (FPTYPE)0.};
+    for (int kk = nei_start[j_idx]; kk < nei_start[j_idx + 1]; ++kk) {
+      const FPTYPE * pf = &pair_force[nei_pair[kk] * 3];
+      fj[0] += pf[0];
+      fj[1] += pf[1];
+      fj[2] += pf[2];
     }
+    force[j_idx * 3 + 0] += fj[0];
+    force[j_idx * 3 + 1] += fj[1];
+    force[j_idx * 3 + 2] += fj[2];
   }
 }
 
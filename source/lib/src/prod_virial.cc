@@ -1,25 +1,11 @@
 #include <iostream>
 #include <stdexcept>
 #include <cstring>
+#include <vector>
+#include <algorithm>
 #include "prod_virial.h"
 #include "errors.h"
 
-inline void 
-make_index_range (
-    int & idx_start,
-    int & idx_end,
-    const int & nei_idx, 
-    const int & nnei) 
-{
-  if (nei_idx < nnei) {
-    idx_start = nei_idx * 4;
-    idx_end   = nei_idx * 4 + 4;
-  }
-  else {
-    throw deepmd::deepmd_exception("should no reach here");    
-  }
-}
-
 template<typename FPTYPE>
 void 
 deepmd::
@@ -35,39 +21,83 @@ prod_virial_a_cpu(
     const int nnei)
 {
   const int ndescrpt = 4 * nnei;
-
-  for (int ii = 0; ii < 9; ++ ii){
-    virial[ii] = (FPTYPE)0.;
-  }
-  for (int ii = 0; ii < 9 * nall; ++ ii){
-    atom_virial[ii] = (FPTYPE)0.;
-  }
+  const int npair = nloc * nnei;
+  // the atoms are summed in blocks of fixed size, so that the virial 
+  // does not depend on the number of threads
+  const int block_size = 64;
+  const int nblock = (nloc + block_size - 1) / block_size;
+  std::vector<FPTYPE> block_virial(nblock * 9, (FPTYPE)0.);
+  // the virial of each pair, only stored if the atom virial is required
+  std::vector<FPTYPE> pair_virial(atom_virial ? npair * 9 : 0);
 
   // compute virial of a frame
   #pragma omp parallel for
-  for (int ii = 0; ii < nloc; ++ii){
-    int i_idx = ii;
-
-    // deriv wrt neighbors
-    for (int jj = 0; jj < nnei; ++jj){
-      int j_idx = nlist[i_idx * nnei + jj];
-      if (j_idx < 0) continue;
-      int aa_start, aa_end;
-      make_index_range (aa_start, aa_end, jj, nnei);
-      for (int aa = aa_start; aa < aa_end; ++aa) {
-	FPTYPE pref = (FPTYPE)-1.0 * net_deriv[i_idx * ndescrpt + aa];
+  for (int bb = 0; bb < nblock; ++bb){
+    FPTYPE * bv = &block_virial[bb * 9];
+    for (int i_idx = bb * block_size; i_idx < std::min((bb + 1) * block_size, nloc); ++i_idx){
+      // deriv wrt neighbors
+      for (int jj = 0; jj < nnei; ++jj){
+	int j_idx = nlist[i_idx * nnei + jj];
+	if (j_idx < 0) continue;
+	FPTYPE fij[3] = {(FPTYPE)0., (FPTYPE)0., (FPTYPE)0.};
+	for (int aa = jj * 4; aa < jj * 4 + 4; ++aa) {
+	  for (int dd0 = 0; dd0 < 3; ++dd0){
+	    fij[dd0] += net_deriv[i_idx * ndescrpt + aa] * env_deriv[i_idx * ndescrpt * 3 + aa * 3 + dd0];
+	  }
+	}
+	const FPTYPE * rr = &rij[i_idx * nnei * 3 + jj * 3];
 	for (int dd0 = 0; dd0 < 3; ++dd0){
 	  for (int dd1 = 0; dd1 < 3; ++dd1){
-	    FPTYPE tmp_v = pref * rij[i_idx * nnei * 3 + jj * 3 + dd1] *  env_deriv[i_idx * ndescrpt * 3 + aa * 3 + dd0];
-      #pragma omp atomic
-	    virial[dd0 * 3 + dd1] -= tmp_v;
-      #pragma omp atomic
-	    atom_virial[j_idx * 9 + dd0 * 3 + dd1] -= tmp_v;
+	    bv[dd0 * 3 + dd1] += fij[dd0] * rr[dd1];
 	  }
 	}
+	if (atom_virial) {
+	  FPTYPE * pv = &pair_virial[(i_idx * nnei + jj) * 9];
+	  for (int dd0 = 0; dd0 < 3; ++dd0){
+	    for (int dd1 = 0; dd1 < 3; ++dd1){
+	      pv[dd0 * 3 + dd1] = fij[dd0] * rr[dd1];
+	    }
+	  }
+	}
+      }
+    }
+  }
+  for (int ii = 0; ii < 9; ++ ii){
+    virial[ii] = (FPTYPE)0.;
+  }
+  for (int bb = 0; bb < nblock; ++bb){
+    for (int ii = 0; ii < 9; ++ ii){
+      virial[ii] += block_virial[bb * 9 + ii];
+    }
+  }
+  if (!atom_virial) return;
+
+  // gather the pair virials by the neighbor atoms, in the order of the pairs
+  std::vector<int> nei_start(nall + 1, 0);
+  for (int pp = 0; pp < npair; ++pp){
+    if (nlist[pp] >= 0) nei_start[nlist[pp] + 1] ++;
+  }
+  for (int jj = 0; jj < nall; ++jj){
+    nei_start[jj + 1] += nei_start[jj];
+  }
+  std::vector<int> nei_end(nei_start.begin(), nei_start.end() - 1);
+  std::vector<int> nei_pair(nei_start[nall]);
+  for (int pp = 0; pp < npair; ++pp){
+    if (nlist[pp] >= 0) nei_pair[nei_end[nlist[pp]] ++] = pp;
+  }
+  #pragma omp parallel for schedule(dynamic, 64)
+  for (int j_idx = 0; j_idx < nall; ++j_idx){
+    FPTYPE av[9] = {(FPTYPE)0.};
+    for (int kk = nei_start[j_idx]; kk < nei_start[j_idx + 1]; ++kk){
+      const FPTYPE * pv = &pair_virial[nei_pair[kk] * 9];
+      for (int dd = 0; dd < 9; ++dd){
+	av[dd] += pv[dd];
       }
     }
-  }  
+    for (int dd = 0; dd < 9; ++dd){
+      atom_virial[j_idx * 9 + dd] = av[dd];
+    }
+  }
 }
 
 template
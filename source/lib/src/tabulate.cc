@@ -147,6 +147,101 @@ void deepmd::tabulate_fusion_se_a_cpu(
   }
 }
 
+// clone the vectorized kernels for AVX-512 and AVX2 with FMA,
+// the best one supported by the CPU is selected at runtime.
+#if defined(__GNUC__) && (__GNUC__ >= 9) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define TABULATE_TARGET_CLONES __attribute__((target_clones("arch=skylake-avx512", "arch=haswell", "default")))
+#else
+#define TABULATE_TARGET_CLONES
+#endif
+
+template <typename FPTYPE>
+TABULATE_TARGET_CLONES
+static void tabulate_fusion_se_a_soa_row(
+    FPTYPE * __restrict out,
+    const FPTYPE * __restrict coef,
+    const FPTYPE xx,
+    const FPTYPE scale,
+    const FPTYPE * ll,
+    const int last_layer_size)
+{
+  const FPTYPE * a0 = coef + 0 * last_layer_size;
+  const FPTYPE * a1 = coef + 1 * last_layer_size;
+  const FPTYPE * a2 = coef + 2 * last_layer_size;
+  const FPTYPE * a3 = coef + 3 * last_layer_size;
+  const FPTYPE * a4 = coef + 4 * last_layer_size;
+  const FPTYPE * a5 = coef + 5 * last_layer_size;
+  FPTYPE * out0 = out + 0 * last_layer_size;
+  FPTYPE * out1 = out + 1 * last_layer_size;
+  FPTYPE * out2 = out + 2 * last_layer_size;
+  FPTYPE * out3 = out + 3 * last_layer_size;
+  const FPTYPE ll0 = ll[0], ll1 = ll[1], ll2 = ll[2], ll3 = ll[3];
+  #pragma omp simd
+  for (int kk = 0; kk < last_layer_size; kk++) {
+    FPTYPE var = a0[kk] + (a1[kk] + (a2[kk] + (a3[kk] + (a4[kk] + a5[kk] * xx) * xx) * xx) * xx) * xx;
+    var *= scale;
+    out0[kk] += var * ll0;
+    out1[kk] += var * ll1;
+    out2[kk] += var * ll2;
+    out3[kk] += var * ll3;
+  }
+}
+
+template<typename FPTYPE>
+void deepmd::tabulate_fusion_se_a_table_soa_cpu(
+    FPTYPE * table_soa,
+    const FPTYPE * table, 
+    const int nspline, 
+    const int last_layer_size)
+{
+  #pragma omp parallel for
+  for (int ii = 0; ii < nspline; ii++) {
+    const FPTYPE * src = table + ii * last_layer_size * 6;
+    FPTYPE * dst = table_soa + ii * last_layer_size * 6;
+    for (int kk = 0; kk < last_layer_size; kk++) {
+      for (int cc = 0; cc < 6; cc++) {
+        dst[cc * last_layer_size + kk] = src[kk * 6 + cc];
+      }
+    }
+  }
+}
+
+template<typename FPTYPE>
+void deepmd::tabulate_fusion_se_a_soa_cpu(
+    FPTYPE * out,
+    const FPTYPE * table_soa, 
+    const FPTYPE * table_info, 
+    const FPTYPE * em_x, 
+    const FPTYPE * em, 
+    const int nloc, 
+    const int nnei, 
+    const int last_layer_size)
+{
+  memset(out, 0, sizeof(FPTYPE) * nloc * 4 * last_layer_size);
+  const FPTYPE lower   = table_info[0];
+  const FPTYPE upper   = table_info[1];
+  const FPTYPE _max    = table_info[2];
+  const FPTYPE stride0 = table_info[3];
+  const FPTYPE stride1 = table_info[4];
+  #pragma omp parallel for
+  for (int ii = 0; ii < nloc; ii++) {
+    FPTYPE ago = em_x[ii * nnei + nnei - 1];
+    for (int jj = 0; jj < nnei; jj++) { 
+      const FPTYPE * ll = em + ii * nnei * 4 + jj * 4;
+      FPTYPE xx = em_x[ii * nnei + jj]; 
+      // the remaining neighbors are the same padding, count them at once
+      const bool unloop = (ago == xx);
+      int table_idx = 0;
+      locate_xx(lower, upper, _max, stride0, stride1, xx, table_idx);
+      tabulate_fusion_se_a_soa_row(
+          out + ii * last_layer_size * 4, 
+          table_soa + table_idx * last_layer_size * 6, 
+          xx, unloop ? (FPTYPE)(nnei - jj) : (FPTYPE)1., ll, last_layer_size);
+      if (unloop) break;
+    }
+  }
+}
+
 template<typename FPTYPE>
 void deepmd::tabulate_fusion_se_a_grad_cpu(
     FPTYPE * dy_dem_x, 
@@ -587,6 +682,10 @@ void deepmd::tabulate_fusion_se_r_grad_grad_cpu(
 
 template void deepmd::tabulate_fusion_se_a_cpu<float>(float * out, const float * table, const float * table_info, const float * em_x, const float * em, const int nloc, const int nnei, const int last_layer_size);
 template void deepmd::tabulate_fusion_se_a_cpu<double>(double * out, const double * table, const double * table_info, const double * em_x, const double * em, const int nloc, const int nnei, const int last_layer_size);
+template void deepmd::tabulate_fusion_se_a_table_soa_cpu<float>(float * table_soa, const float * table, const int nspline, const int last_layer_size);
+template void deepmd::tabulate_fusion_se_a_table_soa_cpu<double>(double * table_soa, const double * table, const int nspline, const int last_layer_size);
+template void deepmd::tabulate_fusion_se_a_soa_cpu<float>(float * out, const float * table_soa, const float * table_info, const float * em_x, const float * em, const int nloc, const int nnei, const int last_layer_size);
+template void deepmd::tabulate_fusion_se_a_soa_cpu<double>(double * out, const double * table_soa, const double * table_info, const double * em_x, const double * em, const int nloc, const int nnei, const int last_layer_size);
 template void deepmd::tabulate_fusion_se_a_grad_cpu<float> (float * dy_dem_x, float * dy_dem, const float * table, const float * table_info, const float * em_x, const float * em, const float * dy, const int nloc, const int nnei, const int last_layer_size); 
 template void deepmd::tabulate_fusion_se_a_grad_cpu<double> (double * dy_dem_x, double * dy_dem, const double * table, const double * table_info, const double * em_x, const double * em, const double * dy, const int nloc, const int nnei, const int last_layer_size);
 template void deepmd::tabulate_fusion_se_a_grad_grad_cpu<float>(float * dz_dy, const float * table, const float * table_info, const float * em_x, const float * em, const float * dz_dy_dem_x, const float * dz_dy_dem, const int nloc, const int nnei, const int last_layer_size);
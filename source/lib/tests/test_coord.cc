@@ -1,7 +1,10 @@
 #include <gtest/gtest.h>
 #include <cmath>
 #include <algorithm>
+#include <random>
 #include "coord.h"
+#include "neighbor_list.h"
+#include "SimulationRegion.h"
 #include "device.h"
 
 class TestNormCoord : public ::testing::Test
@@ -837,6 +840,63 @@ TEST_F(TestCopyCoordMoreCell, cpu_lessmem)
   // 	    << nall << std::endl;
 }
 
+TEST(TestCopyCoordAniso, cpu_equal_copy_coord)
+{
+  // a thin triclinic slab, the atoms have several images along z
+  std::vector<double > boxt = {25., 0., 0., 1., 22., 0., 0.5, 0.3, 2.5};
+  double rc = 6.;
+  int nloc = 400;
+  std::mt19937 gen(20230601);
+  std::uniform_real_distribution<double> uniform(0., 1.);
+  std::vector<double > posi(nloc * 3);
+  std::vector<int > atype(nloc);
+  for(int ii = 0; ii < nloc; ++ii){
+    double inter[3] = {uniform(gen), uniform(gen), uniform(gen)};
+    for(int dd = 0; dd < 3; ++dd){
+      posi[ii*3+dd] = inter[0] * boxt[dd] + inter[1] * boxt[3+dd] + inter[2] * boxt[6+dd];
+    }
+    atype[ii] = ii % 2;
+  }
+  SimulationRegion<double > region_legacy;
+  region_legacy.reinitBox(&boxt[0]);
+  std::vector<double > expected_posi_cpy;
+  std::vector<int > expected_atype_cpy, expected_mapping, ncell, ngcell;
+  copy_coord(expected_posi_cpy, expected_atype_cpy, expected_mapping, ncell, ngcell, posi, atype, rc, region_legacy);
+  int expected_nall = expected_mapping.size();
+  std::vector<double > expected_posi_1;
+  std::vector<int > expected_atype_1, expected_mapping_1;
+  sort_atoms(expected_posi_1, expected_atype_1, expected_mapping_1, expected_posi_cpy, expected_atype_cpy, expected_mapping, nloc, expected_nall);
+
+  deepmd::Region<double> region;
+  init_region_cpu(region, &boxt[0]);
+  // the exact number of atoms is given when the memory is not enough
+  int mem_size = nloc;
+  std::vector<double > out_c(mem_size * 3);
+  std::vector<int > out_t(mem_size);
+  std::vector<int > mapping(mem_size);
+  int nall;
+  int ret = copy_coord_cpu(&out_c[0], &out_t[0], &mapping[0], &nall, &posi[0], &atype[0], nloc, mem_size, rc, region);
+  EXPECT_EQ(ret, 1);
+  EXPECT_EQ(nall, expected_nall);
+  mem_size = nall;
+  out_c.resize(mem_size * 3);
+  out_t.resize(mem_size);
+  mapping.resize(mem_size);
+  ret = copy_coord_cpu(&out_c[0], &out_t[0], &mapping[0], &nall, &posi[0], &atype[0], nloc, mem_size, rc, region);
+  EXPECT_EQ(ret, 0);
+  EXPECT_EQ(nall, expected_nall);
+  std::vector<double > out_c_1;
+  std::vector<int > out_t_1, mapping_1;
+  sort_atoms(out_c_1, out_t_1, mapping_1, out_c, out_t, mapping, nloc, nall);
+  for(int ii = 0; ii < expected_nall; ++ii){
+    for(int dd = 0; dd < 3; ++dd){
+      EXPECT_LT(fabs(out_c_1[ii*3+dd] - expected_posi_1[ii*3+dd]), 1e-12);
+    }
+    EXPECT_EQ(out_t_1[ii], expected_atype_1[ii]);
+    EXPECT_EQ(mapping_1[ii], expected_mapping_1[ii]);
+  }
+}
+
 #if GOOGLE_CUDA
 TEST_F(TestCopyCoordMoreCell, gpu)
 {
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <gtest/gtest.h>
+#include <random>
 #include "fmt_nlist.h"
 #include "env_mat.h"
 #include "prod_env_mat.h"
@@ -282,6 +283,30 @@ TEST_F(TestEnvMatA, cpu_equal_orig_cpy)
   }
 }
 
+// no smooth switch, the env mat is cut off at rc
+TEST_F(TestEnvMatA, cpu_equal_orig_cpy_no_smth)
+{
+  std::vector<int> fmt_nlist_a_0, fmt_nlist_a_1;
+  std::vector<double> env_0, env_deriv_0, rij_a_0;
+  std::vector<double> env_1, env_deriv_1, rij_a_1;
+  for(int ii = 0; ii < nloc; ++ii){
+    int ret_0 = format_nlist_i_cpu<double>(fmt_nlist_a_0, posi_cpy, atype_cpy, ii, nlist_a_cpy[ii], rc, sec_a);
+    EXPECT_EQ(ret_0, -1);
+    env_mat_a(env_0, env_deriv_0, rij_a_0, posi_cpy, ntypes, atype_cpy, region, false, ii, fmt_nlist_a_0, sec_a, rc, rc);
+    int ret_1 = format_nlist_i_cpu<double>(fmt_nlist_a_1, posi_cpy, atype_cpy, ii, nlist_a_cpy[ii], rc, sec_a);
+    EXPECT_EQ(ret_1, -1);
+    deepmd::env_mat_a_cpu<double>(env_1, env_deriv_1, rij_a_1, posi_cpy, atype_cpy, ii, fmt_nlist_a_1, sec_a, rc, rc);
+    EXPECT_EQ(env_0.size(), env_1.size());
+    EXPECT_EQ(env_deriv_0.size(), env_deriv_1.size());
+    for (unsigned jj = 0; jj < env_0.size(); ++jj){
+      EXPECT_LT(fabs(env_0[jj] - env_1[jj]), 1e-10);
+    }
+    for (unsigned jj = 0; jj < env_deriv_0.size(); ++jj){
+      EXPECT_LT(fabs(env_deriv_0[jj] - env_deriv_1[jj]), 1e-10);
+    }
+  }
+}
+
 TEST_F(TestEnvMatA, cpu_num_deriv)
 {
   std::vector<int> fmt_nlist_a, fmt_nlist_r;
@@ -511,6 +536,175 @@ TEST_F(TestEnvMatA, prod_cpu_equal_cpu)
 }
 
 
+TEST_F(TestEnvMatA, prod_cpu_reversed_ilist_normalized)
+{
+  int max_nbor_size = 0;
+  for(int ii = 0; ii < nlist_a_cpy.size(); ++ii){
+    if (nlist_a_cpy[ii].size() > max_nbor_size){
+      max_nbor_size = nlist_a_cpy[ii].size();
+    }
+  }
+  // the core atoms are listed in the reversed order
+  std::vector<int> ilist(nloc), numneigh(nloc);
+  std::vector<int*> firstneigh(nloc);
+  for(int ii = 0; ii < nloc; ++ii){
+    int i_idx = nloc - 1 - ii;
+    ilist[ii] = i_idx;
+    numneigh[ii] = nlist_a_cpy[i_idx].size();
+    firstneigh[ii] = &nlist_a_cpy[i_idx][0];
+  }
+  deepmd::InputNlist inlist(nloc, &ilist[0], &numneigh[0], &firstneigh[0]);
+  std::vector<double > em(nloc * ndescrpt), em_deriv(nloc * ndescrpt * 3), rij(nloc * nnei * 3);
+  std::vector<int> nlist(nloc * nnei);
+  std::vector<double > avg(ntypes * ndescrpt), std(ntypes * ndescrpt);
+  for(int ii = 0; ii < ntypes * ndescrpt; ++ii){
+    avg[ii] = 0.01 * (ii % 7);
+    std[ii] = 1. + 0.1 * (ii % 5);
+  }
+  deepmd::prod_env_mat_a_cpu(
+      &em[0],
+      &em_deriv[0],
+      &rij[0],
+      &nlist[0],
+      &posi_cpy[0],
+      &atype_cpy[0],
+      inlist,
+      max_nbor_size,
+      &avg[0],
+      &std[0],
+      nloc,
+      nall,
+      rc, 
+      rc_smth,
+      sec_a);
+
+  std::vector<int> fmt_nlist_a_1;
+  std::vector<double> env_1, env_deriv_1, rij_a_1;
+  for(int ii = 0; ii < nloc; ++ii){
+    format_nlist_i_cpu<double>(fmt_nlist_a_1, posi_cpy, atype_cpy, ii, nlist_a_cpy[ii], rc, sec_a);  
+    deepmd::env_mat_a_cpu<double>(env_1, env_deriv_1, rij_a_1, posi_cpy, atype_cpy, ii, fmt_nlist_a_1, sec_a, rc_smth, rc);
+    const double * avg_i = &avg[atype_cpy[ii] * ndescrpt];
+    const double * std_i = &std[atype_cpy[ii] * ndescrpt];
+    for (unsigned jj = 0; jj < env_1.size(); ++jj){
+      EXPECT_LT(fabs(em[ii*nnei*4+jj] - (env_1[jj] - avg_i[jj]) / std_i[jj]), 1e-10);
+    }
+    for (unsigned jj = 0; jj < env_deriv_1.size(); ++jj){
+      EXPECT_LT(fabs(em_deriv[ii*nnei*4*3+jj] - env_deriv_1[jj] / std_i[jj/3]), 1e-10);      
+    }    
+    for (unsigned jj = 0; jj < rij_a_1.size(); ++jj){
+      EXPECT_LT(fabs(rij[ii*nnei*3+jj] - rij_a_1[jj]), 1e-10);
+    }
+    for (unsigned jj = 0; jj < fmt_nlist_a_1.size(); ++jj){
+      EXPECT_EQ(nlist[ii*nnei+jj], fmt_nlist_a_1[jj]);
+    }
+  }
+}
+
+
+// more neighbors than a simd block, inside, across and beyond the switch
+TEST(TestEnvMatABlock, cpu_normalized_equal_orig)
+{
+  std::mt19937 gen(20230603);
+  std::uniform_real_distribution<double> dist(-5., 5.);
+  const int nall = 201;
+  const double rc = 6., rc_smth = 1.;
+  std::vector<int> sec_a = {0, 150, 230};
+  std::vector<double> posi(nall * 3);
+  std::vector<int> atype(nall);
+  std::vector<int> nei_idx;
+  for (int ii = 0; ii < nall; ++ii) {
+    for (int dd = 0; dd < 3; ++dd) {
+      posi[ii * 3 + dd] = ii == 0 ? 0. : dist(gen);
+    }
+    atype[ii] = ii % 4 == 0 ? 1 : 0;
+    if (ii > 0) nei_idx.push_back(ii);
+  }
+  std::vector<int> fmt_nlist_a;
+  int ret = format_nlist_i_cpu<double>(fmt_nlist_a, posi, atype, 0, nei_idx, rc, sec_a);
+  EXPECT_EQ(ret, -1);
+  EXPECT_GT(fmt_nlist_a[64], 0);
+  int nnei = sec_a.back();
+  std::vector<double> avg(nnei * 4), std(nnei * 4);
+  for (int jj = 0; jj < nnei * 4; ++jj) {
+    avg[jj] = 0.01 * (jj % 7);
+    std[jj] = 1. + 0.1 * (jj % 5);
+  }
+  std::vector<double> env_0, env_deriv_0, rij_0;
+  SimulationRegion<double> region;
+  env_mat_a(env_0, env_deriv_0, rij_0, posi, 2, atype, region, false, 0, fmt_nlist_a, sec_a, rc_smth, rc);
+  std::vector<double> env(nnei * 4, 1.), env_deriv(nnei * 12, 1.), rij(nnei * 3, 1.);
+  deepmd::env_mat_a_cpu<double>(&env[0], &env_deriv[0], &rij[0], &posi[0], 0, &fmt_nlist_a[0], sec_a, rc_smth, rc, &avg[0], &std[0]);
+  for (int jj = 0; jj < nnei * 4; ++jj) {
+    EXPECT_LT(fabs(env[jj] - (env_0[jj] - avg[jj]) / std[jj]), 1e-10);
+  }
+  for (int jj = 0; jj < nnei * 12; ++jj) {
+    EXPECT_LT(fabs(env_deriv[jj] - env_deriv_0[jj] / std[jj / 3]), 1e-10);
+  }
+  for (int jj = 0; jj < nnei * 3; ++jj) {
+    EXPECT_LT(fabs(rij[jj] - rij_0[jj]), 1e-10);
+  }
+  // the float instantiation
+  std::vector<float> posi_f(posi.begin(), posi.end());
+  std::vector<float> env_f(nnei * 4), env_deriv_f(nnei * 12), rij_f(nnei * 3);
+  deepmd::env_mat_a_cpu<float>(&env_f[0], &env_deriv_f[0], &rij_f[0], &posi_f[0], 0, &fmt_nlist_a[0], sec_a, rc_smth, rc);
+  for (int jj = 0; jj < nnei * 4; ++jj) {
+    EXPECT_LT(fabs(env_f[jj] - env_0[jj]), 1e-5);
+  }
+  for (int jj = 0; jj < nnei * 12; ++jj) {
+    EXPECT_LT(fabs(env_deriv_f[jj] - env_deriv_0[jj]), 1e-5);
+  }
+}
+
+TEST_F(TestEnvMatA, prod_cand_cpu_equal_prod_cpu)
+{
+  int max_nbor_size = 0;
+  for(int ii = 0; ii < nlist_a_cpy.size(); ++ii){
+    if (nlist_a_cpy[ii].size() > max_nbor_size){
+      max_nbor_size = nlist_a_cpy[ii].size();
+    }
+  }
+  std::vector<int> ilist(nloc), numneigh(nloc);
+  std::vector<int*> firstneigh(nloc);
+  deepmd::InputNlist inlist(nloc, &ilist[0], &numneigh[0], &firstneigh[0]);
+  deepmd::convert_nlist(inlist, nlist_a_cpy);
+  std::vector<double > em(nloc * ndescrpt), em_deriv(nloc * ndescrpt * 3), rij(nloc * nnei * 3);
+  std::vector<double > em_1(nloc * ndescrpt), em_deriv_1(nloc * ndescrpt * 3), rij_1(nloc * nnei * 3);
+  std::vector<int> nlist(nloc * nnei), nlist_1(nloc * nnei), cand(nloc * nnei);
+  std::vector<double> margin(nloc, -1.);
+  std::vector<double > avg(ntypes * ndescrpt, 0);
+  std::vector<double > std(ntypes * ndescrpt, 1);
+  // the atoms move away from the reference step by step
+  std::vector<double> posi_1(posi_cpy);
+  double max_disp = 0.;
+  for (int step = 0; step < 4; ++step){
+    for (int ii = 0; ii < nall; ++ii){
+      for (int dd = 0; dd < 3; ++dd){
+	posi_1[ii*3+dd] = posi_cpy[ii*3+dd] + 0.05 * step * ((ii + dd) % 3 - 1);
+      }
+    }
+    deepmd::prod_env_mat_a_cand_cpu(
+	&em_1[0], &em_deriv_1[0], &rij_1[0], &nlist_1[0], &cand[0], &margin[0], max_disp,
+	&posi_1[0], &atype_cpy[0], inlist, max_nbor_size, &avg[0], &std[0],
+	nloc, rc, rc_smth, sec_a);
+    deepmd::prod_env_mat_a_cpu(
+	&em[0], &em_deriv[0], &rij[0], &nlist[0],
+	&posi_1[0], &atype_cpy[0], inlist, max_nbor_size, &avg[0], &std[0],
+	nloc, nall, rc, rc_smth, sec_a);
+    EXPECT_EQ(nlist_1, nlist);
+    for (unsigned jj = 0; jj < em.size(); ++jj){
+      EXPECT_LT(fabs(em_1[jj] - em[jj]), 1e-10);
+    }
+    for (unsigned jj = 0; jj < em_deriv.size(); ++jj){
+      EXPECT_LT(fabs(em_deriv_1[jj] - em_deriv[jj]), 1e-10);
+    }
+    for (unsigned jj = 0; jj < rij.size(); ++jj){
+      EXPECT_LT(fabs(rij_1[jj] - rij[jj]), 1e-10);
+    }
+    max_disp = 0.05 * sqrt(2.) * (step + 1);
+  }
+}
+
+
 #if GOOGLE_CUDA
 TEST_F(TestEnvMatA, prod_gpu_cuda)
 {
@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
 #include "fmt_nlist.h"
 #include "neighbor_list.h"
 
@@ -343,6 +345,118 @@ TEST_F(TestFormatNlistShortSel, cpu)
   }
 }
 
+// the partial selection of each type equals the full sort of all the neighbors
+TEST(TestFormatNlistRandom, cpu_equal_full_sort)
+{
+  std::mt19937 gen(20230601);
+  std::uniform_real_distribution<double> dist(-4., 4.);
+  std::uniform_int_distribution<int> dist_type(0, 2);
+  const int nall = 301;
+  const float rc = 5.;
+  std::vector<int> sec_a = {0, 10, 30, 35};
+  std::vector<double> posi(nall * 3);
+  std::vector<int> atype(nall);
+  for (int ii = 0; ii < nall; ++ii) {
+    for (int dd = 0; dd < 3; ++dd) {
+      posi[ii * 3 + dd] = dist(gen);
+    }
+    atype[ii] = dist_type(gen);
+  }
+  // the ties are broken by the index
+  for (int ii = 280; ii < nall; ++ii) {
+    for (int dd = 0; dd < 3; ++dd) {
+      posi[ii * 3 + dd] = posi[(ii - 20) * 3 + dd];
+    }
+    atype[ii] = atype[ii - 20];
+  }
+  std::vector<int> nei_idx;
+  for (int ii = 1; ii < nall; ++ii) {
+    nei_idx.push_back(ii);
+  }
+  std::shuffle(nei_idx.begin(), nei_idx.end(), gen);
+  std::vector<NeighborInfo<float> > sel_nei;
+  for (int jj : nei_idx) {
+    float rr2 = 0;
+    for (int dd = 0; dd < 3; ++dd) {
+      float diff = (float)posi[jj * 3 + dd] - (float)posi[dd];
+      rr2 += diff * diff;
+    }
+    if (rr2 <= rc * rc) {
+      sel_nei.push_back(NeighborInfo<float>(atype[jj], rr2, jj));
+    }
+  }
+  std::sort(sel_nei.begin(), sel_nei.end());
+  std::vector<int> expect_nlist(sec_a.back(), -1), nei_iter(sec_a);
+  int expect_ret = -1;
+  for (const auto & nei : sel_nei) {
+    if (nei_iter[nei.type] < sec_a[nei.type + 1]) {
+      expect_nlist[nei_iter[nei.type]++] = nei.index;
+    }
+    else {
+      expect_ret = nei.type;
+    }
+  }
+  EXPECT_NE(expect_ret, -1);
+
+  std::vector<int> fmt_nlist;
+  int ret = format_nlist_i_cpu<double>(fmt_nlist, posi, atype, 0, nei_idx, rc, sec_a);
+  EXPECT_EQ(ret, expect_ret);
+  EXPECT_EQ(fmt_nlist, expect_nlist);
+}
+
+// the candidates give the formatted nlist as long as no atom moves beyond the margin
+TEST(TestFormatNlistRandom, cpu_reformat_cand)
+{
+  std::mt19937 gen(20230602);
+  std::uniform_real_distribution<double> dist(-4., 4.);
+  std::uniform_int_distribution<int> dist_type(0, 2);
+  std::normal_distribution<double> normal(0., 1.);
+  const int nall = 301;
+  const float rc = 3.5;
+  // type 0 is truncated, types 1 and 2 have spare candidates beyond rc
+  std::vector<int> sec_a = {0, 10, 70, 110};
+  std::vector<double> posi(nall * 3);
+  std::vector<int> atype(nall);
+  for (int ii = 0; ii < nall; ++ii) {
+    for (int dd = 0; dd < 3; ++dd) {
+      posi[ii * 3 + dd] = ii == 0 ? 0. : dist(gen);
+    }
+    atype[ii] = dist_type(gen);
+  }
+  std::vector<int> nei_idx;
+  for (int ii = 1; ii < nall; ++ii) {
+    nei_idx.push_back(ii);
+  }
+  std::vector<NeighborInfo<float> > sel_nei;
+  std::vector<int> nei_iter;
+  std::vector<int> cand(sec_a.back()), fmt_nlist(sec_a.back()), expect_nlist(sec_a.back());
+  float margin = select_nlist_cand_i_cpu<double>(&cand[0], sel_nei, nei_iter, &posi[0], &atype[0], 0, &nei_idx[0], nei_idx.size(), rc, sec_a);
+  EXPECT_GT(margin, 0.);
+  EXPECT_LT(margin, 1.);
+  int nvalid = 0;
+  for (double scale : {0., 1e-4, 1e-3, 1e-2, 1e-1, 1.}) {
+    std::vector<double> posi_1(posi);
+    double max_disp = 0.;
+    for (int ii = 0; ii < nall; ++ii) {
+      double disp2 = 0.;
+      for (int dd = 0; dd < 3; ++dd) {
+	double disp = scale * normal(gen);
+	posi_1[ii * 3 + dd] += disp;
+	disp2 += disp * disp;
+      }
+      max_disp = std::max(max_disp, sqrt(disp2));
+    }
+    if (max_disp > margin) {
+      continue;
+    }
+    nvalid ++;
+    reformat_nlist_i_cpu<double>(&fmt_nlist[0], sel_nei, &cand[0], &posi_1[0], 0, rc, sec_a);
+    format_nlist_i_cpu<double>(&expect_nlist[0], sel_nei, nei_iter, &posi_1[0], &atype[0], 0, &nei_idx[0], nei_idx.size(), rc, sec_a);
+    EXPECT_EQ(fmt_nlist, expect_nlist);
+  }
+  EXPECT_GE(nvalid, 2);
+}
+
 #if GOOGLE_CUDA
 TEST_F(TestFormatNlist, gpu_cuda)
 {
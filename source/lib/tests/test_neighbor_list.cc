@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "fmt_nlist.h"
 #include "neighbor_list.h"
+#include "coord.h"
 #include "device.h"
 
 class TestNeighborList : public ::testing::Test
@@ -117,6 +118,170 @@ TEST_F(TestNeighborList, cpu_lessmem)
   delete[] firstneigh;
 }
 
+TEST_F(TestNeighborList, cpu_cell)
+{
+  int mem_size = 10;
+  std::vector<int> ilist(nloc), numneigh(nloc);
+  std::vector<std::vector<int>> jlist(nloc, std::vector<int>(mem_size));
+  std::vector<int*> firstneigh(nloc);
+  for(int ii = 0; ii < nloc; ++ii){
+    firstneigh[ii] = &jlist[ii][0];
+  }
+  deepmd::InputNlist nlist(nloc, &ilist[0], &numneigh[0], &firstneigh[0]);
+  deepmd::Region<double> region;
+  init_region_cpu(region, &boxt[0]);
+  int max_list_size;
+  int ret = deepmd::build_nlist_cell_cpu(
+      nlist,
+      &max_list_size,
+      &posi_cpy[0],
+      nloc,
+      nall,
+      mem_size,
+      rc,
+      region);
+  EXPECT_EQ(ret, 0);
+  EXPECT_EQ(nlist.inum, nloc);
+  EXPECT_EQ(max_list_size, 5);
+  for(int ii = 0; ii < nloc; ++ii){
+    EXPECT_EQ(nlist.ilist[ii], ii);
+    EXPECT_EQ(nlist.numneigh[ii], expect_nlist_cpy[ii].size());
+    for(int jj = 0; jj < nlist.numneigh[ii]; ++jj){
+      EXPECT_EQ(nlist.firstneigh[ii][jj], expect_nlist_cpy[ii][jj]);
+    }
+  }
+  // not enough memory
+  mem_size = 2;
+  ret = deepmd::build_nlist_cell_cpu(
+      nlist,
+      &max_list_size,
+      &posi_cpy[0],
+      nloc,
+      nall,
+      mem_size,
+      rc,
+      region);
+  EXPECT_EQ(ret, 1);
+  EXPECT_EQ(max_list_size, 5);
+}
+
+TEST(TestNeighborListCell, cpu_triclinic)
+{
+  // a dense triclinic box copied with the periodic images
+  std::vector<double> boxt = {
+    10.5, 0., 0., 
+    2.1, 11.3, 0., 
+    -1.4, 1.7, 12.2
+  };
+  double rc = 3.5;
+  int nloc = 300;
+  std::vector<double> posi(nloc * 3);
+  std::vector<int> atype(nloc, 0);
+  srand(20230601);
+  for(int ii = 0; ii < nloc; ++ii){
+    double ri[3];
+    for(int dd = 0; dd < 3; ++dd){
+      ri[dd] = double(rand()) / RAND_MAX;
+    }
+    for(int dd = 0; dd < 3; ++dd){
+      posi[ii*3+dd] = ri[0] * boxt[0*3+dd] + ri[1] * boxt[1*3+dd] + ri[2] * boxt[2*3+dd];
+    }
+  }
+  deepmd::Region<double> region;
+  init_region_cpu(region, &boxt[0]);
+  int mem_cpy = nloc * 27, nall;
+  std::vector<double> posi_cpy(mem_cpy * 3);
+  std::vector<int> atype_cpy(mem_cpy), mapping(mem_cpy);
+  int ret = copy_coord_cpu(
+      &posi_cpy[0], &atype_cpy[0], &mapping[0], &nall,
+      &posi[0], &atype[0], nloc, mem_cpy, rc, region);
+  EXPECT_EQ(ret, 0);
+
+  int mem_size = 200;
+  std::vector<int> ilist(nloc), numneigh(nloc);
+  std::vector<std::vector<int>> jlist(nloc, std::vector<int>(mem_size));
+  std::vector<int*> firstneigh(nloc);
+  std::vector<int> ilist_cell(nloc), numneigh_cell(nloc);
+  std::vector<std::vector<int>> jlist_cell(nloc, std::vector<int>(mem_size));
+  std::vector<int*> firstneigh_cell(nloc);
+  for(int ii = 0; ii < nloc; ++ii){
+    firstneigh[ii] = &jlist[ii][0];
+    firstneigh_cell[ii] = &jlist_cell[ii][0];
+  }
+  deepmd::InputNlist nlist(nloc, &ilist[0], &numneigh[0], &firstneigh[0]);
+  deepmd::InputNlist nlist_cell(nloc, &ilist_cell[0], &numneigh_cell[0], &firstneigh_cell[0]);
+  int max_list_size, max_list_size_cell;
+  ret = build_nlist_cpu(
+      nlist, &max_list_size, &posi_cpy[0], nloc, nall, mem_size, rc);
+  EXPECT_EQ(ret, 0);
+  ret = deepmd::build_nlist_cell_cpu(
+      nlist_cell, &max_list_size_cell, &posi_cpy[0], nloc, nall, mem_size, rc, region);
+  EXPECT_EQ(ret, 0);
+  EXPECT_EQ(max_list_size_cell, max_list_size);
+  for(int ii = 0; ii < nloc; ++ii){
+    EXPECT_EQ(nlist_cell.ilist[ii], nlist.ilist[ii]);
+    EXPECT_EQ(nlist_cell.numneigh[ii], nlist.numneigh[ii]);
+    for(int jj = 0; jj < nlist.numneigh[ii]; ++jj){
+      EXPECT_EQ(nlist_cell.firstneigh[ii][jj], nlist.firstneigh[ii][jj]);
+    }
+  }
+}
+
+TEST_F(TestNeighborList, cpu_skin)
+{
+  int mem_size = 40;
+  float skin = 2.;
+  std::vector<int> ilist_skin(nloc), numneigh_skin(nloc);
+  std::vector<std::vector<int>> jlist_skin(nloc, std::vector<int>(mem_size));
+  std::vector<int*> firstneigh_skin(nloc);
+  for(int ii = 0; ii < nloc; ++ii){
+    firstneigh_skin[ii] = &jlist_skin[ii][0];
+  }
+  deepmd::InputNlist nlist_skin(nloc, &ilist_skin[0], &numneigh_skin[0], &firstneigh_skin[0]);
+  int max_list_size;
+  int ret = build_nlist_cpu(
+      nlist_skin,
+      &max_list_size,
+      &posi_cpy[0],
+      nloc,
+      nall,
+      mem_size,
+      rc + skin);
+  EXPECT_EQ(ret, 0);
+  EXPECT_GT(max_list_size, 5);
+  // the superset is valid as long as no atom moves more than skin/2
+  std::vector<double> posi_move(posi);
+  posi_move[0] += 0.9;
+  EXPECT_TRUE(deepmd::nlist_skin_valid_cpu(&posi_move[0], &posi[0], nloc, skin));
+  posi_move[4] -= 1.1;
+  EXPECT_FALSE(deepmd::nlist_skin_valid_cpu(&posi_move[0], &posi[0], nloc, skin));
+  // filter the superset down to rc
+  std::vector<int> ilist(nloc), numneigh(nloc);
+  std::vector<std::vector<int>> jlist(nloc);
+  std::vector<int*> firstneigh(nloc);
+  for(int ii = 0; ii < nloc; ++ii){
+    jlist[ii].resize(numneigh_skin[ii]);
+    firstneigh[ii] = &jlist[ii][0];
+  }
+  deepmd::InputNlist nlist(nloc, &ilist[0], &numneigh[0], &firstneigh[0]);
+  deepmd::filter_nlist_cpu(
+      nlist,
+      &max_list_size,
+      nlist_skin,
+      &posi_cpy[0],
+      rc);
+  EXPECT_EQ(nlist.inum, nloc);
+  EXPECT_EQ(max_list_size, 5);
+  for(int ii = 0; ii < nloc; ++ii){
+    EXPECT_EQ(nlist.ilist[ii], ii);
+    EXPECT_EQ(nlist.numneigh[ii], expect_nlist_cpy[ii].size());
+    std::sort(nlist.firstneigh[ii], nlist.firstneigh[ii] + nlist.numneigh[ii]);
+    for(int jj = 0; jj < nlist.numneigh[ii]; ++jj){
+      EXPECT_EQ(nlist.firstneigh[ii][jj], expect_nlist_cpy[ii][jj]);
+    }
+  }
+}
+
 #if GOOGLE_CUDA
 TEST_F(TestNeighborList, gpu)
 {
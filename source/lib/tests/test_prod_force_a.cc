@@ -98,6 +98,22 @@ TEST_F(TestProdForceA, cpu)
   // printf("\n");
 }
 
+TEST_F(TestProdForceA, cpu_split)
+{
+  // the forces of the two halves of the atoms sum to the total force
+  std::vector<double> force(nall * 3), force_1(nall * 3);
+  int nloc_0 = nloc / 2;
+  deepmd::prod_force_a_cpu<double> (&force[0], &net_deriv[0], &env_deriv[0], &nlist[0], nloc_0, nall, nnei, 0);
+  deepmd::prod_force_a_cpu<double> (&force_1[0], &net_deriv[0], &env_deriv[0], &nlist[0], nloc - nloc_0, nall, nnei, nloc_0);
+  for (int jj = 0; jj < nall * 3; ++jj){
+    force[jj] += force_1[jj];
+  }
+  EXPECT_EQ(force.size(), expected_force.size());
+  for (int jj = 0; jj < force.size(); ++jj){
+    EXPECT_LT(fabs(force[jj] - expected_force[jj]) , 1e-5);
+  }
+}
+
 #if GOOGLE_CUDA
 TEST_F(TestProdForceA, gpu_cuda)
 {
@@ -155,6 +155,24 @@ TEST_F(TestTabulateSeA, tabulate_fusion_se_a_cpu)
   }
 }
 
+TEST_F(TestTabulateSeA, tabulate_fusion_se_a_soa_cpu)
+{
+  const int nspline = table.size() / (last_layer_size * 6);
+  std::vector<double> table_soa(table.size());
+  deepmd::tabulate_fusion_se_a_table_soa_cpu<double>(&table_soa[0], &table[0], nspline, last_layer_size);
+  std::vector<double> xyz_scatter(nloc * nnei * last_layer_size);
+  deepmd::tabulate_fusion_se_a_soa_cpu<double>(&xyz_scatter[0], &table_soa[0], &info[0], &em_x[0], &em[0], nloc, nnei, last_layer_size);
+  EXPECT_EQ(xyz_scatter.size(), expected_xyz_scatter.size());
+  for (int jj = 0; jj < xyz_scatter.size(); ++jj){
+    EXPECT_LT(fabs(xyz_scatter[jj] - expected_xyz_scatter[jj]) , 1e-5);
+  }
+  std::vector<double> xyz_scatter_ref(nloc * nnei * last_layer_size);
+  deepmd::tabulate_fusion_se_a_cpu<double>(&xyz_scatter_ref[0], &table[0], &info[0], &em_x[0], &em[0], nloc, nnei, last_layer_size);
+  for (int jj = 0; jj < xyz_scatter.size(); ++jj){
+    EXPECT_LT(fabs(xyz_scatter[jj] - xyz_scatter_ref[jj]) , 1e-12);
+  }
+}
+
 TEST_F(TestTabulateSeA, tabulate_fusion_se_a_grad_cpu)
 {
   std::vector<double> dy_dem_x(em_x.size());
@@ -62,10 +62,18 @@ static int stringCmp(const void *a, const void* b)
 }
 
 int PairDeepMD::get_node_rank() {
+    MPI_Comm nodeComm = get_node_comm();
+    int myrank;
+    MPI_Comm_rank(nodeComm, &myrank);
+    MPI_Comm_free(&nodeComm);
+    return myrank;
+}
+
+MPI_Comm PairDeepMD::get_node_comm() {
     char host_name[MPI_MAX_PROCESSOR_NAME];
     memset(host_name, '\0', sizeof(char) * MPI_MAX_PROCESSOR_NAME);
     char (*host_names)[MPI_MAX_PROCESSOR_NAME];
-    int n, namelen, color, rank, nprocs, myrank;
+    int n, namelen, color, rank, nprocs;
     size_t bytes;
     MPI_Comm nodeComm;
     
@@ -99,13 +107,10 @@ int PairDeepMD::get_node_rank() {
     }
 
     MPI_Comm_split(MPI_COMM_WORLD, color, 0, &nodeComm);
-    MPI_Comm_rank(nodeComm, &myrank);
 
     MPI_Barrier(MPI_COMM_WORLD);
-    int looprank=myrank;
-    // printf (" Assigning device %d  to process on node %s rank %d, OK\n",looprank,  host_name, rank );
     free(host_names);
-    return looprank;
+    return nodeComm;
 }
 
 std::string PairDeepMD::get_file_content(const std::string & model) {
@@ -139,6 +144,60 @@ std::vector<std::string> PairDeepMD::get_file_content(const std::vector<std::str
   return file_contents;
 }
 
+void PairDeepMD::init_shared_models(const std::vector<std::string> & models) {
+  // the first process on each node maps the model files into shared memory,
+  // the others on the node attach to them instead of receiving the bytes
+  MPI_Comm node_comm = get_node_comm();
+  int node_rank = 0;
+  MPI_Comm_rank(node_comm, &node_rank);
+  std::vector<deepmd::SharedModelFile> shared_files(models.size());
+  std::vector<std::string> names(models.size());
+  if (node_rank == 0) {
+    try {
+      for (unsigned ii = 0; ii < models.size(); ++ii) {
+	shared_files[ii].create(models[ii], "/deepmd_" + std::to_string(ii) + "_");
+	names[ii] = shared_files[ii].name();
+      }
+    } catch(deepmd::deepmd_exception& e) {
+      error->one(FLERR, e.what());
+    }
+  }
+  // the segment names are only known to the creator
+  for (unsigned ii = 0; ii < models.size(); ++ii) {
+    int nchar = names[ii].size();
+    MPI_Bcast(&nchar, 1, MPI_INT, 0, node_comm);
+    names[ii].resize(nchar);
+    MPI_Bcast(&names[ii][0], nchar, MPI_CHAR, 0, node_comm);
+  }
+  if (node_rank != 0) {
+    try {
+      for (unsigned ii = 0; ii < models.size(); ++ii) {
+	shared_files[ii].attach(names[ii]);
+      }
+    } catch(deepmd::deepmd_exception& e) {
+      error->one(FLERR, e.what());
+    }
+  }
+  // the segments are removed when the creator releases them, which should
+  // not happen before every process on the node has attached
+  MPI_Barrier(node_comm);
+  std::vector<const char *> model_buffers(models.size());
+  std::vector<size_t> buffer_sizes(models.size());
+  for (unsigned ii = 0; ii < models.size(); ++ii) {
+    model_buffers[ii] = shared_files[ii].data();
+    buffer_sizes[ii] = shared_files[ii].size();
+  }
+  try {
+    deep_pot.init (models[0], node_rank, model_buffers[0], buffer_sizes[0]);
+    if (models.size() > 1) {
+      deep_pot_model_devi.init(models, node_rank, model_buffers, buffer_sizes);
+    }
+  } catch(deepmd::deepmd_exception& e) {
+    error->all(FLERR, e.what());
+  }
+  MPI_Comm_free(&node_comm);
+}
+
 static void 
 ana_st (double & max, 
 	double & min, 
@@ -260,6 +319,9 @@ PairDeepMD::PairDeepMD(LAMMPS *lmp)
   eps_v = 0.;
   scale = NULL;
   do_ttm = false;
+  warmup_steps = 0;
+  trace_freq = 0;
+  trace_file = "dp_trace";
   single_model = false;
   multi_models_mod_devi = false;
   multi_models_no_mod_devi = false;
@@ -369,6 +431,17 @@ void PairDeepMD::compute(int eflag, int vflag)
 
   // int ago = numb_models > 1 ? 0 : neighbor->ago;
   int ago = neighbor->ago;
+  if (warmup_steps > 0 && nlocal > 0) {
+    try {
+      deep_pot.warmup(nlocal, nghost, warmup_steps);
+      if (numb_models > 1) {
+	deep_pot_model_devi.warmup(nlocal, nghost, warmup_steps);
+      }
+    } catch(deepmd::deepmd_exception& e) {
+      error->one(FLERR, e.what());
+    }
+    warmup_steps = 0;
+  }
   if (numb_models > 1) {
       if (multi_models_no_mod_devi && (out_freq > 0 && update->ntimestep % out_freq == 0)) {
           ago = 0;
@@ -381,6 +454,16 @@ void PairDeepMD::compute(int eflag, int vflag)
   single_model = (numb_models == 1);
   multi_models_no_mod_devi = (numb_models > 1 && (out_freq == 0 || update->ntimestep % out_freq != 0));
   multi_models_mod_devi = (numb_models > 1 && (out_freq > 0 && update->ntimestep % out_freq == 0));
+  // only the first process is traced
+  if (trace_freq > 0 && update->ntimestep % trace_freq == 0 && comm->me == 0) {
+    std::string step_trace_file = trace_file + "_" + std::to_string(update->ntimestep) + ".json";
+    if (multi_models_mod_devi) {
+      deep_pot_model_devi.trace_next_compute(step_trace_file);
+    }
+    else {
+      deep_pot.trace_next_compute(step_trace_file);
+    }
+  }
   if (do_ghost) {
     deepmd::InputNlist lmp_list (list->inum, list->ilist, list->numneigh, list->firstneigh);
     if (single_model || multi_models_no_mod_devi) {
@@ -810,6 +893,10 @@ is_key (const string& input)
   keys.push_back("atomic");
   keys.push_back("relative");
   keys.push_back("relative_v");
+  keys.push_back("shm");
+  keys.push_back("warmup");
+  keys.push_back("trace_freq");
+  keys.push_back("trace_file");
 
   for (int ii = 0; ii < keys.size(); ++ii){
     if (input == keys[ii]) {
@@ -836,24 +923,38 @@ void PairDeepMD::settings(int narg, char **arg)
     models.push_back(arg[ii]);
   }
   numb_models = models.size();
+  // the models are loaded before the other keywords are parsed
+  bool use_shm = false;
+  for (int ii = iarg; ii < narg; ++ii){
+    if (string(arg[ii]) == string("shm")) {
+      use_shm = true;
+    }
+  }
+  if (use_shm) {
+    init_shared_models(models);
+  }
   if (numb_models == 1) {
+    if (!use_shm) {
     try {
     deep_pot.init (arg[0], get_node_rank(), get_file_content(arg[0]));
     } catch(deepmd::deepmd_exception& e) {
       error->all(FLERR, e.what());
     }
+    }
     cutoff = deep_pot.cutoff ();
     numb_types = deep_pot.numb_types();
     dim_fparam = deep_pot.dim_fparam();
     dim_aparam = deep_pot.dim_aparam();
   }
   else {
+    if (!use_shm) {
     try {
     deep_pot.init (arg[0], get_node_rank(), get_file_content(arg[0]));
     deep_pot_model_devi.init(models, get_node_rank(), get_file_content(models));
     } catch(deepmd::deepmd_exception& e) {
       error->all(FLERR, e.what());
     }
+    }
     cutoff = deep_pot_model_devi.cutoff();
     numb_types = deep_pot_model_devi.numb_types();
     dim_fparam = deep_pot_model_devi.dim_fparam();
@@ -943,6 +1044,26 @@ void PairDeepMD::settings(int narg, char **arg)
 #endif
       iarg += 2;
     }
+    else if (string(arg[iarg]) == string("shm")) {
+      iarg += 1;
+    }
+    else if (string(arg[iarg]) == string("warmup")) {
+      if (iarg+1 >= narg) error->all(FLERR,"Illegal warmup, not provided");
+      warmup_steps = atoi(arg[iarg+1]);
+      if (warmup_steps < 0) error->all(FLERR,"Illegal warmup, should be >= 0");
+      iarg += 2;
+    }
+    else if (string(arg[iarg]) == string("trace_freq")) {
+      if (iarg+1 >= narg) error->all(FLERR,"Illegal trace_freq, not provided");
+      trace_freq = atoi(arg[iarg+1]);
+      if (trace_freq < 0) error->all(FLERR,"Illegal trace_freq, should be >= 0");
+      iarg += 2;
+    }
+    else if (string(arg[iarg]) == string("trace_file")) {
+      if (iarg+1 >= narg) error->all(FLERR,"Illegal trace_file, not provided");
+      trace_file = string(arg[iarg+1]);
+      iarg += 2;
+    }
   }
   if (out_freq < 0) error->all(FLERR,"Illegal out_freq, should be >= 0");
   if (do_ttm && aparam.size() > 0) {
@@ -1049,6 +1170,28 @@ void PairDeepMD::coeff(int narg, char **arg)
 }
 
 
+void PairDeepMD::finish()
+{
+  // the timing is reported if DP_TIMING is set, only that of the first process,
+  // and restarted so that each run reports its own steps
+  if (comm->me == 0){
+    std::string report = deep_pot.get_timing_report("  ");
+    if (report.size() > 0) {
+      utils::logmesg(lmp, "DeePMD-kit timing of the first process:\n" + report);
+    }
+    if (numb_models > 1) {
+      report = deep_pot_model_devi.get_timing_report("  ");
+      if (report.size() > 0) {
+	utils::logmesg(lmp, "DeePMD-kit model deviation timing of the first process:\n" + report);
+      }
+    }
+  }
+  deep_pot.clear_timing();
+  if (numb_models > 1) {
+    deep_pot_model_devi.clear_timing();
+  }
+}
+
 void PairDeepMD::init_style()
 {
 #if LAMMPS_VERSION_NUMBER>=20220324
@@ -5,6 +5,8 @@
 #include "neighbor_list.h"
 #include "prod_env_mat.h"
 #include "errors.h"
+#include <mutex>
+#include <cstdlib>
 
 REGISTER_OP("ProdEnvMatA")
     .Attr("T: {float, double} = DT_DOUBLE")
@@ -189,7 +191,6 @@ _norm_copy_coord_cpu(
     const FPTYPE * box,
     const int * type,
     const int &nloc, 
-    const int &max_cpy_trial, 
     const float & rcut_r);
 
 template<typename FPTYPE>
@@ -205,6 +206,17 @@ _build_nlist_cpu(
     const int & nloc,
     const int & new_nall,
     const int & max_nnei_trial,
+    const float & rcut_r,
+    const deepmd::Region<FPTYPE> & region);
+
+template<typename FPTYPE>
+static void
+_init_nlist_region_cpu(
+    deepmd::Region<FPTYPE> & region,
+    const FPTYPE * coord,
+    const FPTYPE * box,
+    const int & nall,
+    const int & nei_mode,
     const float & rcut_r);
 
 static void
@@ -226,6 +238,67 @@ _map_nei_info_cpu(
     const int & ntypes,
     const bool & b_nlist_map);
 
+// the neighbor list built with rcut + skin, kept between the calls of an op.
+// it is reused as long as no atom moves more than half of the skin.
+template <typename FPTYPE>
+struct NlistSkinCache {
+  std::mutex mtx;
+  bool built = false;
+  int nloc = 0;
+  int nall = 0;
+  int nei_mode = 0;
+  int max_nnei = 0;
+  std::vector<FPTYPE> ref_coord;
+  std::vector<FPTYPE> ref_box;
+  // displacement of the copied atoms from their local images
+  std::vector<FPTYPE> shift;
+  std::vector<int> mapping;
+  std::vector<int> ilist, numneigh;
+  std::vector<int*> firstneigh;
+  std::vector<std::vector<int>> jlist;
+};
+
+static float
+_get_env_nlist_skin();
+
+// the candidate neighbors of the formatted nlist built from the lammps
+// nlist, kept between the steps while lammps does not rebuild its nlist.
+// the margins refer to ref_coord.
+template <typename FPTYPE>
+struct FmtNlistCache {
+  std::mutex mtx;
+  bool built = false;
+  int nloc = 0;
+  int nall = 0;
+  std::vector<FPTYPE> ref_coord;
+  std::vector<int> cand;
+  std::vector<FPTYPE> margin;
+};
+
+static bool
+_get_env_fmt_nlist_cache();
+
+template <typename FPTYPE>
+static void
+_prod_env_mat_a_cand_cpu(
+    FmtNlistCache<FPTYPE> & cache,
+    FPTYPE * em,
+    FPTYPE * em_deriv,
+    FPTYPE * rij,
+    int * nlist,
+    const FPTYPE * coord,
+    const int * type,
+    const deepmd::InputNlist & inlist,
+    const int & max_nbor_size,
+    const FPTYPE * avg,
+    const FPTYPE * std,
+    const int & nloc,
+    const int & nall,
+    const float & rcut_r,
+    const float & rcut_r_smth,
+    const std::vector<int> & sec_a,
+    const int & ago);
+
 template <typename FPTYPE>
 static void
 _prepare_coord_nlist_cpu(
@@ -249,7 +322,32 @@ _prepare_coord_nlist_cpu(
     const int & nloc,
     const int & nei_mode,
     const float & rcut_r,
-    const int & max_cpy_trial,
+    const int & max_nnei_trial);
+
+template <typename FPTYPE>
+static void
+_prepare_coord_nlist_skin_cpu(
+    OpKernelContext* context,
+    NlistSkinCache<FPTYPE> & cache,
+    FPTYPE const ** coord,
+    std::vector<FPTYPE> & coord_cpy,
+    int const** type,
+    std::vector<int> & type_cpy,
+    std::vector<int> & idx_mapping,
+    deepmd::InputNlist & inlist,
+    std::vector<int> & ilist,
+    std::vector<int> & numneigh,
+    std::vector<int*> & firstneigh,
+    std::vector<std::vector<int>> & jlist,
+    int & new_nall,
+    int & mem_cpy,
+    int & mem_nnei,
+    int & max_nbor_size,
+    const FPTYPE * box,
+    const int & nloc,
+    const int & nei_mode,
+    const float & rcut_r,
+    const float & skin,
     const int & max_nnei_trial);
 
 #if GOOGLE_CUDA
@@ -449,6 +547,9 @@ public:
     mem_cpy = 256;
     max_nnei_trial = 100;
     mem_nnei = 256;
+    nlist_skin = _get_env_nlist_skin();
+    OP_REQUIRES (context, (nlist_skin >= 0), errors::InvalidArgument ("DP_NLIST_SKIN should not be negative"));
+    fmt_nlist_cache = _get_env_fmt_nlist_cache();
   }
 
   void Compute(OpKernelContext* context) override {
@@ -664,15 +765,33 @@ public:
       std::vector<int> type_cpy;
       int frame_nall = nall;
       // prepare coord and nlist
-      _prepare_coord_nlist_cpu<FPTYPE>(
-	  context, &coord, coord_cpy, &type, type_cpy, idx_mapping, 
-	  inlist, ilist, numneigh, firstneigh, jlist,
-	  frame_nall, mem_cpy, mem_nnei, max_nbor_size,
-	  box, mesh_tensor.flat<int>().data(), nloc, nei_mode, rcut_r, max_cpy_trial, max_nnei_trial);
+      if (nlist_skin > 0 && nei_mode != 3 && nsamples == 1) {
+	_prepare_coord_nlist_skin_cpu<FPTYPE>(
+	    context, skin_cache, &coord, coord_cpy, &type, type_cpy, idx_mapping, 
+	    inlist, ilist, numneigh, firstneigh, jlist,
+	    frame_nall, mem_cpy, mem_nnei, max_nbor_size,
+	    box, nloc, nei_mode, rcut_r, nlist_skin, max_nnei_trial);
+      }
+      else {
+	_prepare_coord_nlist_cpu<FPTYPE>(
+	    context, &coord, coord_cpy, &type, type_cpy, idx_mapping, 
+	    inlist, ilist, numneigh, firstneigh, jlist,
+	    frame_nall, mem_cpy, mem_nnei, max_nbor_size,
+	    box, mesh_tensor.flat<int>().data(), nloc, nei_mode, rcut_r, max_nnei_trial);
+      }
       // launch the cpu compute function
-      deepmd::prod_env_mat_a_cpu(
-	  em, em_deriv, rij, nlist, 
-	  coord, type, inlist, max_nbor_size, avg, std, nloc, frame_nall, rcut_r, rcut_r_smth, sec_a);
+      if (fmt_nlist_cache && nei_mode == 3 && nsamples == 1) {
+	// mesh[0] is the number of steps since lammps built its nlist
+	_prod_env_mat_a_cand_cpu<FPTYPE>(
+	    fmt_cache, em, em_deriv, rij, nlist, 
+	    coord, type, inlist, max_nbor_size, avg, std, nloc, frame_nall, rcut_r, rcut_r_smth, sec_a,
+	    mesh_tensor.flat<int>().data()[0]);
+      }
+      else {
+	deepmd::prod_env_mat_a_cpu(
+	    em, em_deriv, rij, nlist, 
+	    coord, type, inlist, max_nbor_size, avg, std, nloc, frame_nall, rcut_r, rcut_r_smth, sec_a);
+      }
       // do nlist mapping if coords were copied
       if(b_nlist_map) _map_nlist_cpu(nlist, &idx_mapping[0], nloc, nnei);
     }
@@ -692,6 +811,10 @@ private:
   int nnei, nnei_a, nnei_r, nloc, nall, max_nbor_size;
   int mem_cpy, max_cpy_trial;
   int mem_nnei, max_nnei_trial;
+  float nlist_skin;
+  NlistSkinCache<FPTYPE> skin_cache;
+  bool fmt_nlist_cache;
+  FmtNlistCache<FPTYPE> fmt_cache;
   std::string device;
   int * array_int = NULL;
   unsigned long long * array_longlong = NULL;
@@ -716,6 +839,8 @@ public:
     mem_cpy = 256;
     max_nnei_trial = 100;
     mem_nnei = 256;
+    nlist_skin = _get_env_nlist_skin();
+    OP_REQUIRES (context, (nlist_skin >= 0), errors::InvalidArgument ("DP_NLIST_SKIN should not be negative"));
   }
 
   void Compute(OpKernelContext* context) override {
@@ -929,11 +1054,20 @@ public:
       std::vector<int> type_cpy;
       int frame_nall = nall;
       // prepare coord and nlist
-      _prepare_coord_nlist_cpu<FPTYPE>(
-	  context, &coord, coord_cpy, &type, type_cpy, idx_mapping, 
-	  inlist, ilist, numneigh, firstneigh, jlist,
-	  frame_nall, mem_cpy, mem_nnei, max_nbor_size,
-	  box, mesh_tensor.flat<int>().data(), nloc, nei_mode, rcut, max_cpy_trial, max_nnei_trial);
+      if (nlist_skin > 0 && nei_mode != 3 && nsamples == 1) {
+	_prepare_coord_nlist_skin_cpu<FPTYPE>(
+	    context, skin_cache, &coord, coord_cpy, &type, type_cpy, idx_mapping, 
+	    inlist, ilist, numneigh, firstneigh, jlist,
+	    frame_nall, mem_cpy, mem_nnei, max_nbor_size,
+	    box, nloc, nei_mode, rcut, nlist_skin, max_nnei_trial);
+      }
+      else {
+	_prepare_coord_nlist_cpu<FPTYPE>(
+	    context, &coord, coord_cpy, &type, type_cpy, idx_mapping, 
+	    inlist, ilist, numneigh, firstneigh, jlist,
+	    frame_nall, mem_cpy, mem_nnei, max_nbor_size,
+	    box, mesh_tensor.flat<int>().data(), nloc, nei_mode, rcut, max_nnei_trial);
+      }
       // launch the cpu compute function
       deepmd::prod_env_mat_r_cpu(
           em, em_deriv, rij, nlist, 
@@ -955,6 +1089,8 @@ private:
   int nnei, ndescrpt, nloc, nall, max_nbor_size;
   int mem_cpy, max_cpy_trial;
   int mem_nnei, max_nnei_trial;
+  float nlist_skin;
+  NlistSkinCache<FPTYPE> skin_cache;
   std::string device;
   int * array_int = NULL;
   unsigned long long * array_longlong = NULL;
@@ -1240,7 +1376,7 @@ public:
 	  context, &coord, coord_cpy, &f_type, type_cpy, idx_mapping, 
 	  inlist, ilist, numneigh, firstneigh, jlist,
 	  frame_nall, mem_cpy, mem_nnei, max_nbor_size,
-	  box, mesh_tensor.flat<int>().data(), nloc, nei_mode, rcut_r, max_cpy_trial, max_nnei_trial);
+	  box, mesh_tensor.flat<int>().data(), nloc, nei_mode, rcut_r, max_nnei_trial);
       // launch the cpu compute function
       deepmd::prod_env_mat_a_cpu(
 	  em, em_deriv, rij, nlist, 
@@ -1284,7 +1420,6 @@ _norm_copy_coord_cpu(
     const FPTYPE * box,
     const int * type,
     const int &nloc, 
-    const int &max_cpy_trial, 
     const float & rcut_r)
 {
   std::vector<FPTYPE> tmp_coord(nall*3);
@@ -1292,22 +1427,25 @@ _norm_copy_coord_cpu(
   deepmd::Region<FPTYPE> region;
   init_region_cpu(region, box);
   normalize_coord_cpu(&tmp_coord[0], nall, region);
-  int tt;
-  for(tt = 0; tt < max_cpy_trial; ++tt){
+  coord_cpy.resize(mem_cpy*3);
+  type_cpy.resize(mem_cpy);
+  idx_mapping.resize(mem_cpy);
+  int ret = copy_coord_cpu(
+      &coord_cpy[0], &type_cpy[0], &idx_mapping[0], &nall, 
+      &tmp_coord[0], type, nloc, mem_cpy, rcut_r, region);
+  if (ret == 1) {
+    // the exact nall is given when the buffers are too small, so the copy is
+    // redone at most once. the buffers grow with some headroom, as nall
+    // changes slightly from step to step
+    mem_cpy = nall + nall / 8;
     coord_cpy.resize(mem_cpy*3);
     type_cpy.resize(mem_cpy);
     idx_mapping.resize(mem_cpy);
-    int ret = copy_coord_cpu(
+    ret = copy_coord_cpu(
 	&coord_cpy[0], &type_cpy[0], &idx_mapping[0], &nall, 
 	&tmp_coord[0], type, nloc, mem_cpy, rcut_r, region);
-    if(ret == 0){
-      break;
-    }
-    else{
-      mem_cpy *= 2;
-    }
   }
-  return (tt != max_cpy_trial);
+  return (ret == 0);
 }
 
 template<typename FPTYPE>
@@ -1323,7 +1461,8 @@ _build_nlist_cpu(
     const int & nloc,
     const int & new_nall,
     const int & max_nnei_trial,
-    const float & rcut_r)
+    const float & rcut_r,
+    const deepmd::Region<FPTYPE> & region)
 {
   int tt;
   for(tt = 0; tt < max_nnei_trial; ++tt){
@@ -1332,9 +1471,9 @@ _build_nlist_cpu(
       firstneigh[ii] = &jlist[ii][0];
     }
     deepmd::InputNlist inlist(nloc, &ilist[0], &numneigh[0], &firstneigh[0]);
-    int ret = build_nlist_cpu(
+    int ret = build_nlist_cell_cpu(
 	inlist, &max_nnei, 
-	coord, nloc, new_nall, mem_nnei, rcut_r);
+	coord, nloc, new_nall, mem_nnei, rcut_r, region);
     if(ret == 0){
       break;
     }
@@ -1345,6 +1484,38 @@ _build_nlist_cpu(
   return (tt != max_nnei_trial);
 }
     
+template<typename FPTYPE>
+static void
+_init_nlist_region_cpu(
+    deepmd::Region<FPTYPE> & region,
+    const FPTYPE * coord,
+    const FPTYPE * box,
+    const int & nall,
+    const int & nei_mode,
+    const float & rcut_r)
+{
+  if(nei_mode == 1){
+    init_region_cpu(region, box);
+    return;
+  }
+  // no pbc, the cells are laid out in the bounding box of the atoms
+  FPTYPE lo[3], hi[3];
+  for(int dd = 0; dd < 3; ++dd){
+    lo[dd] = hi[dd] = nall > 0 ? coord[dd] : 0;
+  }
+  for(int ii = 1; ii < nall; ++ii){
+    for(int dd = 0; dd < 3; ++dd){
+      lo[dd] = std::min(lo[dd], coord[ii*3+dd]);
+      hi[dd] = std::max(hi[dd], coord[ii*3+dd]);
+    }
+  }
+  FPTYPE boxt[9] = {0};
+  for(int dd = 0; dd < 3; ++dd){
+    boxt[dd*3+dd] = std::max(hi[dd] - lo[dd], (FPTYPE)rcut_r);
+  }
+  init_region_cpu(region, boxt);
+}
+
 static void
 _map_nlist_cpu(
     int * nlist,
@@ -1400,7 +1571,6 @@ _prepare_coord_nlist_cpu(
     const int & nloc,
     const int & nei_mode,
     const float & rcut_r,
-    const int & max_cpy_trial,
     const int & max_nnei_trial)
 {    
   inlist.inum = nloc;
@@ -1410,15 +1580,17 @@ _prepare_coord_nlist_cpu(
     if(nei_mode == 1){
       int copy_ok = _norm_copy_coord_cpu(
 	  coord_cpy, type_cpy, idx_mapping, new_nall, mem_cpy,
-	  *coord, box, *type, nloc, max_cpy_trial, rcut_r);
+	  *coord, box, *type, nloc, rcut_r);
       OP_REQUIRES (context, copy_ok, errors::Aborted("cannot allocate mem for copied coords"));
       *coord = &coord_cpy[0];
       *type = &type_cpy[0];
     }
     // build nlist
+    deepmd::Region<FPTYPE> region;
+    _init_nlist_region_cpu(region, *coord, box, new_nall, nei_mode, rcut_r);
     int build_ok = _build_nlist_cpu(
 	ilist, numneigh, firstneigh, jlist, max_nbor_size, mem_nnei,
-	*coord, nloc, new_nall, max_nnei_trial, rcut_r);
+	*coord, nloc, new_nall, max_nnei_trial, rcut_r, region);
     OP_REQUIRES (context, build_ok, errors::Aborted("cannot allocate mem for nlist"));
     inlist.ilist = &ilist[0];
     inlist.numneigh = &numneigh[0];
@@ -1433,6 +1605,175 @@ _prepare_coord_nlist_cpu(
   }
 }
 
+static float
+_get_env_nlist_skin()
+{
+  // the skin of the cached neighbor list, 0 (default) disables the cache
+  const char* env_skin = std::getenv("DP_NLIST_SKIN");
+  if (env_skin == NULL) {
+    return 0.;
+  }
+  return std::atof(env_skin);
+}
+
+static bool
+_get_env_fmt_nlist_cache()
+{
+  // cache the formatted lammps nlist between the steps, disabled by default
+  const char* env_cache = std::getenv("DP_FMT_NLIST_CACHE");
+  if (env_cache == NULL) {
+    return false;
+  }
+  return std::atoi(env_cache) != 0;
+}
+
+template <typename FPTYPE>
+static void
+_prod_env_mat_a_cand_cpu(
+    FmtNlistCache<FPTYPE> & cache,
+    FPTYPE * em,
+    FPTYPE * em_deriv,
+    FPTYPE * rij,
+    int * nlist,
+    const FPTYPE * coord,
+    const int * type,
+    const deepmd::InputNlist & inlist,
+    const int & max_nbor_size,
+    const FPTYPE * avg,
+    const FPTYPE * std,
+    const int & nloc,
+    const int & nall,
+    const float & rcut_r,
+    const float & rcut_r_smth,
+    const std::vector<int> & sec_a,
+    const int & ago)
+{
+  std::lock_guard<std::mutex> lock(cache.mtx);
+  FPTYPE max_disp = 0;
+  if (ago == 0 || !cache.built || cache.nloc != nloc || cache.nall != nall) {
+    // lammps has rebuilt its nlist, all the candidates are selected again
+    cache.nloc = nloc;
+    cache.nall = nall;
+    cache.ref_coord.assign(coord, coord + nall*3);
+    cache.cand.resize(nloc * sec_a.back());
+    cache.margin.assign(nloc, -1);
+    cache.built = true;
+  }
+  else {
+    // the largest displacement of the local and ghost atoms
+    FPTYPE max_disp2 = 0;
+    for (int ii = 0; ii < nall*3; ii += 3) {
+      FPTYPE diff[3];
+      for (int dd = 0; dd < 3; ++dd) {
+	diff[dd] = coord[ii+dd] - cache.ref_coord[ii+dd];
+      }
+      max_disp2 = std::max(max_disp2, deepmd::dot3(diff, diff));
+    }
+    max_disp = sqrt(max_disp2);
+  }
+  deepmd::prod_env_mat_a_cand_cpu(
+      em, em_deriv, rij, nlist, &cache.cand[0], &cache.margin[0], max_disp,
+      coord, type, inlist, max_nbor_size, avg, std, nloc, rcut_r, rcut_r_smth, sec_a);
+}
+
+template <typename FPTYPE>
+static void
+_prepare_coord_nlist_skin_cpu(
+    OpKernelContext* context,
+    NlistSkinCache<FPTYPE> & cache,
+    FPTYPE const ** coord,
+    std::vector<FPTYPE> & coord_cpy,
+    int const** type,
+    std::vector<int> & type_cpy,
+    std::vector<int> & idx_mapping,
+    deepmd::InputNlist & inlist,
+    std::vector<int> & ilist,
+    std::vector<int> & numneigh,
+    std::vector<int*> & firstneigh,
+    std::vector<std::vector<int>> & jlist,
+    int & new_nall,
+    int & mem_cpy,
+    int & mem_nnei,
+    int & max_nbor_size,
+    const FPTYPE * box,
+    const int & nloc,
+    const int & nei_mode,
+    const float & rcut_r,
+    const float & skin,
+    const int & max_nnei_trial)
+{
+  std::lock_guard<std::mutex> lock(cache.mtx);
+  bool rebuild = !cache.built || cache.nloc != nloc || cache.nei_mode != nei_mode;
+  if (!rebuild && nei_mode == 1) {
+    rebuild = !std::equal(box, box+9, cache.ref_box.begin());
+  }
+  if (!rebuild) {
+    rebuild = !deepmd::nlist_skin_valid_cpu(*coord, &cache.ref_coord[0], nloc, skin);
+  }
+  if (rebuild) {
+    cache.built = false;
+    cache.nloc = nloc;
+    cache.nei_mode = nei_mode;
+    cache.ref_coord.assign(*coord, *coord + nloc*3);
+    cache.ref_box.assign(box, box+9);
+    cache.ilist.resize(nloc);
+    cache.numneigh.resize(nloc);
+    cache.firstneigh.resize(nloc);
+    cache.jlist.resize(nloc);
+    cache.nall = nloc;
+    const FPTYPE * build_coord = *coord;
+    std::vector<FPTYPE> skin_coord_cpy;
+    std::vector<int> skin_type_cpy;
+    if (nei_mode == 1) {
+      // copy the images within rcut + skin
+      int copy_ok = _norm_copy_coord_cpu(
+	  skin_coord_cpy, skin_type_cpy, cache.mapping, cache.nall, mem_cpy,
+	  *coord, box, *type, nloc, rcut_r + skin);
+      OP_REQUIRES (context, copy_ok, errors::Aborted("cannot allocate mem for copied coords"));
+      cache.shift.resize(cache.nall*3);
+      for (int ii = 0; ii < cache.nall; ++ii) {
+	for (int dd = 0; dd < 3; ++dd) {
+	  cache.shift[ii*3+dd] = skin_coord_cpy[ii*3+dd] - (*coord)[cache.mapping[ii]*3+dd];
+	}
+      }
+      build_coord = &skin_coord_cpy[0];
+    }
+    deepmd::Region<FPTYPE> region;
+    _init_nlist_region_cpu(region, build_coord, box, cache.nall, nei_mode, rcut_r + skin);
+    int build_ok = _build_nlist_cpu(
+	cache.ilist, cache.numneigh, cache.firstneigh, cache.jlist, cache.max_nnei, mem_nnei,
+	build_coord, nloc, cache.nall, max_nnei_trial, rcut_r + skin, region);
+    OP_REQUIRES (context, build_ok, errors::Aborted("cannot allocate mem for nlist"));
+    cache.built = true;
+  }
+  new_nall = cache.nall;
+  if (nei_mode == 1) {
+    // move the copied atoms together with their local images
+    coord_cpy.resize(new_nall*3);
+    type_cpy.resize(new_nall);
+    idx_mapping.assign(cache.mapping.begin(), cache.mapping.begin() + new_nall);
+    for (int ii = 0; ii < new_nall; ++ii) {
+      const int i_idx = idx_mapping[ii];
+      for (int dd = 0; dd < 3; ++dd) {
+	coord_cpy[ii*3+dd] = (*coord)[i_idx*3+dd] + cache.shift[ii*3+dd];
+      }
+      type_cpy[ii] = (*type)[i_idx];
+    }
+    *coord = &coord_cpy[0];
+    *type = &type_cpy[0];
+  }
+  // filter the cached nlist down to rcut
+  for (int ii = 0; ii < nloc; ++ii) {
+    jlist[ii].resize(cache.numneigh[ii]);
+    firstneigh[ii] = jlist[ii].data();
+  }
+  deepmd::InputNlist skin_inlist(nloc, &cache.ilist[0], &cache.numneigh[0], &cache.firstneigh[0]);
+  inlist.ilist = &ilist[0];
+  inlist.numneigh = &numneigh[0];
+  inlist.firstneigh = &firstneigh[0];
+  deepmd::filter_nlist_cpu(inlist, &max_nbor_size, skin_inlist, *coord, rcut_r);
+}
+
 #if GOOGLE_CUDA
 template<typename FPTYPE>
 static int
@@ -59,7 +59,6 @@ _norm_copy_coord_cpu(
     const FPTYPE * box,
     const int * type,
     const int &nloc, 
-    const int &max_cpy_trial, 
     const float & rcut_r);
 
 template<typename FPTYPE>
@@ -107,7 +106,6 @@ _prepare_coord_nlist_cpu(
     const int & nloc,
     const int & nei_mode,
     const float & rcut_r,
-    const int & max_cpy_trial,
     const int & max_nnei_trial);
 
 // instance of function
@@ -124,7 +122,6 @@ _norm_copy_coord_cpu(
     const FPTYPE * box,
     const int * type,
     const int &nloc, 
-    const int &max_cpy_trial, 
     const float & rcut_r)
 {
   std::vector<FPTYPE> tmp_coord(nall*3);
@@ -132,22 +129,25 @@ _norm_copy_coord_cpu(
   deepmd::Region<FPTYPE> region;
   init_region_cpu(region, box);
   normalize_coord_cpu(&tmp_coord[0], nall, region);
-  int tt;
-  for(tt = 0; tt < max_cpy_trial; ++tt){
+  coord_cpy.resize(mem_cpy*3);
+  type_cpy.resize(mem_cpy);
+  idx_mapping.resize(mem_cpy);
+  int ret = copy_coord_cpu(
+      &coord_cpy[0], &type_cpy[0], &idx_mapping[0], &nall, 
+      &tmp_coord[0], type, nloc, mem_cpy, rcut_r, region);
+  if (ret == 1) {
+    // the exact nall is given when the buffers are too small, so the copy is
+    // redone at most once. the buffers grow with some headroom, as nall
+    // changes slightly from step to step
+    mem_cpy = nall + nall / 8;
     coord_cpy.resize(mem_cpy*3);
     type_cpy.resize(mem_cpy);
     idx_mapping.resize(mem_cpy);
-    int ret = copy_coord_cpu(
+    ret = copy_coord_cpu(
 	&coord_cpy[0], &type_cpy[0], &idx_mapping[0], &nall, 
 	&tmp_coord[0], type, nloc, mem_cpy, rcut_r, region);
-    if(ret == 0){
-      break;
-    }
-    else{
-      mem_cpy *= 2;
-    }
   }
-  return (tt != max_cpy_trial);
+  return (ret == 0);
 }
 
 template<typename FPTYPE>
@@ -225,7 +225,6 @@ _prepare_coord_nlist_cpu(
     const int & nloc,
     const int & nei_mode,
     const float & rcut_r,
-    const int & max_cpy_trial,
     const int & max_nnei_trial)
 {    
   inlist.inum = nloc;
@@ -235,7 +234,7 @@ _prepare_coord_nlist_cpu(
     if(nei_mode == 1){
       int copy_ok = _norm_copy_coord_cpu(
 	  coord_cpy, type_cpy, idx_mapping, new_nall, mem_cpy,
-	  *coord, box, *type, nloc, max_cpy_trial, rcut_r);
+	  *coord, box, *type, nloc, rcut_r);
       OP_REQUIRES (context, copy_ok, errors::Aborted("cannot allocate mem for copied coords"));
       *coord = &coord_cpy[0];
       *type = &type_cpy[0];
@@ -451,7 +450,7 @@ public:
 	  context, &coord, coord_cpy, &type, type_cpy, idx_mapping, 
 	  inlist, ilist, numneigh, firstneigh, jlist,
 	  frame_nall, mem_cpy, mem_nnei, max_nbor_size,
-	  box, mesh_tensor.flat<int>().data(), nloc, nei_mode, rcut_r, max_cpy_trial, max_nnei_trial);
+	  box, mesh_tensor.flat<int>().data(), nloc, nei_mode, rcut_r, max_nnei_trial);
       // launch the cpu compute function
       deepmd::prod_env_mat_a_nvnmd_quantize_cpu(
 	  em, em_deriv, rij, nlist, 
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "custom_op.h"
 #include "prod_virial.h"
 
@@ -121,9 +122,14 @@ class ProdVirialSeAOp : public OpKernel {
       #endif // TENSORFLOW_USE_ROCM
     }
     else if (device == "CPU") {
+      // skip the atom virial if no one consumes it
+      const bool need_atom_virial = context->output_required(1);
       deepmd::prod_virial_a_cpu(    
-          virial, atom_virial,
+          virial, need_atom_virial ? atom_virial : NULL,
           net_deriv, in_deriv, rij, nlist, nloc, nall, nnei);
+      if (!need_atom_virial) {
+        std::fill(atom_virial, atom_virial + nall * 9, (FPTYPE)0.);
+      }
     }
     }
   }
@@ -1,3 +1,5 @@
+#include <memory>
+#include <mutex>
 #include "custom_op.h"
 #include "tabulate.h"
 
@@ -178,14 +180,33 @@ class TabulateFusionSeAOp : public OpKernel {
       #endif // TENSORFLOW_USE_ROCM
     }
     else if (device == "CPU") {
-      deepmd::tabulate_fusion_se_a_cpu(    
+      // the table is a constant of the graph, so its channel-major copy is
+      // built once and reused while the input is the same buffer. the source
+      // tensor is held so that its address cannot be recycled.
+      const int nspline = table_tensor.shape().dim_size(0);
+      std::shared_ptr<const std::vector<FPTYPE> > soa;
+      {
+        std::lock_guard<std::mutex> lock(table_soa_mtx);
+        if (!table_soa || !table_soa_src.SharesBufferWith(table_tensor) || table_soa_src.shape().dim_size(0) != nspline || table_soa->size() != table_tensor.NumElements()) {
+          std::shared_ptr<std::vector<FPTYPE> > tmp(new std::vector<FPTYPE>(table_tensor.NumElements()));
+          deepmd::tabulate_fusion_se_a_table_soa_cpu(
+              &(*tmp)[0], table, nspline, last_layer_size);
+          table_soa = tmp;
+          table_soa_src = table_tensor;
+        }
+        soa = table_soa;
+      }
+      deepmd::tabulate_fusion_se_a_soa_cpu(    
           descriptor,
-          table, table_info, em_x, em, nloc, nnei, last_layer_size);
+          &(*soa)[0], table_info, em_x, em, nloc, nnei, last_layer_size);
     }
   }
 private:
     int last_layer_size;
     std::string device;
+    std::mutex table_soa_mtx;
+    Tensor table_soa_src;
+    std::shared_ptr<const std::vector<FPTYPE> > table_soa;
 };
 
 template<typename Device, typename FPTYPE>